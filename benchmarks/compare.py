@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+# Runs rsbench and checks its results against a stored baseline.
+#
+# A case fails when its ns_per_frame is more than the tolerance (default
+# 25%, RS_BENCH_TOLERANCE overrides it) above the baseline's, or when it
+# makes more allocations per frame than that tolerance, and half an
+# allocation, allow. Cases missing from either side are reported
+# and skipped. With --update the results become the new baseline.
+#
+# Without a baseline it exits 77, which meson reports as a skipped test.
+# Allocation counts of the code paths don't depend on the machine, so
+# with --allocs-only a baseline recorded elsewhere still gates them.
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        return {r['name']: r for r in json.load(f)['results']}
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('rsbench')
+    parser.add_argument('baseline')
+    parser.add_argument('results')
+    parser.add_argument('--plugin-path', help='directory holding the built plugin')
+    parser.add_argument('--update', action='store_true', help='store the results as the baseline')
+    parser.add_argument('--frames', default='300')
+    parser.add_argument('--allocs-only', action='store_true', help='only check allocations, not timings')
+    args = parser.parse_args()
+
+    env = dict(os.environ)
+    if args.plugin_path:
+        env['GST_PLUGIN_PATH'] = args.plugin_path
+    run = subprocess.run([args.rsbench, '--frames', args.frames, '--output', args.results], env=env)
+    if run.returncode != 0:
+        print('rsbench failed with %d' % run.returncode)
+        return 1
+
+    if args.update:
+        with open(args.results) as src, open(args.baseline, 'w') as dst:
+            dst.write(src.read())
+        print('baseline written to %s' % args.baseline)
+        return 0
+
+    results = load(args.results)
+    if not os.path.exists(args.baseline):
+        print('no baseline at %s, record one with --update' % args.baseline)
+        return 77
+    baseline = load(args.baseline)
+    tolerance = float(os.environ.get('RS_BENCH_TOLERANCE', '0.25'))
+
+    failed = []
+    for name, base in sorted(baseline.items()):
+        result = results.get(name)
+        if result is None:
+            print('%-40s missing from results' % name)
+            continue
+        ratio = result['ns_per_frame'] / base['ns_per_frame'] if base['ns_per_frame'] > 0 else 1.0
+        status = 'ok'
+        if ratio > 1.0 + tolerance and not args.allocs_only:
+            status = 'SLOWER'
+        # counts of the code paths are exact, those of pipelines vary with thread timing
+        elif base['allocs_per_frame'] >= 0 and result['allocs_per_frame'] > \
+                base['allocs_per_frame'] + max(0.5, base['allocs_per_frame'] * tolerance):
+            status = 'MORE ALLOCATIONS'
+        print('%-40s %12.0f ns/frame (%+6.1f%%) %8.2f allocs/frame  %s' % (
+            name, result['ns_per_frame'], (ratio - 1.0) * 100.0, result['allocs_per_frame'], status))
+        if status != 'ok':
+            failed.append(name)
+    for name in sorted(set(results) - set(baseline)):
+        print('%-40s not in baseline' % name)
+
+    if failed:
+        print('%d case(s) regressed past the baseline: %s' % (len(failed), ', '.join(failed)))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,663 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Benchmarks of the muxing, demuxing and metadata code paths and of whole
+ * realsensesrc ! rsdemux pipelines, on frames of the synthetic device so
+ * no camera is needed. Results are printed as JSON, one object per case:
+ *
+ *   ns_per_frame      mean wall time per frame
+ *   mb_per_s          frame bytes moved per second
+ *   allocs_per_frame  heap allocations per frame, of every thread
+ *   faults_per_frame  minor page faults per frame, of every thread
+ *   tlb_misses_per_frame  data TLB misses per frame of the calling thread,
+ *                     -1 where perf events are not available
+ *   p50_ns, p99_ns    per-frame latency percentiles
+ *
+ * Per-frame latency is the time of one call in the code path cases and
+ * capture to fakesink in the pipeline cases. The mux-pool and mux-alloc
+ * cases compare the default allocator with GstRealsenseAllocator's slabs
+ * with and without huge pages, from a buffer pool and fresh per frame.
+ * compare.py checks the results against a baseline.
+ *
+ * Usage: rsbench [--frames N] [--filter SUBSTRING] [--output FILE]
+ */
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/audio/audio.h>
+
+#include "common.hpp"
+#include "gstrealsenseallocator.h"
+#include "gstrealsensemeta.h"
+#include "rsimu.hpp"
+#include "rsmux.hpp"
+#include "rsstats.hpp"
+#include "rssynthetic.hpp"
+
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+GST_DEBUG_CATEGORY_STATIC(rsbench_debug);
+#define GST_CAT_DEFAULT rsbench_debug
+
+/* Every heap allocation of the process, GStreamer's and the SDK's included,
+ * counted by taking over the allocator entry points from glibc. */
+static std::atomic<uint64_t> allocations {0};
+
+#if defined(__GLIBC__)
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t align, size_t size);
+
+void* malloc(size_t size) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t align, size_t size) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(align, size);
+}
+
+void* aligned_alloc(size_t align, size_t size) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(align, size);
+}
+
+int posix_memalign(void** ptr, size_t align, size_t size) noexcept
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    *ptr = __libc_memalign(align, size);
+    return *ptr != nullptr ? 0 : ENOMEM;
+}
+}
+static constexpr bool counting_allocations = true;
+#else
+static constexpr bool counting_allocations = false;
+#endif
+
+/* Stands in for realsensesrc as the Source of RSMux. The null first word
+ * makes the GST_*_OBJECT macros log it as a plain pointer. */
+struct BenchSource
+{
+    gpointer instance = nullptr;
+    StreamType stream_type = StreamType::StreamMux;
+    gint gst_stride = 0;
+    bool imu_active = false;
+};
+
+struct BenchResult
+{
+    std::string name;
+    uint64_t frames = 0;
+    double ns_per_frame = 0.0;
+    double mb_per_s = 0.0;
+    double allocs_per_frame = 0.0;
+    double faults_per_frame = 0.0;
+    double tlb_misses_per_frame = -1.0;
+    uint64_t p50_ns = 0;
+    uint64_t p99_ns = 0;
+};
+
+struct BenchOptions
+{
+    uint64_t frames = 300;
+    std::string filter;
+    std::string output;
+};
+
+/* Minor page faults of the process so far */
+static uint64_t
+bench_page_faults()
+{
+    struct rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_minflt);
+}
+
+/* Data TLB load misses of the calling thread, while it lives. Containers
+ * and kernels with perf_event_paranoid set high do not allow it. */
+class BenchTlbCounter
+{
+public:
+    BenchTlbCounter()
+    {
+        perf_event_attr attr {};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~BenchTlbCounter()
+    {
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+    bool available() const { return fd_ >= 0; }
+
+    uint64_t read_count() const
+    {
+        uint64_t count = 0;
+        if (fd_ < 0 || read(fd_, &count, sizeof(count)) != sizeof(count))
+            return 0;
+        return count;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+/* Times frames runs of one(), after a few warm-up runs so pools are filled
+ * and tables built. one() returns the frame bytes it moved. */
+static BenchResult
+bench_loop(const std::string& name, uint64_t frames, const std::function<size_t()>& one)
+{
+    for (int i = 0; i < 5; ++i)
+        one();
+
+    RSHistogram latency;
+    size_t bytes = 0;
+    BenchTlbCounter tlb;
+    const auto tlb_start = tlb.read_count();
+    const auto faults_start = bench_page_faults();
+    const auto allocs_start = allocations.load();
+    const auto start = RSStats::now();
+    for (uint64_t i = 0; i < frames; ++i)
+    {
+        const auto t = RSStats::now();
+        bytes += one();
+        latency.record(static_cast<uint64_t>(RSStats::now() - t));
+    }
+    const auto elapsed = RSStats::now() - start;
+    const auto allocs = allocations.load() - allocs_start;
+    const auto faults = bench_page_faults() - faults_start;
+    const auto tlb_misses = tlb.read_count() - tlb_start;
+
+    BenchResult result;
+    result.name = name;
+    result.frames = frames;
+    result.ns_per_frame = static_cast<double>(elapsed) / frames;
+    result.mb_per_s = elapsed > 0 ? bytes * 1e3 / elapsed : 0.0;
+    result.allocs_per_frame = counting_allocations ? static_cast<double>(allocs) / frames : -1.0;
+    result.faults_per_frame = static_cast<double>(faults) / frames;
+    result.tlb_misses_per_frame = tlb.available() ? static_cast<double>(tlb_misses) / frames : -1.0;
+    result.p50_ns = latency.percentile(0.5);
+    result.p99_ns = latency.percentile(0.99);
+    return result;
+}
+
+/* Header realsensesrc writes for frame_set */
+static RSHeader
+bench_header(rs2::frameset& frame_set, const BenchSource& src, const RSImuBatch* imu)
+{
+    auto cframe = frame_set.get_color_frame();
+    auto depth = frame_set.get_depth_frame();
+    RSHeader header {};
+    header.color_width = cframe.get_width();
+    header.color_height = cframe.get_height();
+    header.color_stride = src.gst_stride;
+    header.color_format = GST_VIDEO_FORMAT_RGB;
+    header.depth_width = depth.get_width();
+    header.depth_height = depth.get_height();
+    header.depth_stride = depth.get_stride_in_bytes();
+    header.depth_format = GST_VIDEO_FORMAT_GRAY16_LE;
+    header.accel_format = GST_AUDIO_FORMAT_UNKNOWN;
+    header.gyro_format = GST_AUDIO_FORMAT_UNKNOWN;
+    header.color_fps = cframe.get_profile().fps();
+    header.depth_fps = depth.get_profile().fps();
+    if (imu != nullptr)
+    {
+        header.accel_format = GST_AUDIO_FORMAT_F32LE;
+        header.gyro_format = GST_AUDIO_FORMAT_F32LE;
+        header.imu_rate = RSSynthetic::GyroRate;
+        header.imu_count = static_cast<int>(imu->count);
+    }
+    return header;
+}
+
+/* One batch of the samples a 400 Hz gyro gives per frame at 30 fps */
+static RSImuBatch
+bench_imu_batch()
+{
+    RSImuBatch batch {};
+    batch.count = RSSynthetic::GyroRate / 30;
+    for (size_t i = 0; i < batch.count * RSImuBatch::Channels; ++i)
+        batch.samples[i] = static_cast<float>(i);
+    return batch;
+}
+
+/* RSMux::mux into buffers of each allocator, taken from a buffer pool as
+ * realsensesrc does and allocated fresh per frame as when the pool runs
+ * dry, so the A/B of page faults and TLB misses shows in the results */
+static void
+bench_allocators(rs2::frameset& frame_set, const RSHeader& header, const BenchSource& src,
+    const std::string& suffix, const BenchOptions& options, std::vector<BenchResult>& results)
+{
+    struct Variant
+    {
+        const char* name;
+        bool slab;
+        HugePages huge_pages;
+    };
+    const Variant variants[] = {
+        {"system", false, HugePagesOff},
+        {"slab", true, HugePagesOff},
+        {"slab-thp", true, HugePagesTransparent},
+        {"slab-hugetlb", true, HugePagesExplicit},
+    };
+
+    const auto size = RSMux::buffer_size(frame_set, header, &src, nullptr);
+    auto params = RSMux::allocation_params();
+    for (const auto& variant : variants)
+    {
+        const auto pool_name = std::string("mux-pool/") + variant.name + suffix;
+        const auto alloc_name = std::string("mux-alloc/") + variant.name + suffix;
+        if (!options.filter.empty() && pool_name.find(options.filter) == std::string::npos &&
+            alloc_name.find(options.filter) == std::string::npos)
+            continue;
+
+        auto allocator = variant.slab ? gst_realsense_allocator_new(variant.huge_pages, FALSE) : nullptr;
+
+        auto pool = gst_buffer_pool_new();
+        auto config = gst_buffer_pool_get_config(pool);
+        gst_buffer_pool_config_set_params(config, nullptr, static_cast<guint>(size), 2, 0);
+        gst_buffer_pool_config_set_allocator(config, allocator, &params);
+        gst_buffer_pool_set_config(pool, config);
+        gst_buffer_pool_set_active(pool, TRUE);
+        if (pool_name.find(options.filter) != std::string::npos)
+        {
+            results.push_back(bench_loop(pool_name, options.frames, [&] {
+                GstBuffer* buffer = nullptr;
+                gst_buffer_pool_acquire_buffer(pool, &buffer, nullptr);
+                buffer = RSMux::mux(frame_set, header, &src, buffer, nullptr);
+                const auto bytes = gst_buffer_get_size(buffer);
+                gst_buffer_unref(buffer);
+                return bytes;
+            }));
+        }
+        gst_buffer_pool_set_active(pool, FALSE);
+        gst_object_unref(pool);
+
+        if (alloc_name.find(options.filter) != std::string::npos)
+        {
+            results.push_back(bench_loop(alloc_name, options.frames, [&] {
+                auto buffer = gst_buffer_new_allocate(allocator, size, &params);
+                buffer = RSMux::mux(frame_set, header, &src, buffer, nullptr);
+                const auto bytes = gst_buffer_get_size(buffer);
+                gst_buffer_unref(buffer);
+                return bytes;
+            }));
+        }
+
+        if (allocator != nullptr)
+        {
+            const auto counters = gst_realsense_allocator_get_counters(allocator);
+            GST_INFO("%s: peak %" G_GUINT64_FORMAT " bytes, %" G_GUINT64_FORMAT " slab refills, %s pages",
+                variant.name, counters.peak, counters.refills, counters.huge ? "hugetlbfs" : "anonymous");
+            gst_object_unref(allocator);
+        }
+    }
+}
+
+/* Mux, demux and metadata of one resolution, on a frameset held for the
+ * whole run so only the code under test runs in the loop. */
+static void
+bench_code_paths(int width, int height, const BenchOptions& options, std::vector<BenchResult>& results)
+{
+    RSSyntheticSettings settings;
+    settings.width = width;
+    settings.height = height;
+    RSSynthetic synthetic(settings);
+    synthetic.start(true, true, false);
+    auto frame_set = synthetic.wait_for_frames();
+    synthetic.stop();
+
+    const auto size = std::to_string(width) + "x" + std::to_string(height);
+    auto wanted = [&](const std::string& name) {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    };
+    const auto imu_batch = bench_imu_batch();
+
+    struct Combination
+    {
+        const char* name;
+        StreamType stream_type;
+        bool imu;
+    };
+    const Combination combinations[] = {
+        {"color", StreamType::StreamColor, false},
+        {"depth", StreamType::StreamDepth, false},
+        {"color+depth", StreamType::StreamMux, false},
+        {"color+depth+imu", StreamType::StreamMux, true},
+    };
+
+    for (const auto& combination : combinations)
+    {
+        BenchSource src;
+        src.stream_type = combination.stream_type;
+        src.imu_active = combination.imu;
+        src.gst_stride = combination.stream_type == StreamType::StreamDepth ?
+            width * static_cast<int>(sizeof(uint16_t)) : width * 3;
+        const RSImuBatch* imu = combination.imu ? &imu_batch : nullptr;
+        const auto header = bench_header(frame_set, src, imu);
+        const auto suffix = std::string("/") + combination.name + "/" + size;
+
+        // the buffer comes back each frame, as from a pool
+        if (wanted("mux" + suffix))
+        {
+            GstBuffer* buffer = nullptr;
+            results.push_back(bench_loop("mux" + suffix, options.frames, [&] {
+                buffer = RSMux::mux(frame_set, header, &src, buffer, imu);
+                return gst_buffer_get_size(buffer);
+            }));
+            gst_buffer_unref(buffer);
+        }
+
+        if (wanted("mux-zero-copy" + suffix))
+        {
+            results.push_back(bench_loop("mux-zero-copy" + suffix, options.frames, [&] {
+                auto buffer = RSMux::mux_zero_copy(frame_set, header, &src, imu);
+                const auto bytes = gst_buffer_get_size(buffer);
+                gst_buffer_unref(buffer);
+                return bytes;
+            }));
+        }
+
+        if (combination.stream_type == StreamType::StreamMux && !combination.imu)
+            bench_allocators(frame_set, header, src, suffix, options, results);
+
+        if (combination.stream_type != StreamType::StreamMux || !wanted("demux" + suffix))
+            continue;
+
+        auto muxed = RSMux::mux(frame_set, header, &src, nullptr, imu);
+        results.push_back(bench_loop("demux" + suffix, options.frames, [&] {
+            RSMuxPrefix prefix;
+            RSMux::GetRSHeader(&src, muxed, &prefix);
+            auto subs = RSMux::demux(muxed, prefix);
+            size_t bytes = 0;
+            for (auto sub : {std::get<0>(subs), std::get<1>(subs), std::get<2>(subs)})
+            {
+                if (sub == nullptr)
+                    continue;
+                bytes += gst_buffer_get_size(sub);
+                gst_buffer_unref(sub);
+            }
+            return bytes;
+        }));
+        gst_buffer_unref(muxed);
+    }
+
+    // what realsensesrc attaches to every buffer, and what copying a buffer's metadata costs
+    GstRealsenseMeta values {};
+    values.depth_units = RSSynthetic::DepthUnits;
+    values.json_descr = g_intern_static_string("");
+    auto source = gst_buffer_new();
+    auto copy = gst_buffer_new();
+    if (wanted("meta-attach/" + size))
+    {
+        results.push_back(bench_loop("meta-attach/" + size, options.frames, [&] {
+            auto meta = gst_buffer_add_realsense_meta_from(source, &values);
+            gst_buffer_remove_meta(source, &meta->meta);
+            return sizeof(GstRealsenseMeta);
+        }));
+    }
+    if (wanted("meta-transform/" + size))
+    {
+        gst_buffer_add_realsense_meta_from(source, &values);
+        results.push_back(bench_loop("meta-transform/" + size, options.frames, [&] {
+            gst_buffer_copy_into(copy, source, GST_BUFFER_COPY_META, 0, -1);
+            gst_buffer_remove_meta(copy, &gst_buffer_get_realsense_meta(copy)->meta);
+            return sizeof(GstRealsenseMeta);
+        }));
+    }
+    gst_buffer_unref(source);
+    gst_buffer_unref(copy);
+}
+
+struct PipelineRun
+{
+    GstElement* pipeline;
+    RSHistogram latency;
+    std::atomic<uint64_t> frames {0};
+    std::atomic<uint64_t> bytes {0};
+};
+
+/* Capture to fakesink: the running time now less the buffer's, which
+ * realsensesrc stamps with the capture time */
+static void
+bench_pipeline_handoff(GstElement * sink, GstBuffer * buffer, GstPad * pad, PipelineRun * run)
+{
+    run->bytes += gst_buffer_get_size(buffer);
+    auto clock = gst_element_get_clock(sink);
+    if (clock == nullptr)
+        return;
+    const auto now = gst_clock_get_time(clock) - gst_element_get_base_time(sink);
+    gst_object_unref(clock);
+
+    // the color sink counts frames, depth only mode has no color sink
+    if (g_str_has_prefix(GST_ELEMENT_NAME(sink), "color") || g_str_has_prefix(GST_ELEMENT_NAME(sink), "single"))
+    {
+        ++run->frames;
+        if (GST_BUFFER_PTS_IS_VALID(buffer) && now > GST_BUFFER_PTS(buffer))
+            run->latency.record(now - GST_BUFFER_PTS(buffer));
+    }
+}
+
+/* A whole realsensesrc ! rsdemux pipeline on the synthetic device, at a
+ * frame rate above what it can do so it runs as fast as it can */
+static bool
+bench_pipeline(int width, int height, StreamType stream_type, bool imu, const BenchOptions& options,
+    std::vector<BenchResult>& results)
+{
+    const char* combination = stream_type == StreamType::StreamColor ? "color" :
+        stream_type == StreamType::StreamDepth ? "depth" : imu ? "color+depth+imu" : "color+depth";
+    const auto name = std::string("pipeline/") + combination + "/" + std::to_string(width) + "x" + std::to_string(height);
+    if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+        return true;
+
+    auto src = g_strdup_printf("realsensesrc synthetic=true synthetic-width=%d synthetic-height=%d synthetic-fps=1000 "
+        "stream-type=%d imu-on=%s num-buffers=%" G_GUINT64_FORMAT, width, height, static_cast<int>(stream_type),
+        imu ? "true" : "false", options.frames + 10);
+    auto description = stream_type == StreamType::StreamMux ?
+        g_strdup_printf("%s ! rsdemux name=demux demux.color ! fakesink name=color sync=false signal-handoffs=true "
+            "demux.depth ! fakesink name=depth sync=false signal-handoffs=true %s", src,
+            imu ? "demux.imu ! fakesink name=imu sync=false signal-handoffs=true" : "") :
+        g_strdup_printf("%s ! fakesink name=single sync=false signal-handoffs=true", src);
+    g_free(src);
+
+    GError* error = nullptr;
+    PipelineRun run;
+    run.pipeline = gst_parse_launch(description, &error);
+    g_free(description);
+    if (run.pipeline == nullptr || error != nullptr)
+    {
+        g_printerr("%s: %s\n", name.c_str(), error != nullptr ? error->message : "could not build pipeline");
+        g_clear_error(&error);
+        if (run.pipeline != nullptr)
+            gst_object_unref(run.pipeline);
+        return false;
+    }
+
+    for (auto sink_name : {"color", "depth", "imu", "single"})
+    {
+        auto sink = gst_bin_get_by_name(GST_BIN(run.pipeline), sink_name);
+        if (sink == nullptr)
+            continue;
+        g_signal_connect(sink, "handoff", G_CALLBACK(bench_pipeline_handoff), &run);
+        gst_object_unref(sink);
+    }
+
+    const auto allocs_start = allocations.load();
+    const auto start = RSStats::now();
+    gst_element_set_state(run.pipeline, GST_STATE_PLAYING);
+    auto bus = gst_element_get_bus(run.pipeline);
+    auto msg = gst_bus_timed_pop_filtered(bus, 120 * GST_SECOND,
+        static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+    const auto elapsed = RSStats::now() - start;
+    const auto allocs = allocations.load() - allocs_start;
+
+    bool ok = msg != nullptr && GST_MESSAGE_TYPE(msg) == GST_MESSAGE_EOS;
+    if (!ok)
+    {
+        if (msg != nullptr)
+        {
+            gst_message_parse_error(msg, &error, nullptr);
+            g_printerr("%s: %s\n", name.c_str(), error->message);
+            g_clear_error(&error);
+        }
+        else
+        {
+            g_printerr("%s: timed out\n", name.c_str());
+        }
+    }
+    if (msg != nullptr)
+        gst_message_unref(msg);
+    gst_object_unref(bus);
+    gst_element_set_state(run.pipeline, GST_STATE_NULL);
+    gst_object_unref(run.pipeline);
+
+    const auto frames = run.frames.load();
+    if (!ok || frames == 0)
+        return false;
+
+    // includes starting the device, which the first frames pay for either way
+    BenchResult result;
+    result.name = name;
+    result.frames = frames;
+    result.ns_per_frame = static_cast<double>(elapsed) / frames;
+    result.mb_per_s = elapsed > 0 ? run.bytes * 1e3 / elapsed : 0.0;
+    result.allocs_per_frame = counting_allocations ? static_cast<double>(allocs) / frames : -1.0;
+    result.p50_ns = run.latency.percentile(0.5);
+    result.p99_ns = run.latency.percentile(0.99);
+    results.push_back(result);
+    return true;
+}
+
+static std::string
+bench_json(const std::vector<BenchResult>& results)
+{
+    std::string json = "{\n  \"version\": 1,\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const auto& r = results[i];
+        auto entry = g_strdup_printf("    {\"name\": \"%s\", \"frames\": %" G_GUINT64_FORMAT ", "
+            "\"ns_per_frame\": %.1f, \"mb_per_s\": %.1f, \"allocs_per_frame\": %.2f, "
+            "\"faults_per_frame\": %.2f, \"tlb_misses_per_frame\": %.1f, "
+            "\"p50_ns\": %" G_GUINT64_FORMAT ", \"p99_ns\": %" G_GUINT64_FORMAT "}%s\n",
+            r.name.c_str(), r.frames, r.ns_per_frame, r.mb_per_s, r.allocs_per_frame, r.faults_per_frame,
+            r.tlb_misses_per_frame, r.p50_ns, r.p99_ns,
+            i + 1 < results.size() ? "," : "");
+        json += entry;
+        g_free(entry);
+    }
+    json += "  ]\n}\n";
+    return json;
+}
+
+int
+main(int argc, char** argv)
+{
+    gst_init(&argc, &argv);
+    GST_DEBUG_CATEGORY_INIT(rsbench_debug, "rsbench", 0, "RealSense benchmarks");
+
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc)
+            options.frames = std::max(1ull, std::strtoull(argv[++i], nullptr, 10));
+        else if (arg == "--filter" && i + 1 < argc)
+            options.filter = argv[++i];
+        else if (arg == "--output" && i + 1 < argc)
+            options.output = argv[++i];
+        else
+        {
+            g_printerr("Usage: %s [--frames N] [--filter SUBSTRING] [--output FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const int sizes[][2] = {{640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160}};
+    std::vector<BenchResult> results;
+    bool ok = true;
+    try
+    {
+        for (const auto& size : sizes)
+            bench_code_paths(size[0], size[1], options, results);
+
+        for (const auto& size : sizes)
+        {
+            ok &= bench_pipeline(size[0], size[1], StreamType::StreamColor, false, options, results);
+            ok &= bench_pipeline(size[0], size[1], StreamType::StreamDepth, false, options, results);
+            ok &= bench_pipeline(size[0], size[1], StreamType::StreamMux, false, options, results);
+            ok &= bench_pipeline(size[0], size[1], StreamType::StreamMux, true, options, results);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        g_printerr("rsbench: %s\n", e.what());
+        return 1;
+    }
+
+    const auto json = bench_json(results);
+    if (options.output.empty())
+    {
+        std::fputs(json.c_str(), stdout);
+    }
+    else if (!g_file_set_contents(options.output.c_str(), json.c_str(), -1, nullptr))
+    {
+        g_printerr("rsbench: cannot write %s\n", options.output.c_str());
+        return 1;
+    }
+    return ok ? 0 : 1;
+}
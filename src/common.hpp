@@ -21,6 +21,8 @@
 #ifndef __GST_RSCOMMON_H__
 #define __GST_RSCOMMON_H__
 
+#include <cstdint>
+
 enum StreamType
 {
   StreamColor,
@@ -35,6 +37,52 @@ enum Align
   Depth
 };
 
+// What to do when a bounded frame queue is full
+enum OverflowPolicy
+{
+  DropOldest,
+  DropNewest,
+  Block // wait for room, for sources that can be paced, like file playback
+};
+
+// Memory behind output buffers. Off leaves it to the default allocator,
+// the others use GstRealsenseAllocator's slabs.
+enum HugePages
+{
+  HugePagesOff,
+  HugePagesTransparent, // slabs the kernel may back with huge pages
+  HugePagesExplicit     // hugetlbfs pages, transparent ones if none are reserved
+};
+
+// Color format requested from the camera. YUYV is the sensor's native
+// format, the others are converted by the SDK on the CPU.
+enum ColorFormat
+{
+  ColorRGB8,
+  ColorBGR8,
+  ColorRGBA8,
+  ColorBGRA8,
+  ColorYUYV // YUY2 in GStreamer
+};
+
+// Frame content of the synthetic software device
+enum SyntheticPattern
+{
+  PatternStatic, // fixed bars and depth ramp, rendered once
+  PatternMoving, // bars and ramp scroll every frame
+  PatternNoise   // new random pixels every frame
+};
+
+// Streams of a muxed buffer as bits, for masks of the streams wanted
+// downstream or left out of a buffer
+enum StreamBit
+{
+  StreamBitColor = 1 << 0,
+  StreamBitDepth = 1 << 1,
+  StreamBitImu = 1 << 2,
+  StreamBitsAll = StreamBitColor | StreamBitDepth | StreamBitImu
+};
+
 struct RSHeader {
   int color_height;
   int color_width;
@@ -46,7 +94,15 @@ struct RSHeader {
   int depth_format;
   int accel_format;
   int gyro_format;
+  int imu_rate;       // samples per second of the IMU section
+  int imu_count;      // IMU samples in this buffer, see RSImuBatch
+  int64_t imu_offset; // ns from the buffer timestamp to the first IMU sample
+  int64_t depth_offset; // ns from the buffer timestamp to the depth frame
+  int color_fps;        // frame rate of the streams, 0 if unknown
+  int depth_fps;
+  int skipped;          // StreamBits whose section was left out, as nobody wanted them
 
+  // imu_count, the offsets and skipped change with every buffer and are not compared
   bool operator!=(const RSHeader &rhs)
   {
     if (color_height != rhs.color_height)
@@ -69,6 +125,12 @@ struct RSHeader {
       return true;
     if (gyro_format != rhs.gyro_format)
       return true;
+    if (imu_rate != rhs.imu_rate)
+      return true;
+    if (color_fps != rhs.color_fps)
+      return true;
+    if (depth_fps != rhs.depth_fps)
+      return true;
     return false;
   }
 
@@ -78,4 +140,54 @@ struct RSHeader {
   }
 };
 
+// The header as sources before RSMuxPrefix wrote it at the start of a
+// muxed buffer. Frozen, as recordings and unchanged sources still use it.
+struct RSHeaderV1 {
+  int32_t color_height;
+  int32_t color_width;
+  int32_t color_stride;
+  int32_t color_format;
+  int32_t depth_height;
+  int32_t depth_width;
+  int32_t depth_stride;
+  int32_t depth_format;
+  int32_t accel_format;
+  int32_t gyro_format;
+};
+
+// Every plane of a muxed buffer starts on a multiple of this many bytes,
+// so AVX-512 loads can read planes in place
+constexpr uint32_t RSMuxAlign = 64;
+
+// Planes of a muxed buffer, in the order they are laid out
+enum RSMuxPlaneIndex
+{
+  RSMuxColor,
+  RSMuxDepth,
+  RSMuxImu,
+  RSMuxPlanes
+};
+
+struct RSMuxPlane {
+  uint64_t offset;     // bytes from the start of the buffer
+  uint64_t size;       // 0 if the stream is not in this buffer
+  int32_t stride;      // bytes per row, 0 for IMU samples
+  int32_t reserved;
+  int64_t pts_offset;  // ns from the buffer timestamp to the stream's
+};
+
+// Start of a muxed buffer (video/x-realsense-mux). Buffers of older
+// versions begin with an RSHeaderV1, followed by the planes back to back.
+struct RSMuxPrefix {
+  static constexpr uint32_t Magic = 0x584d5352; // "RSMX"
+  static constexpr uint32_t Version = 2;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;     // bytes before the first plane, a multiple of RSMuxAlign
+  uint32_t n_planes;
+  RSMuxPlane planes[RSMuxPlanes];
+  RSHeader header;
+};
+
 #endif // __GST_RSCOMMON_H__
\ No newline at end of file
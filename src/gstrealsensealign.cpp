@@ -0,0 +1,506 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* GStreamer realsense align
+ *
+ * SECTION:element-rsalign
+ * @title: rsalign
+ *
+ * Aligns the depth and color planes of a muxed realsensesrc stream.
+ * rsalign gives the same result as the align property of realsensesrc, but
+ * runs outside the source's streaming thread, uses all cores and reuses its
+ * lookup tables until the calibration in the buffer metadata changes.
+ * The output is a muxed stream again, so it can feed rsdemux.
+ *
+ * ## Example launch line
+ * |[
+ *  gst-launch-1.0 realsensesrc stream-type=2 align=0 ! queue ! rsalign align=1 \
+ *  ! rsdemux name=demux \
+ *  ! queue ! videoconvert ! autovideosink \
+ *  demux. ! queue ! videoconvert ! autovideosink
+ * ]|
+ *
+ * This pipeline aligns depth to color on its own thread, then demuxes and
+ * renders both streams.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/video/video.h>
+#include <gst/audio/audio.h>
+
+#include "gstrealsensealign.h"
+#include "gstrealsensemeta.h"
+
+#include "rsmux.hpp"
+#include <cstring>
+#include <stdexcept>
+
+GST_DEBUG_CATEGORY_STATIC (rsalign_debug);
+#define GST_CAT_DEFAULT rsalign_debug
+
+enum
+{
+  PROP_0,
+  PROP_ALIGN,
+  PROP_N_THREADS,
+};
+
+static GstStaticPadTemplate sink_tmpl = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE
+        ("{ RGB, RGBA, BGR, BGRA, GRAY16_LE, GRAY16_BE, YUY2, UYVY }")
+        "; " RS_MUX_CAPS)
+    );
+
+static GstStaticPadTemplate src_tmpl = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (RS_MUX_CAPS)
+    );
+
+#define gst_rsalign_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstRSAlign, gst_rsalign, GST_TYPE_ELEMENT,
+  GST_DEBUG_CATEGORY_INIT(rsalign_debug, "rsalign", 0,
+  "Align element for Realsense plugin"));
+
+static void gst_rsalign_finalize (GObject * object);
+static void gst_rsalign_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_rsalign_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
+
+static gboolean gst_rsalign_sink_query (GstPad * pad, GstObject * parent, GstQuery * query);
+static gboolean gst_rsalign_handle_sink_event (GstPad * pad, GstObject * parent, GstEvent * event);
+static gboolean gst_rsalign_handle_src_event (GstPad * pad, GstObject * parent, GstEvent * event);
+static GstFlowReturn gst_rsalign_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer);
+static GstStateChangeReturn gst_rsalign_change_state (GstElement * element, GstStateChange transition);
+
+static void
+gst_rsalign_class_init (GstRSAlignClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+
+  gobject_class->finalize = gst_rsalign_finalize;
+  gobject_class->set_property = gst_rsalign_set_property;
+  gobject_class->get_property = gst_rsalign_get_property;
+
+  gstelement_class->change_state = GST_DEBUG_FUNCPTR (gst_rsalign_change_state);
+
+  gst_element_class_add_static_pad_template (gstelement_class, &sink_tmpl);
+  gst_element_class_add_static_pad_template (gstelement_class, &src_tmpl);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "RealSense Aligner", "Filter/Video",
+      "Align depth and color of a muxed RealSense stream",
+      "Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>");
+
+  g_object_class_install_property (gobject_class, PROP_ALIGN,
+    g_param_spec_int ("align", "Alignment",
+        "Alignment between Color and Depth sensors: 0 = none (pass through), "
+        "1 = depth to color, 2 = color to depth",
+        Align::None, Align::Depth, DEFAULT_PROP_RSALIGN_ALIGN,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_N_THREADS,
+    g_param_spec_uint ("n-threads", "Threads",
+        "Maximum number of threads used for alignment (0 = one per core)",
+        0, G_MAXUINT, DEFAULT_PROP_RSALIGN_N_THREADS,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+}
+
+static void
+gst_rsalign_init (GstRSAlign * rsalign)
+{
+  rsalign->sinkpad = gst_pad_new_from_static_template (&sink_tmpl, "sink");
+  gst_pad_set_chain_function (rsalign->sinkpad, GST_DEBUG_FUNCPTR (gst_rsalign_chain));
+  gst_pad_set_event_function (rsalign->sinkpad, GST_DEBUG_FUNCPTR (gst_rsalign_handle_sink_event));
+  gst_pad_set_query_function (rsalign->sinkpad, GST_DEBUG_FUNCPTR (gst_rsalign_sink_query));
+  gst_element_add_pad (GST_ELEMENT (rsalign), rsalign->sinkpad);
+
+  rsalign->srcpad = gst_pad_new_from_static_template (&src_tmpl, "src");
+  gst_pad_use_fixed_caps (rsalign->srcpad);
+  gst_pad_set_event_function (rsalign->srcpad, GST_DEBUG_FUNCPTR (gst_rsalign_handle_src_event));
+  gst_element_add_pad (GST_ELEMENT (rsalign), rsalign->srcpad);
+
+  rsalign->align = DEFAULT_PROP_RSALIGN_ALIGN;
+  rsalign->n_threads = DEFAULT_PROP_RSALIGN_N_THREADS;
+  rsalign->aligner = new RSAligner();
+}
+
+static void
+gst_rsalign_finalize (GObject * object)
+{
+  auto rsalign = GST_RSALIGN (object);
+  delete rsalign->aligner;
+  rsalign->aligner = nullptr;
+  gst_event_replace (&rsalign->pending_segment, nullptr);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_rsalign_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  auto rsalign = GST_RSALIGN (object);
+
+  switch (prop_id) {
+    case PROP_ALIGN:
+      GST_OBJECT_LOCK (rsalign);
+      rsalign->align = static_cast<Align>(g_value_get_int (value));
+      GST_OBJECT_UNLOCK (rsalign);
+      break;
+    case PROP_N_THREADS:
+      rsalign->n_threads = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_rsalign_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  auto rsalign = GST_RSALIGN (object);
+
+  switch (prop_id) {
+    case PROP_ALIGN:
+      g_value_set_int (value, rsalign->align);
+      break;
+    case PROP_N_THREADS:
+      g_value_set_uint (value, rsalign->n_threads);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* reset to default values before starting streaming */
+static void
+gst_rsalign_reset (GstRSAlign * rsalign)
+{
+  rsalign->in_header = {};
+  rsalign->out_header = {};
+  rsalign->have_caps = FALSE;
+  gst_event_replace (&rsalign->pending_segment, nullptr);
+}
+
+static gboolean
+gst_rsalign_sink_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  gboolean res = TRUE;
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_ALLOCATION:
+      // output caps differ from the input, so downstream cannot size a pool
+      // for upstream. Upstream falls back to its own pool.
+      res = FALSE;
+      break;
+    default:
+      res = gst_pad_query_default (pad, parent, query);
+      break;
+  }
+
+  return res;
+}
+
+static gboolean
+gst_rsalign_handle_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  auto rsalign = GST_RSALIGN (parent);
+  gboolean res = TRUE;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+      // output caps are derived from the muxed header in the chain function
+      gst_event_unref (event);
+      break;
+    case GST_EVENT_SEGMENT:
+      if (!rsalign->have_caps) {
+        // segment must not overtake caps downstream
+        gst_event_replace (&rsalign->pending_segment, event);
+        gst_event_unref (event);
+        break;
+      }
+      res = gst_pad_push_event (rsalign->srcpad, event);
+      break;
+    default:
+      res = gst_pad_event_default (pad, parent, event);
+      break;
+  }
+
+  return res;
+}
+
+static gboolean
+gst_rsalign_handle_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  int streams;
+  const gchar *sender;
+  if (RSMux::parse_streams_event (event, &streams, &sender)) {
+    // each plane is aligned from both, so only the IMU can be left out upstream
+    const auto wanted = streams | StreamBitColor | StreamBitDepth;
+    GST_DEBUG_OBJECT (parent, "%s wants streams 0x%x, asking for 0x%x", sender, streams, wanted);
+    auto forward = RSMux::streams_event (sender, wanted);
+    gst_event_unref (event);
+    return gst_pad_push_event (GST_RSALIGN (parent)->sinkpad, forward);
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+/* Header of the aligned output for an input header */
+static RSHeader
+gst_rsalign_out_header (const RSHeader& in, Align align)
+{
+  auto out = in;
+  if (align == Align::Color) {
+    out.depth_width = in.color_width;
+    out.depth_height = in.color_height;
+    out.depth_stride = in.color_width * static_cast<int>(sizeof(uint16_t));
+  }
+  else if (align == Align::Depth) {
+    GstVideoInfo info;
+    gst_video_info_init (&info);
+    gst_video_info_set_format (&info, static_cast<GstVideoFormat>(in.color_format), in.depth_width, in.depth_height);
+    out.color_width = in.depth_width;
+    out.color_height = in.depth_height;
+    out.color_stride = GST_VIDEO_INFO_COMP_STRIDE (&info, 0);
+  }
+  return out;
+}
+
+/* Same caps as realsensesrc gives a muxed stream of this geometry */
+static gboolean
+gst_rsalign_set_src_caps (GstRSAlign * rsalign, const RSHeader& header)
+{
+  auto caps = RSMux::caps (header, header.accel_format != GST_AUDIO_FORMAT_UNKNOWN);
+
+  GST_DEBUG_OBJECT (rsalign, "output caps %" GST_PTR_FORMAT, caps);
+  const auto res = gst_pad_set_caps (rsalign->srcpad, caps);
+  gst_caps_unref (caps);
+
+  if (res && rsalign->pending_segment) {
+    gst_pad_push_event (rsalign->srcpad, rsalign->pending_segment);
+    rsalign->pending_segment = nullptr;
+  }
+  return res;
+}
+
+/* New memory holding an aligned plane, written by fill(data). The memory
+ * starts on RSMuxAlign, like the planes realsensesrc copies. */
+template <typename Fill>
+static GstMemory*
+gst_rsalign_new_plane (gsize size, Fill&& fill)
+{
+  auto params = RSMux::allocation_params ();
+  auto mem = gst_allocator_alloc (nullptr, size, &params);
+  GstMapInfo map;
+  if (mem == nullptr || !gst_memory_map (mem, &map, GST_MAP_WRITE))
+    throw std::runtime_error ("failed to allocate aligned plane");
+  fill (map.data);
+  gst_memory_unmap (mem, &map);
+  return mem;
+}
+
+/* Aligned copy of buffer. Planes that do not change are shared, not copied. */
+static GstBuffer*
+gst_rsalign_process (GstRSAlign * rsalign, GstBuffer * buffer, const RSMuxPrefix& in_prefix, Align align)
+{
+  const auto& in = rsalign->in_header;
+  const auto& out = rsalign->out_header;
+
+  auto [colorbuf, depthbuf, imubuf] = RSMux::demux (buffer, in_prefix);
+  if (colorbuf == nullptr || depthbuf == nullptr) {
+    GST_ELEMENT_WARNING (rsalign, STREAM, DEMUX, ("Muxed buffer smaller than header describes."), (NULL));
+    if (colorbuf != nullptr)
+      gst_buffer_unref (colorbuf);
+    if (depthbuf != nullptr)
+      gst_buffer_unref (depthbuf);
+    if (imubuf != nullptr)
+      gst_buffer_unref (imubuf);
+    return nullptr;
+  }
+
+  GstMapInfo cmap, dmap;
+  gst_buffer_map (colorbuf, &cmap, GST_MAP_READ);
+  gst_buffer_map (depthbuf, &dmap, GST_MAP_READ);
+  const auto depth = reinterpret_cast<const uint16_t*>(dmap.data);
+
+  auto& pool = RSWorkerPool::shared ();
+  const auto threads = rsalign->n_threads;
+
+  // shared planes keep their memory, so the planes follow each other unpadded
+  const gsize color_size = align == Align::Color ? gst_buffer_get_size (colorbuf) :
+      static_cast<gsize>(out.color_height) * out.color_stride;
+  const gsize depth_size = align == Align::Color ? static_cast<gsize>(out.depth_height) * out.depth_stride :
+      gst_buffer_get_size (depthbuf);
+  const gsize imu_size = imubuf != nullptr ? gst_buffer_get_size (imubuf) : 0;
+  const auto out_prefix = RSMux::layout (out, color_size, depth_size, imu_size, 1);
+
+  auto outbuf = gst_buffer_new ();
+  gst_buffer_append_memory (outbuf, gst_rsalign_new_plane (out_prefix.size, [&](guint8* data) {
+    std::memset (data, 0, out_prefix.size);
+    std::memcpy (data, &out_prefix, sizeof (out_prefix));
+  }));
+
+  if (align == Align::Color) {
+    gst_buffer_copy_into (outbuf, colorbuf, GST_BUFFER_COPY_MEMORY, 0, -1);
+    gst_buffer_append_memory (outbuf, gst_rsalign_new_plane (depth_size, [&](guint8* data) {
+      rsalign->aligner->depth_to_color (depth, in.depth_stride,
+          reinterpret_cast<uint16_t*>(data), out.depth_stride, pool, threads);
+    }));
+  }
+  else {
+    const auto finfo = gst_video_format_get_info (static_cast<GstVideoFormat>(in.color_format));
+    const int bpp = GST_VIDEO_FORMAT_INFO_PSTRIDE (finfo, 0);
+    auto packing = RSPacking::None;
+    if (in.color_format == GST_VIDEO_FORMAT_YUY2)
+      packing = RSPacking::YUY2;
+    else if (in.color_format == GST_VIDEO_FORMAT_UYVY)
+      packing = RSPacking::UYVY;
+    gst_buffer_append_memory (outbuf, gst_rsalign_new_plane (color_size, [&](guint8* data) {
+      rsalign->aligner->color_to_depth (depth, in.depth_stride, cmap.data, in.color_stride,
+          bpp, data, out.color_stride, pool, threads, packing);
+    }));
+    gst_buffer_copy_into (outbuf, depthbuf, GST_BUFFER_COPY_MEMORY, 0, -1);
+  }
+
+  gst_buffer_unmap (colorbuf, &cmap);
+  gst_buffer_unmap (depthbuf, &dmap);
+
+  if (imubuf != nullptr) {
+    gst_buffer_copy_into (outbuf, imubuf, GST_BUFFER_COPY_MEMORY, 0, -1);
+    gst_buffer_unref (imubuf);
+  }
+  gst_buffer_unref (colorbuf);
+  gst_buffer_unref (depthbuf);
+
+  gst_buffer_copy_into (outbuf, buffer,
+      static_cast<GstBufferCopyFlags>(GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS | GST_BUFFER_COPY_META),
+      0, -1);
+
+  // both planes now have the geometry of the target camera
+  auto meta = gst_buffer_get_realsense_meta (outbuf);
+  if (meta != nullptr) {
+    if (align == Align::Color)
+      meta->depth_intrinsics = meta->color_intrinsics;
+    else
+      meta->color_intrinsics = meta->depth_intrinsics;
+    meta->depth_to_color = rs_identity_extrinsics ();
+  }
+
+  return outbuf;
+}
+
+static GstFlowReturn
+gst_rsalign_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  auto rsalign = GST_RSALIGN (parent);
+
+  GST_OBJECT_LOCK (rsalign);
+  const auto align = rsalign->align;
+  GST_OBJECT_UNLOCK (rsalign);
+
+  try
+  {
+    RSMuxPrefix prefix;
+    const auto header = RSMux::GetRSHeader (rsalign, buffer, &prefix);
+    const auto out_header = gst_rsalign_out_header (header, align);
+
+    // always take the new headers, the IMU fields change every buffer
+    const bool changed = !rsalign->have_caps || out_header != rsalign->out_header;
+    rsalign->in_header = header;
+    rsalign->out_header = out_header;
+    if (changed) {
+      if (!gst_rsalign_set_src_caps (rsalign, out_header)) {
+        gst_buffer_unref (buffer);
+        return GST_FLOW_NOT_NEGOTIATED;
+      }
+      rsalign->have_caps = TRUE;
+    }
+
+    if (align == Align::None)
+      return gst_pad_push (rsalign->srcpad, buffer);
+
+    const auto meta = gst_buffer_get_realsense_meta (buffer);
+    if (meta == nullptr || meta->depth_intrinsics.width != header.depth_width ||
+        meta->color_intrinsics.width != header.color_width) {
+      GST_ELEMENT_ERROR (rsalign, STREAM, FORMAT,
+          ("rsalign needs a muxed color and depth stream with calibration metadata from realsensesrc."), (NULL));
+      gst_buffer_unref (buffer);
+      return GST_FLOW_ERROR;
+    }
+
+    if (rsalign->aligner->configure (meta->depth_intrinsics, meta->color_intrinsics,
+        meta->depth_to_color, meta->depth_units)) {
+      GST_INFO_OBJECT (rsalign, "Built alignment tables for %dx%d depth, %dx%d color (%s)",
+          header.depth_width, header.depth_height, header.color_width, header.color_height,
+          RSGeometry::isa_name ());
+    }
+
+    auto outbuf = gst_rsalign_process (rsalign, buffer, prefix, align);
+    gst_buffer_unref (buffer);
+    if (outbuf == nullptr)
+      return GST_FLOW_OK;
+
+    return gst_pad_push (rsalign->srcpad, outbuf);
+  }
+  catch (const std::exception& e)
+  {
+    GST_ELEMENT_ERROR (rsalign, RESOURCE, FAILED, ("gst_rsalign_chain: %s", e.what ()), (NULL));
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
+}
+
+static GstStateChangeReturn
+gst_rsalign_change_state (GstElement * element, GstStateChange transition)
+{
+  auto rsalign = GST_RSALIGN (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_rsalign_reset (rsalign);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_rsalign_reset (rsalign);
+      break;
+    default:
+      break;
+  }
+  return ret;
+}
@@ -0,0 +1,76 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSALIGN_ELEMENT_H__
+#define __GST_RSALIGN_ELEMENT_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include "common.hpp"
+#include "rsalign.hpp"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_RSALIGN \
+  (gst_rsalign_get_type())
+#define GST_RSALIGN(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_RSALIGN,GstRSAlign))
+#define GST_RSALIGN_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_RSALIGN,GstRSAlignClass))
+#define GST_IS_RSALIGN(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_RSALIGN))
+#define GST_IS_RSALIGN_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_RSALIGN))
+
+#define DEFAULT_PROP_RSALIGN_ALIGN Align::Color
+#define DEFAULT_PROP_RSALIGN_N_THREADS 0
+
+typedef struct _GstRSAlign GstRSAlign;
+typedef struct _GstRSAlignClass GstRSAlignClass;
+
+struct _GstRSAlign {
+  GstElement     element;
+
+  GstPad        *sinkpad;
+  GstPad        *srcpad;
+
+  /* properties */
+  Align          align;
+  guint          n_threads;
+
+  /* stream state */
+  RSHeader       in_header;   // header of the last input buffer
+  RSHeader       out_header;  // header written to output buffers
+  gboolean       have_caps;
+  GstEvent      *pending_segment; // held until output caps are set
+
+  RSAligner     *aligner;
+};
+
+struct _GstRSAlignClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_rsalign_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_RSALIGN_ELEMENT_H__ */
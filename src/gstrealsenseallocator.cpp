@@ -0,0 +1,179 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Frame memory from huge page slabs
+ *
+ * GstRealsenseAllocator hands out 64-byte aligned memory carved from
+ * RSSlab's slabs, which are backed by transparent or explicit huge pages,
+ * prefaulted and optionally locked. realsensesrc uses it for its buffer
+ * pool when huge-pages is set, or when rsdemux proposes one downstream.
+ * A 4K frame then spans a dozen TLB entries instead of six thousand and
+ * never faults on the capture path.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstrealsenseallocator.h"
+
+#include <cstring>
+
+GST_DEBUG_CATEGORY_STATIC (rsallocator_debug);
+#define GST_CAT_DEFAULT rsallocator_debug
+
+typedef struct
+{
+  GstMemory mem;
+
+  guint8 *block;    /* as returned by the slab */
+  guint8 *data;     /* block moved up to the requested alignment */
+  gsize block_size; /* 0 for memory shared from another */
+} GstRealsenseMemory;
+
+#define gst_realsense_allocator_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstRealsenseAllocator, gst_realsense_allocator, GST_TYPE_ALLOCATOR,
+    GST_DEBUG_CATEGORY_INIT (rsallocator_debug, "rsallocator", 0, "RealSense frame memory allocator"));
+
+static GstMemory *
+gst_realsense_allocator_alloc (GstAllocator * allocator, gsize size, GstAllocationParams * params)
+{
+  auto self = GST_REALSENSE_ALLOCATOR (allocator);
+  const gsize maxsize = size + params->prefix + params->padding;
+  // slab blocks are RSSlab::Align aligned, larger alignments need room to move up
+  const gsize room = params->align >= RSSlab::Align ? params->align : 0;
+  const gsize block_size = maxsize + room;
+
+  auto block = static_cast<guint8 *> (self->slab->alloc (block_size));
+  if (block == nullptr) {
+    GST_WARNING_OBJECT (self, "Could not map a slab for %" G_GSIZE_FORMAT " bytes", block_size);
+    return nullptr;
+  }
+
+  auto mem = g_new (GstRealsenseMemory, 1);
+  gst_memory_init (GST_MEMORY_CAST (mem), params->flags, allocator, nullptr,
+      maxsize, params->align, params->prefix, size);
+  mem->block = block;
+  mem->data = reinterpret_cast<guint8 *> (
+      (reinterpret_cast<guintptr> (block) + room) & ~static_cast<guintptr> (room > 0 ? params->align : 0));
+  mem->block_size = block_size;
+
+  if (params->prefix > 0 && (params->flags & GST_MEMORY_FLAG_ZERO_PREFIXED))
+    std::memset (mem->data, 0, params->prefix);
+  if (params->padding > 0 && (params->flags & GST_MEMORY_FLAG_ZERO_PADDED))
+    std::memset (mem->data + params->prefix + size, 0, params->padding);
+
+  return GST_MEMORY_CAST (mem);
+}
+
+static void
+gst_realsense_allocator_free (GstAllocator * allocator, GstMemory * memory)
+{
+  auto mem = reinterpret_cast<GstRealsenseMemory *> (memory);
+
+  if (mem->block_size > 0)
+    GST_REALSENSE_ALLOCATOR (allocator)->slab->release (mem->block, mem->block_size);
+  g_free (mem);
+}
+
+static gpointer
+gst_realsense_memory_map (GstMemory * memory, gsize maxsize, GstMapFlags flags)
+{
+  return reinterpret_cast<GstRealsenseMemory *> (memory)->data;
+}
+
+static void
+gst_realsense_memory_unmap (GstMemory * memory)
+{
+}
+
+static GstMemory *
+gst_realsense_memory_share (GstMemory * memory, gssize offset, gssize size)
+{
+  auto mem = reinterpret_cast<GstRealsenseMemory *> (memory);
+  auto parent = memory->parent != nullptr ? memory->parent : memory;
+
+  if (size == -1)
+    size = memory->size - offset;
+
+  auto sub = g_new (GstRealsenseMemory, 1);
+  gst_memory_init (GST_MEMORY_CAST (sub),
+      static_cast<GstMemoryFlags> (GST_MINI_OBJECT_FLAGS (parent) | GST_MINI_OBJECT_FLAG_LOCK_READONLY),
+      memory->allocator, parent, memory->maxsize, memory->align, memory->offset + offset, size);
+  sub->block = mem->block;
+  sub->data = mem->data;
+  sub->block_size = 0;
+
+  return GST_MEMORY_CAST (sub);
+}
+
+static void
+gst_realsense_allocator_finalize (GObject * object)
+{
+  auto self = GST_REALSENSE_ALLOCATOR (object);
+
+  delete self->slab;
+  self->slab = nullptr;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_realsense_allocator_class_init (GstRealsenseAllocatorClass * klass)
+{
+  auto gobject_class = G_OBJECT_CLASS (klass);
+  auto allocator_class = GST_ALLOCATOR_CLASS (klass);
+
+  gobject_class->finalize = gst_realsense_allocator_finalize;
+  allocator_class->alloc = gst_realsense_allocator_alloc;
+  allocator_class->free = gst_realsense_allocator_free;
+}
+
+static void
+gst_realsense_allocator_init (GstRealsenseAllocator * self)
+{
+  auto allocator = GST_ALLOCATOR_CAST (self);
+
+  allocator->mem_type = GST_REALSENSE_MEMORY_TYPE;
+  allocator->mem_map = gst_realsense_memory_map;
+  allocator->mem_unmap = gst_realsense_memory_unmap;
+  allocator->mem_share = gst_realsense_memory_share;
+}
+
+/* A new allocator with its own slabs. lock mlocks them, which needs a
+ * large enough RLIMIT_MEMLOCK; see gst_realsense_allocator_get_counters. */
+GstAllocator *
+gst_realsense_allocator_new (HugePages huge_pages, gboolean lock)
+{
+  auto self = GST_REALSENSE_ALLOCATOR (g_object_new (GST_TYPE_REALSENSE_ALLOCATOR, nullptr));
+  self->slab = new RSSlab (huge_pages, lock);
+  gst_object_ref_sink (self);
+
+  GST_DEBUG_OBJECT (self, "huge-pages %d, mlock %d", huge_pages, lock);
+  return GST_ALLOCATOR_CAST (self);
+}
+
+RSSlabCounters
+gst_realsense_allocator_get_counters (GstAllocator * allocator)
+{
+  g_return_val_if_fail (GST_IS_REALSENSE_ALLOCATOR (allocator), RSSlabCounters {});
+
+  return GST_REALSENSE_ALLOCATOR (allocator)->slab->counters ();
+}
@@ -0,0 +1,63 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_REALSENSE_ALLOCATOR_H__
+#define __GST_REALSENSE_ALLOCATOR_H__
+
+#include <gst/gst.h>
+#include "common.hpp"
+#include "rsslab.hpp"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_REALSENSE_ALLOCATOR \
+  (gst_realsense_allocator_get_type())
+#define GST_REALSENSE_ALLOCATOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_REALSENSE_ALLOCATOR,GstRealsenseAllocator))
+#define GST_IS_REALSENSE_ALLOCATOR(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_REALSENSE_ALLOCATOR))
+
+#define GST_REALSENSE_MEMORY_TYPE "RealsenseMemory"
+
+typedef struct _GstRealsenseAllocator GstRealsenseAllocator;
+typedef struct _GstRealsenseAllocatorClass GstRealsenseAllocatorClass;
+
+/* Allocator of frame memory from RSSlab's huge page slabs. Memory holds a
+ * reference to its allocator, so the slabs outlive every buffer using them. */
+struct _GstRealsenseAllocator
+{
+  GstAllocator parent;
+
+  RSSlab *slab;
+};
+
+struct _GstRealsenseAllocatorClass
+{
+  GstAllocatorClass parent_class;
+};
+
+GType gst_realsense_allocator_get_type (void);
+
+GstAllocator *gst_realsense_allocator_new (HugePages huge_pages, gboolean lock);
+RSSlabCounters gst_realsense_allocator_get_counters (GstAllocator * allocator);
+
+G_END_DECLS
+
+#endif /* __GST_REALSENSE_ALLOCATOR_H__ */
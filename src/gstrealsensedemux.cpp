@@ -47,15 +47,38 @@
 #include <gst/audio/audio.h>
 
 #include "gstrealsensedemux.h"
+#include "gstrealsenseallocator.h"
 #include "gstrealsensesrc.h"
 #include "gstrealsensemeta.h"
 
 #include "rsmux.hpp"
+#include <initializer_list>
 #include <stdexcept>
 
 GST_DEBUG_CATEGORY_STATIC (rsdemux_debug);
 #define GST_CAT_DEFAULT rsdemux_debug
 
+enum
+{
+  PROP_0,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_THREADED,
+  PROP_QUEUE_DEPTH,
+  PROP_OVERFLOW_POLICY,
+  PROP_COLOR_DROPPED,
+  PROP_DEPTH_DROPPED,
+  PROP_IMU_DROPPED,
+  PROP_COLOR_QUEUE_LEVEL,
+  PROP_DEPTH_QUEUE_LEVEL,
+  PROP_IMU_QUEUE_LEVEL,
+  PROP_HUGE_PAGES,
+  PROP_MLOCK,
+  PROP_ALLOC_LIVE,
+  PROP_ALLOC_PEAK,
+  PROP_SLAB_REFILLS,
+};
+
 #define RSS_VIDEO_CAPS GST_VIDEO_CAPS_MAKE (GST_VIDEO_FORMATS_ALL) "," \
   "multiview-mode = { mono, left, right }"                              \
   ";" \
@@ -69,14 +92,15 @@ static GstStaticPadTemplate sink_tmpl = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
     GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE
-        ("{ RGB, RGBA, BGR, BGRA, GRAY16_LE, GRAY16_BE, YVYU }"))
+        ("{ RGB, RGBA, BGR, BGRA, GRAY16_LE, GRAY16_BE, YUY2, UYVY }")
+        "; " RS_MUX_CAPS)
     );
 
 static GstStaticPadTemplate color_src_tmpl = GST_STATIC_PAD_TEMPLATE ("color",
     GST_PAD_SRC,
     GST_PAD_SOMETIMES,
     GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE
-        ("{ RGB, RGBA, BGR, BGRA, GRAY16_LE, GRAY16_BE, YVYU }"))
+        ("{ RGB, RGBA, BGR, BGRA, GRAY16_LE, GRAY16_BE, YUY2, UYVY }"))
     );
 
 static GstStaticPadTemplate depth_src_tmpl = GST_STATIC_PAD_TEMPLATE ("depth",
@@ -92,7 +116,7 @@ static GstStaticPadTemplate imu_src_templ = GST_STATIC_PAD_TEMPLATE ("imu",
     GST_STATIC_CAPS ("audio/x-raw, "
         "format = (string) " GST_AUDIO_NE (F32) ", "
         "layout = (string) interleaved, "
-        "rate = (int) { 32000, 44100, 48000 }, " "channels = (int) {3, 6}")
+        "rate = (int) [ 1, MAX ], " "channels = (int) 6")
     );
 
 #define gst_rsdemux_parent_class parent_class
@@ -101,6 +125,8 @@ G_DEFINE_TYPE_WITH_CODE (GstRSDemux, gst_rsdemux, GST_TYPE_ELEMENT,
   "Demux element for Realsense plugin"));
 
 static void gst_rsdemux_finalize (GObject * object);
+static void gst_rsdemux_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_rsdemux_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
 
 /* query functions */
 static gboolean gst_rsdemux_src_query (GstPad * pad, GstObject * parent, GstQuery * query);
@@ -114,6 +140,8 @@ static gboolean gst_rsdemux_handle_sink_event (GstPad * pad, GstObject * parent,
 /* scheduling functions */
 static GstFlowReturn gst_rsdemux_flush (GstRSDemux * rsdemux);
 static GstFlowReturn gst_rsdemux_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer);
+static GstFlowReturn gst_rsdemux_push (GstRSDemux * rsdemux, GstPad * pad, GstBuffer * buffer, int stream, int wanted);
+static int gst_rsdemux_pad_stream (GstRSDemux * rsdemux, GstPad * pad);
 
 /* state change functions */
 static GstStateChangeReturn gst_rsdemux_change_state (GstElement * element, GstStateChange transition);
@@ -128,6 +156,8 @@ gst_rsdemux_class_init (GstRSDemuxClass * klass)
   gstelement_class = (GstElementClass *) klass;
 
   gobject_class->finalize = gst_rsdemux_finalize;
+  gobject_class->set_property = gst_rsdemux_set_property;
+  gobject_class->get_property = gst_rsdemux_get_property;
 
   gstelement_class->change_state = GST_DEBUG_FUNCPTR (gst_rsdemux_change_state);
   gstelement_class->send_event = GST_DEBUG_FUNCPTR (gst_rsdemux_send_event);
@@ -143,6 +173,93 @@ gst_rsdemux_class_init (GstRSDemuxClass * klass)
       "Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>");
 
   GST_DEBUG_CATEGORY_INIT (rsdemux_debug, "rsdemux", 0, "RS demuxer element");
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+    g_param_spec_boolean ("stats", "Stats",
+        "Time demuxing and pushing of every frame and post the histograms as realsense-stats element messages",
+        FALSE, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+    g_param_spec_uint ("stats-interval", "Stats interval",
+        "Milliseconds between realsense-stats messages (0 = only at EOS)",
+        0, G_MAXUINT, DEFAULT_PROP_STATS_INTERVAL,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_THREADED,
+    g_param_spec_boolean ("threaded", "Threaded",
+        "Push every pad from its own thread through a bounded queue, so a slow branch doesn't hold up the others. "
+        "Takes effect at the next start",
+        FALSE, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_QUEUE_DEPTH,
+    g_param_spec_uint ("queue-depth", "Queue depth",
+        "Frames each pad queues in threaded mode",
+        1, 64, DEFAULT_PROP_RSDEMUX_QUEUE_DEPTH,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_OVERFLOW_POLICY,
+    g_param_spec_int ("overflow-policy", "Overflow policy",
+        "What a full pad queue does in threaded mode: 0 = drop the oldest frame, 1 = drop the new frame, "
+        "2 = wait for room, holding up the other pads",
+        OverflowPolicy::DropOldest, OverflowPolicy::Block, OverflowPolicy::DropOldest,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_COLOR_DROPPED,
+    g_param_spec_uint64 ("color-dropped", "Color frames dropped",
+        "Color frames dropped by a full queue in threaded mode",
+        0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DEPTH_DROPPED,
+    g_param_spec_uint64 ("depth-dropped", "Depth frames dropped",
+        "Depth frames dropped by a full queue in threaded mode",
+        0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_IMU_DROPPED,
+    g_param_spec_uint64 ("imu-dropped", "IMU batches dropped",
+        "IMU batches dropped by a full queue in threaded mode",
+        0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_COLOR_QUEUE_LEVEL,
+    g_param_spec_uint ("color-queue-level", "Color queue level",
+        "Color frames waiting in the queue in threaded mode",
+        0, G_MAXUINT, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DEPTH_QUEUE_LEVEL,
+    g_param_spec_uint ("depth-queue-level", "Depth queue level",
+        "Depth frames waiting in the queue in threaded mode",
+        0, G_MAXUINT, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_IMU_QUEUE_LEVEL,
+    g_param_spec_uint ("imu-queue-level", "IMU queue level",
+        "IMU batches waiting in the queue in threaded mode",
+        0, G_MAXUINT, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_HUGE_PAGES,
+    g_param_spec_int ("huge-pages", "Huge pages",
+        "Allocator proposed upstream: 0 = none, 1 = 64-byte aligned slabs of transparent huge pages, "
+        "2 = slabs of explicit (hugetlbfs) huge pages, falling back to transparent ones. Takes effect at the next start",
+        HugePages::HugePagesOff, HugePages::HugePagesExplicit, HugePages::HugePagesOff,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_MLOCK,
+    g_param_spec_boolean ("mlock", "mlock",
+        "Lock the huge page slabs into memory. Needs a large enough RLIMIT_MEMLOCK",
+        FALSE, (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_ALLOC_LIVE,
+    g_param_spec_uint64 ("alloc-live", "Allocated live",
+        "Bytes of the proposed allocator's slabs held by buffers now",
+        0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_ALLOC_PEAK,
+    g_param_spec_uint64 ("alloc-peak", "Allocated peak",
+        "Most bytes of the proposed allocator's slabs held by buffers at once",
+        0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SLAB_REFILLS,
+    g_param_spec_uint64 ("slab-refills", "Slab refills",
+        "Number of huge page slabs the proposed allocator mapped",
+        0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
 }
 
 static void
@@ -159,14 +276,133 @@ gst_rsdemux_init (GstRSDemux * rsdemux)
   /* now add the pad */
   gst_element_add_pad (GST_ELEMENT (rsdemux), rsdemux->sinkpad);
   // src pads will be created in the chain function
+
+  rsdemux->stats_on = FALSE;
+  rsdemux->stats_interval = DEFAULT_PROP_STATS_INTERVAL;
+  rsdemux->threaded = FALSE;
+  rsdemux->queue_depth = DEFAULT_PROP_RSDEMUX_QUEUE_DEPTH;
+  rsdemux->overflow_policy = OverflowPolicy::DropOldest;
+  rsdemux->huge_pages = HugePages::HugePagesOff;
+  rsdemux->frame_duration = GST_CLOCK_TIME_NONE;
 }
 
 static void
 gst_rsdemux_finalize (GObject * object)
 {
+  auto rsdemux = GST_RSDEMUX (object);
+  rsdemux->stats = nullptr;
+  if (rsdemux->allocator != nullptr)
+    gst_object_unref (rsdemux->allocator);
+  rsdemux->allocator = nullptr;
+
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+static void
+gst_rsdemux_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  auto rsdemux = GST_RSDEMUX (object);
+
+  switch (prop_id) {
+    case PROP_STATS:
+      rsdemux->stats_on = g_value_get_boolean (value);
+      break;
+    case PROP_STATS_INTERVAL:
+      rsdemux->stats_interval = g_value_get_uint (value);
+      break;
+    case PROP_THREADED:
+      rsdemux->threaded = g_value_get_boolean (value);
+      break;
+    case PROP_QUEUE_DEPTH:
+      rsdemux->queue_depth = g_value_get_uint (value);
+      break;
+    case PROP_OVERFLOW_POLICY:
+      rsdemux->overflow_policy = static_cast<OverflowPolicy>(g_value_get_int (value));
+      break;
+    case PROP_HUGE_PAGES:
+      rsdemux->huge_pages = static_cast<HugePages>(g_value_get_int (value));
+      break;
+    case PROP_MLOCK:
+      rsdemux->mlock = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static guint
+gst_rsdemux_queue_level (GstRSDemux * rsdemux, RSDemuxPadThread& thread)
+{
+  GST_OBJECT_LOCK (rsdemux);
+  const auto level = thread.queue ? thread.queue->level () : 0;
+  GST_OBJECT_UNLOCK (rsdemux);
+  return static_cast<guint>(level);
+}
+
+static void
+gst_rsdemux_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  auto rsdemux = GST_RSDEMUX (object);
+
+  switch (prop_id) {
+    case PROP_STATS:
+      g_value_set_boolean (value, rsdemux->stats_on);
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint (value, rsdemux->stats_interval);
+      break;
+    case PROP_THREADED:
+      g_value_set_boolean (value, rsdemux->threaded);
+      break;
+    case PROP_QUEUE_DEPTH:
+      g_value_set_uint (value, rsdemux->queue_depth);
+      break;
+    case PROP_OVERFLOW_POLICY:
+      g_value_set_int (value, rsdemux->overflow_policy);
+      break;
+    case PROP_COLOR_DROPPED:
+      g_value_set_uint64 (value, rsdemux->color_thread.dropped);
+      break;
+    case PROP_DEPTH_DROPPED:
+      g_value_set_uint64 (value, rsdemux->depth_thread.dropped);
+      break;
+    case PROP_IMU_DROPPED:
+      g_value_set_uint64 (value, rsdemux->imu_thread.dropped);
+      break;
+    case PROP_COLOR_QUEUE_LEVEL:
+      g_value_set_uint (value, gst_rsdemux_queue_level (rsdemux, rsdemux->color_thread));
+      break;
+    case PROP_DEPTH_QUEUE_LEVEL:
+      g_value_set_uint (value, gst_rsdemux_queue_level (rsdemux, rsdemux->depth_thread));
+      break;
+    case PROP_IMU_QUEUE_LEVEL:
+      g_value_set_uint (value, gst_rsdemux_queue_level (rsdemux, rsdemux->imu_thread));
+      break;
+    case PROP_HUGE_PAGES:
+      g_value_set_int (value, rsdemux->huge_pages);
+      break;
+    case PROP_MLOCK:
+      g_value_set_boolean (value, rsdemux->mlock);
+      break;
+    case PROP_ALLOC_LIVE:
+    case PROP_ALLOC_PEAK:
+    case PROP_SLAB_REFILLS:
+    {
+      GST_OBJECT_LOCK (rsdemux);
+      const auto counters = rsdemux->allocator != nullptr ?
+          gst_realsense_allocator_get_counters (rsdemux->allocator) : RSSlabCounters {};
+      GST_OBJECT_UNLOCK (rsdemux);
+      g_value_set_uint64 (value, prop_id == PROP_ALLOC_LIVE ? counters.live :
+          prop_id == PROP_ALLOC_PEAK ? counters.peak : counters.refills);
+      break;
+    }
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 /* reset to default values before starting streaming */
 static void
 gst_rsdemux_reset (GstRSDemux * rsdemux)
@@ -175,6 +411,137 @@ gst_rsdemux_reset (GstRSDemux * rsdemux)
   rsdemux->in_width = 0;
   rsdemux->in_stride_bytes = 0;
   rsdemux->header = {};
+  rsdemux->stats = rsdemux->stats_on ?
+      std::make_unique<RSStats> (rsdemux->stats_interval * GST_MSECOND) : nullptr;
+  // announce ourselves with the first frame, even if we want everything
+  rsdemux->streams_sent = -1;
+  GST_OBJECT_LOCK (rsdemux);
+  rsdemux->depth_lead = 0;
+  rsdemux->imu_lead = 0;
+  rsdemux->not_linked = 0;
+  rsdemux->frame_duration = GST_CLOCK_TIME_NONE;
+  GST_OBJECT_UNLOCK (rsdemux);
+  rsdemux->threaded_active = rsdemux->threaded;
+  rsdemux->color_thread.dropped = 0;
+  rsdemux->depth_thread.dropped = 0;
+  rsdemux->imu_thread.dropped = 0;
+}
+
+static RSDemuxPadThread&
+gst_rsdemux_pad_thread (GstRSDemux * rsdemux, GstPad * pad)
+{
+  if (pad == rsdemux->colorsrcpad)
+    return rsdemux->color_thread;
+  if (pad == rsdemux->depthsrcpad)
+    return rsdemux->depth_thread;
+  return rsdemux->imu_thread;
+}
+
+/* Task of a source pad in threaded mode, pushes what the chain function
+ * queued. Runs with the pad's stream lock held. */
+static void
+gst_rsdemux_pad_loop (GstPad * pad)
+{
+  auto rsdemux = GST_RSDEMUX (GST_PAD_PARENT (pad));
+  auto& thread = gst_rsdemux_pad_thread (rsdemux, pad);
+
+  auto item = thread.queue->pop ();
+  if (item == nullptr)
+  {
+    GST_DEBUG_OBJECT (pad, "flushing, pausing task");
+    gst_pad_pause_task (pad);
+    return;
+  }
+
+  if (GST_IS_EVENT (item))
+  {
+    gst_pad_push_event (pad, GST_EVENT_CAST (item));
+    return;
+  }
+
+  const auto stream = gst_rsdemux_pad_stream (rsdemux, pad);
+  const auto ret = gst_rsdemux_push (rsdemux, pad, GST_BUFFER_CAST (item), stream, stream);
+  GST_OBJECT_LOCK (rsdemux);
+  thread.last_flow = ret;
+  GST_OBJECT_UNLOCK (rsdemux);
+
+  // the chain function hands the result upstream, flushing stops it queueing more
+  if (ret == GST_FLOW_FLUSHING || ret <= GST_FLOW_NOT_NEGOTIATED)
+  {
+    GST_DEBUG_OBJECT (pad, "pausing task, reason %s", gst_flow_get_name (ret));
+    thread.queue->set_flushing (true);
+    gst_pad_pause_task (pad);
+  }
+}
+
+/* Give a new pad its queue and task in threaded mode */
+static void
+gst_rsdemux_start_pad_thread (GstRSDemux * rsdemux, GstPad * pad, RSDemuxPadThread& thread)
+{
+  if (!rsdemux->threaded_active || pad == nullptr || thread.queue != nullptr)
+    return;
+
+  GST_OBJECT_LOCK (rsdemux);
+  thread.queue = std::make_unique<RSPadQueue> (rsdemux->queue_depth, rsdemux->overflow_policy);
+  thread.last_flow = GST_FLOW_OK;
+  GST_OBJECT_UNLOCK (rsdemux);
+  gst_pad_start_task (pad, (GstTaskFunction) gst_rsdemux_pad_loop, pad, nullptr);
+}
+
+static void
+gst_rsdemux_stop_pad_thread (GstRSDemux * rsdemux, GstPad * pad, RSDemuxPadThread& thread)
+{
+  if (thread.queue == nullptr)
+    return;
+
+  // wakes the task so it can stop, it holds the stream lock while it waits
+  thread.queue->set_flushing (true);
+  gst_pad_stop_task (pad);
+  GST_OBJECT_LOCK (rsdemux);
+  thread.queue = nullptr;
+  GST_OBJECT_UNLOCK (rsdemux);
+}
+
+/* Flush the queues of all pads around a flush from upstream. The tasks
+ * pause while flushing and start again after. */
+static void
+gst_rsdemux_flush_pad_threads (GstRSDemux * rsdemux, bool flushing)
+{
+  for (auto pad : {rsdemux->colorsrcpad, rsdemux->depthsrcpad, rsdemux->imusrcpad})
+  {
+    if (pad == nullptr)
+      continue;
+    auto& thread = gst_rsdemux_pad_thread (rsdemux, pad);
+    if (thread.queue == nullptr)
+      continue;
+
+    thread.queue->set_flushing (flushing);
+    if (!flushing)
+    {
+      GST_OBJECT_LOCK (rsdemux);
+      thread.last_flow = GST_FLOW_OK;
+      GST_OBJECT_UNLOCK (rsdemux);
+      gst_pad_start_task (pad, (GstTaskFunction) gst_rsdemux_pad_loop, pad, nullptr);
+    }
+  }
+}
+
+/* Deactivating a pad waits for its stream lock, which the task holds while
+ * it waits for the queue, so the queue is woken first */
+static gboolean
+gst_rsdemux_src_activate_mode (GstPad * pad, GstObject * parent, GstPadMode mode, gboolean active)
+{
+  if (!active)
+  {
+    if (parent != nullptr && gst_rsdemux_pad_stream (GST_RSDEMUX (parent), pad) != 0)
+    {
+      auto& thread = gst_rsdemux_pad_thread (GST_RSDEMUX (parent), pad);
+      if (thread.queue != nullptr)
+        thread.queue->set_flushing (true);
+    }
+    gst_pad_stop_task (pad);
+  }
+  return TRUE;
 }
 
 static GstPad *
@@ -187,6 +554,7 @@ gst_rsdemux_add_pad (GstRSDemux * rsdemux, GstStaticPadTemplate * templ, GstCaps
   pad = gst_pad_new_from_static_template (templ, templ->name_template);
 
   gst_pad_set_query_function (pad, GST_DEBUG_FUNCPTR (gst_rsdemux_src_query));
+  gst_pad_set_activatemode_function (pad, GST_DEBUG_FUNCPTR (gst_rsdemux_src_activate_mode));
 
   gst_pad_set_event_function (pad,
       GST_DEBUG_FUNCPTR (gst_rsdemux_handle_src_event));
@@ -210,26 +578,75 @@ static void
 gst_rsdemux_remove_pads (GstRSDemux * rsdemux)
 {
   if (rsdemux->colorsrcpad) {
+    gst_rsdemux_stop_pad_thread (rsdemux, rsdemux->colorsrcpad, rsdemux->color_thread);
     gst_element_remove_pad (GST_ELEMENT (rsdemux), rsdemux->colorsrcpad);
     rsdemux->colorsrcpad = nullptr;
   }
   if (rsdemux->depthsrcpad) {
+    gst_rsdemux_stop_pad_thread (rsdemux, rsdemux->depthsrcpad, rsdemux->depth_thread);
     gst_element_remove_pad (GST_ELEMENT (rsdemux), rsdemux->depthsrcpad);
     rsdemux->depthsrcpad = nullptr;
   }
   if (rsdemux->imusrcpad) {
+    gst_rsdemux_stop_pad_thread (rsdemux, rsdemux->imusrcpad, rsdemux->imu_thread);
     gst_element_remove_pad (GST_ELEMENT (rsdemux), rsdemux->imusrcpad);
     rsdemux->imusrcpad = nullptr;
   }
+  GST_OBJECT_LOCK (rsdemux);
+  rsdemux->not_linked = 0;
+  GST_OBJECT_UNLOCK (rsdemux);
+}
+
+/* StreamBit of the stream a source pad carries */
+static int
+gst_rsdemux_pad_stream (GstRSDemux * rsdemux, GstPad * pad)
+{
+  if (pad == rsdemux->colorsrcpad)
+    return StreamBitColor;
+  if (pad == rsdemux->depthsrcpad)
+    return StreamBitDepth;
+  if (pad == rsdemux->imusrcpad)
+    return StreamBitImu;
+  return 0;
 }
 
 static gboolean
 gst_rsdemux_src_query (GstPad * pad, GstObject * parent, GstQuery * query)
 {
   gboolean res = TRUE;
+  auto rsdemux = GST_RSDEMUX (parent);
 
-  // TODO Handle any necessary src queries
   switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_LATENCY:
+    {
+      res = gst_pad_peer_query (rsdemux->sinkpad, query);
+      if (res) {
+        gboolean live;
+        GstClockTime min, max;
+        gst_query_parse_latency (query, &live, &min, &max);
+
+        GstClockTime lead = 0;
+        GST_OBJECT_LOCK (rsdemux);
+        if (pad == rsdemux->depthsrcpad)
+          lead = rsdemux->depth_lead;
+        else if (pad == rsdemux->imusrcpad)
+          lead = rsdemux->imu_lead;
+
+        // a frame may wait behind the whole queue before its task pushes it
+        GstClockTime queued = 0;
+        if (rsdemux->threaded_active && GST_CLOCK_TIME_IS_VALID (rsdemux->frame_duration))
+          queued = rsdemux->queue_depth * rsdemux->frame_duration;
+        GST_OBJECT_UNLOCK (rsdemux);
+
+        min += lead;
+        if (GST_CLOCK_TIME_IS_VALID (max))
+          max += lead + queued;
+        GST_DEBUG_OBJECT (pad, "latency min %" GST_TIME_FORMAT " max %" GST_TIME_FORMAT,
+            GST_TIME_ARGS (min), GST_TIME_ARGS (max));
+        gst_query_set_latency (query, live, min, max);
+      }
+      break;
+    }
     case GST_QUERY_DURATION:
     default:
       res = gst_pad_query_default (pad, parent, query);
@@ -246,6 +663,23 @@ gst_rsdemux_sink_query (GstPad * pad, GstObject * parent, GstQuery * query)
 
   // TODO Handle any sink queries
   switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_ALLOCATION:
+    {
+      // the pads carry other caps than the sink, so nothing downstream can answer this
+      auto rsdemux = GST_RSDEMUX (parent);
+      GST_OBJECT_LOCK (rsdemux);
+      auto allocator = rsdemux->allocator != nullptr ?
+          GST_ALLOCATOR_CAST (gst_object_ref (rsdemux->allocator)) : nullptr;
+      GST_OBJECT_UNLOCK (rsdemux);
+      if (allocator == nullptr) {
+        res = gst_pad_query_default (pad, parent, query);
+        break;
+      }
+      auto params = RSMux::allocation_params ();
+      gst_query_add_allocation_param (query, allocator, &params);
+      gst_object_unref (allocator);
+      break;
+    }
     case GST_QUERY_DURATION:
     default:
       res = gst_pad_query_default (pad, parent, query);
@@ -255,29 +689,31 @@ gst_rsdemux_sink_query (GstPad * pad, GstObject * parent, GstQuery * query)
   return res;
 }
 
-/* takes ownership of the event */
+/* takes ownership of the event. In threaded mode serialized events go
+ * through the pad queues so they stay in order with the buffers. */
 static gboolean
 gst_rsdemux_push_event (GstRSDemux * rsdemux, GstEvent * event)
 {
   gboolean res = FALSE;
+  bool any_pad = false;
+  const bool queued = GST_EVENT_IS_SERIALIZED (event) && GST_EVENT_TYPE (event) != GST_EVENT_FLUSH_STOP;
 
-  if (rsdemux->colorsrcpad) {
-    gst_event_ref (event);
-    res |= gst_pad_push_event (rsdemux->colorsrcpad, event);
-  }
+  for (auto pad : {rsdemux->colorsrcpad, rsdemux->depthsrcpad, rsdemux->imusrcpad})
+  {
+    if (pad == nullptr)
+      continue;
+    any_pad = true;
 
-  if (rsdemux->depthsrcpad) {
+    auto& thread = gst_rsdemux_pad_thread (rsdemux, pad);
     gst_event_ref (event);
-    res |= gst_pad_push_event (rsdemux->depthsrcpad, event);
+    if (queued && thread.queue != nullptr)
+      res |= thread.queue->push_event (event);
+    else
+      res |= gst_pad_push_event (pad, event);
   }
 
-  if (rsdemux->colorsrcpad==nullptr && rsdemux->depthsrcpad==nullptr) 
-  {
-    gst_event_unref (event);
-    res = TRUE;
-  }
-
-  return res;
+  gst_event_unref (event);
+  return any_pad ? res : TRUE;
 }
 
 static gboolean
@@ -291,15 +727,19 @@ gst_rsdemux_handle_sink_event (GstPad * pad, GstObject * parent,
     case GST_EVENT_FLUSH_START:
       /* we are not blocking on anything except the push() calls
        * to the peer which will be unblocked by forwarding the
-       * event.*/
+       * event, and in threaded mode the queues, which flushing empties.*/
+      gst_rsdemux_flush_pad_threads (rsdemux, true);
       res = gst_rsdemux_push_event (rsdemux, event);
       break;
     case GST_EVENT_FLUSH_STOP:
       res = gst_rsdemux_push_event (rsdemux, event);
+      gst_rsdemux_flush_pad_threads (rsdemux, false);
       break;
     case GST_EVENT_EOS:
       /* flush any pending data, should be nothing left. */
       gst_rsdemux_flush (rsdemux);
+      if (rsdemux->stats)
+        rsdemux->stats->post (GST_ELEMENT (rsdemux));
       /* forward event */
       res = gst_rsdemux_push_event (rsdemux, event);
       /* and clear the adapter */
@@ -340,7 +780,13 @@ gst_rsdemux_handle_src_event (GstPad * pad, GstObject * parent,
   const auto rsdemux = GST_RSDEMUX (parent);
 
   switch (GST_EVENT_TYPE (event)) {
-    // TODO handle src pad events here
+    case GST_EVENT_RECONFIGURE:
+      // linking a pad sends this, so one that gave NOT_LINKED may be used again
+      GST_OBJECT_LOCK (rsdemux);
+      rsdemux->not_linked &= ~gst_rsdemux_pad_stream (rsdemux, pad);
+      GST_OBJECT_UNLOCK (rsdemux);
+      res = gst_pad_push_event (rsdemux->sinkpad, event);
+      break;
     default:
       res = gst_pad_push_event (rsdemux->sinkpad, event);
       break;
@@ -355,27 +801,28 @@ static GstFlowReturn make_new_pads(GstRSDemux* rsdemux, const RSHeader& header)
   GST_CAT_WARNING(rsdemux_debug, "making new pads");
   GST_CAT_DEBUG(rsdemux_debug, "making pad caps");
 
+  // formats and rates as negotiated with the camera, 0/1 if the source didn't say
   auto color_caps = gst_caps_new_simple ("video/x-raw",
-        "format", G_TYPE_STRING, "RGB",
+        "format", G_TYPE_STRING, gst_video_format_to_string (static_cast<GstVideoFormat>(header.color_format)),
         "width", G_TYPE_INT, header.color_width,
         "height", G_TYPE_INT, header.color_height,
-        "framerate", GST_TYPE_FRACTION, 30, 1,
+        "framerate", GST_TYPE_FRACTION, header.color_fps, 1,
         NULL);
   auto depth_caps = gst_caps_new_simple ("video/x-raw",
-        "format", G_TYPE_STRING, "GRAY16_LE",
+        "format", G_TYPE_STRING, gst_video_format_to_string (static_cast<GstVideoFormat>(header.depth_format)),
         "width", G_TYPE_INT, header.depth_width,
         "height", G_TYPE_INT, header.depth_height,
-        "framerate", GST_TYPE_FRACTION, 30, 1,
+        "framerate", GST_TYPE_FRACTION, header.depth_fps, 1,
         NULL);
 
-  bool imu_on = GST_AUDIO_FORMAT_UNKNOWN != static_cast<GstAudioFormat>(header.accel_format);
+  bool imu_on = GST_AUDIO_FORMAT_UNKNOWN != static_cast<GstAudioFormat>(header.accel_format) && header.imu_rate > 0;
   if(imu_on)// || G_UNLIKELY(rsdemux->imusrcpad==nullptr))
   {
+    // one sample per IMU reading, accel and gyro resampled onto one grid
     GstAudioInfo info;
-    constexpr gint imu_rate = GST_AUDIO_DEF_RATE;
-    constexpr gint imu_channels = 6; // x,y,z for accel and gyro
+    constexpr gint imu_channels = RSImuBatch::Channels; // x,y,z for accel and gyro
     gst_audio_info_init(&info);
-    gst_audio_info_set_format(&info, static_cast<GstAudioFormat>(header.accel_format), imu_rate, imu_channels, NULL);
+    gst_audio_info_set_format(&info, static_cast<GstAudioFormat>(header.accel_format), header.imu_rate, imu_channels, NULL);
 
     const auto imu_caps = gst_audio_info_to_caps(&info);
     rsdemux->imusrcpad = gst_rsdemux_add_pad(rsdemux, &imu_src_templ, imu_caps, "imu");
@@ -404,17 +851,157 @@ static GstFlowReturn make_new_pads(GstRSDemux* rsdemux, const RSHeader& header)
   }
   gst_caps_unref (color_caps);
   gst_caps_unref (depth_caps);
-  
+
+  GST_OBJECT_LOCK (rsdemux);
+  rsdemux->frame_duration = header.color_fps > 0 ?
+      gst_util_uint64_scale_int (GST_SECOND, 1, header.color_fps) : GST_CLOCK_TIME_NONE;
+  GST_OBJECT_UNLOCK (rsdemux);
+
+  gst_rsdemux_start_pad_thread (rsdemux, rsdemux->colorsrcpad, rsdemux->color_thread);
+  gst_rsdemux_start_pad_thread (rsdemux, rsdemux->depthsrcpad, rsdemux->depth_thread);
+  gst_rsdemux_start_pad_thread (rsdemux, rsdemux->imusrcpad, rsdemux->imu_thread);
+
   return GST_FLOW_OK;
 }
 
+/* A sub-buffer stamped earlier than the muxed buffer it came in is that much
+ * later, relative to its own timestamp, when it gets pushed. Grows *lead to
+ * cover that, with a little headroom so jitter doesn't keep growing it, and
+ * returns TRUE when it did. */
+static gboolean
+gst_rsdemux_update_lead (GstRSDemux * rsdemux, GstBuffer * buffer, GstBuffer * sub, GstClockTime * lead)
+{
+  if (sub == nullptr || !GST_BUFFER_PTS_IS_VALID (buffer) || !GST_BUFFER_PTS_IS_VALID (sub) ||
+      GST_BUFFER_PTS (sub) >= GST_BUFFER_PTS (buffer))
+    return FALSE;
+
+  const auto needed = GST_BUFFER_PTS (buffer) - GST_BUFFER_PTS (sub);
+  GST_OBJECT_LOCK (rsdemux);
+  const gboolean grew = needed > *lead;
+  if (grew)
+    *lead = needed + GST_MSECOND;
+  GST_OBJECT_UNLOCK (rsdemux);
+  return grew;
+}
+
+/* Streams whose pad is linked and has not returned NOT_LINKED since. When
+ * that changes, upstream is told so it can stop muxing the others. */
+static int
+gst_rsdemux_update_wanted (GstRSDemux * rsdemux)
+{
+  GST_OBJECT_LOCK (rsdemux);
+  const auto not_linked = rsdemux->not_linked;
+  GST_OBJECT_UNLOCK (rsdemux);
+
+  int wanted = 0;
+  if (rsdemux->colorsrcpad != nullptr && gst_pad_is_linked (rsdemux->colorsrcpad))
+    wanted |= StreamBitColor;
+  if (rsdemux->depthsrcpad != nullptr && gst_pad_is_linked (rsdemux->depthsrcpad))
+    wanted |= StreamBitDepth;
+  if (rsdemux->imusrcpad != nullptr && gst_pad_is_linked (rsdemux->imusrcpad))
+    wanted |= StreamBitImu;
+  wanted &= ~not_linked;
+
+  if (wanted != rsdemux->streams_sent)
+  {
+    GST_INFO_OBJECT (rsdemux, "streams in use changed from 0x%x to 0x%x", rsdemux->streams_sent, wanted);
+    // sent once, a source that doesn't know the event muxes everything anyway
+    auto sender = gst_object_get_path_string (GST_OBJECT (rsdemux));
+    if (!gst_pad_push_event (rsdemux->sinkpad, RSMux::streams_event (sender, wanted)))
+      GST_DEBUG_OBJECT (rsdemux, "upstream did not handle the streams event");
+    g_free (sender);
+    rsdemux->streams_sent = wanted;
+  }
+  return wanted;
+}
+
+/* Push the sub-buffer of stream, nullptr if there is none. A pad that gives
+ * NOT_LINKED is not fed again until it is relinked. */
+static GstFlowReturn
+gst_rsdemux_push (GstRSDemux * rsdemux, GstPad * pad, GstBuffer * buffer, int stream, int wanted)
+{
+  // a wanted stream can be missing while upstream catches up with the mask
+  if (buffer == nullptr)
+    return (wanted & stream) ? GST_FLOW_OK : GST_FLOW_NOT_LINKED;
+
+  const auto ret = gst_pad_push (pad, buffer);
+  if (ret == GST_FLOW_NOT_LINKED)
+  {
+    GST_DEBUG_OBJECT (pad, "not linked downstream, dropping the stream until relinked");
+    GST_OBJECT_LOCK (rsdemux);
+    rsdemux->not_linked |= stream;
+    GST_OBJECT_UNLOCK (rsdemux);
+  }
+  else if (ret != GST_FLOW_OK)
+  {
+    GST_ELEMENT_WARNING(rsdemux, RESOURCE, SETTINGS, ("Pushing to %s src gave %d.", GST_PAD_NAME (pad), ret), (NULL));
+  }
+  return ret;
+}
+
+/* Hand the sub-buffer of stream to the pad's task. What upstream gets back
+ * is what the task's last push gave, so NOT_LINKED, EOS and errors still
+ * reach it a frame or so late. */
+static GstFlowReturn
+gst_rsdemux_queue (GstRSDemux * rsdemux, GstPad * pad, RSDemuxPadThread& thread, GstBuffer * buffer,
+    guint64 frame, int stream, int wanted)
+{
+  if (buffer == nullptr)
+    return (wanted & stream) ? GST_FLOW_OK : GST_FLOW_NOT_LINKED;
+
+  const auto result = thread.queue->push_buffer (buffer, frame);
+  if (result == RSPadQueue::PushResult::DroppedOldest || result == RSPadQueue::PushResult::DroppedNewest)
+  {
+    GST_LOG_OBJECT (pad, "queue full, dropped frame %" G_GUINT64_FORMAT, frame);
+    ++thread.dropped;
+  }
+
+  GST_OBJECT_LOCK (rsdemux);
+  auto ret = thread.last_flow;
+  GST_OBJECT_UNLOCK (rsdemux);
+  // a task stopped by an error flushes its queue, and upstream gets the error
+  if (result == RSPadQueue::PushResult::Flushing && ret == GST_FLOW_OK)
+    ret = GST_FLOW_FLUSHING;
+  return ret;
+}
+
+static GstFlowReturn
+gst_rsdemux_send (GstRSDemux * rsdemux, GstPad * pad, GstBuffer * buffer, guint64 frame, int stream, int wanted)
+{
+  // in threaded mode the pad tasks push, this only queues
+  if (rsdemux->threaded_active)
+    return gst_rsdemux_queue (rsdemux, pad, gst_rsdemux_pad_thread (rsdemux, pad), buffer, frame, stream, wanted);
+  return gst_rsdemux_push (rsdemux, pad, buffer, stream, wanted);
+}
+
+/* Result for upstream of the pushes of one frame, as GstFlowCombiner does
+ * it: flushing or an error on any pad wins, and EOS or NOT_LINKED only count
+ * when no pad took its buffer. */
+static GstFlowReturn
+gst_rsdemux_combine_flows (std::initializer_list<GstFlowReturn> rets)
+{
+  GstFlowReturn combined = GST_FLOW_NOT_LINKED;
+  for (const auto ret : rets)
+  {
+    if (ret == GST_FLOW_FLUSHING || ret <= GST_FLOW_NOT_NEGOTIATED)
+      return ret;
+    if (ret >= GST_FLOW_OK)
+      combined = GST_FLOW_OK;
+    else if (ret == GST_FLOW_EOS && combined == GST_FLOW_NOT_LINKED)
+      combined = GST_FLOW_EOS;
+  }
+  return combined;
+}
+
 static GstFlowReturn
 gst_rsdemux_demux_video (GstRSDemux * rsdemux, GstBuffer * buffer)
 {
   GstFlowReturn ret = GST_FLOW_OK;
   GST_DEBUG ("Demuxing video frame");
   
-  const auto header = RSMux::GetRSHeader(rsdemux, buffer);
+  // only the prefix is read here, the planes are never mapped
+  RSMuxPrefix prefix;
+  const auto header = RSMux::GetRSHeader(rsdemux, buffer, &prefix);
 
   // see if anything changed 
   if (rsdemux->header != header || 
@@ -425,37 +1012,63 @@ gst_rsdemux_demux_video (GstRSDemux * rsdemux, GstBuffer * buffer)
     make_new_pads(rsdemux, header);
   }
   
-  /* takes ownership of buffer here, we just need to modify
-   * the metadata. */
-  // outbuf = gst_buffer_make_writable (buffer);
-  auto [colorbuf, depthbuf, imubuf] = RSMux::demux(buffer, header);
-
-  // meta
-  GST_CAT_DEBUG(rsdemux_debug, "copying metadata");
-  auto rsmeta = gst_buffer_get_realsense_meta(buffer);
-  gst_buffer_add_realsense_meta(colorbuf, *rsmeta->cam_model, *rsmeta->cam_serial_number,rsmeta->exposure,*rsmeta->json_descr, rsmeta->depth_units, &rsmeta->color_intrinsics);
-  gst_buffer_add_realsense_meta(depthbuf, *rsmeta->cam_model, *rsmeta->cam_serial_number,rsmeta->exposure,*rsmeta->json_descr, rsmeta->depth_units, &rsmeta->color_intrinsics);
-  if(imubuf != nullptr && rsdemux->imusrcpad != nullptr)
-    gst_buffer_add_realsense_meta(imubuf, *rsmeta->cam_model, *rsmeta->cam_serial_number,rsmeta->exposure,*rsmeta->json_descr, rsmeta->depth_units, &rsmeta->color_intrinsics);
+  // no sub-buffers at all for streams nobody takes
+  const auto wanted = gst_rsdemux_update_wanted (rsdemux);
+  if (wanted == 0)
+  {
+    GST_DEBUG_OBJECT (rsdemux, "no pad linked, dropping frame");
+    gst_buffer_unref(buffer);
+    return GST_FLOW_NOT_LINKED;
+  }
 
-  GST_CAT_DEBUG(rsdemux_debug, "pushing buffers");
+  GstBuffer *colorbuf, *depthbuf, *imubuf;
+  {
+    RSStageTimer timer (rsdemux->stats.get(), RSStage::Demux);
+    std::tie(colorbuf, depthbuf, imubuf) = RSMux::demux(buffer, prefix, wanted);
+  }
 
-  ret = gst_pad_push (rsdemux->colorsrcpad, colorbuf);
-  if (ret != GST_FLOW_OK)
-    GST_ELEMENT_WARNING(rsdemux, RESOURCE, SETTINGS, ("Pushing to color src gave %d.", ret), (NULL));
+  // metadata was copied to the sub-buffers by RSMux::demux
+  const auto present = wanted & ~header.skipped;
+  if (((present & StreamBitColor) && colorbuf == nullptr) || ((present & StreamBitDepth) && depthbuf == nullptr))
+  {
+    GST_ELEMENT_WARNING(rsdemux, STREAM, DEMUX, ("Muxed buffer smaller than header describes."), (NULL));
+    if (colorbuf != nullptr)
+      gst_buffer_unref(colorbuf);
+    if (depthbuf != nullptr)
+      gst_buffer_unref(depthbuf);
+    if (imubuf != nullptr)
+      gst_buffer_unref(imubuf);
+    gst_buffer_unref(buffer);
+    return GST_FLOW_OK;
+  }
 
-  ret = gst_pad_push (rsdemux->depthsrcpad, depthbuf);
-  if (ret != GST_FLOW_OK)
-    GST_ELEMENT_WARNING(rsdemux, RESOURCE, SETTINGS, ("Pushing to depth src gave %d.", ret), (NULL));
-  
-  if(imubuf != nullptr && rsdemux->imusrcpad != nullptr)
+  const gboolean depth_grew = gst_rsdemux_update_lead (rsdemux, buffer, depthbuf, &rsdemux->depth_lead);
+  const gboolean imu_grew = gst_rsdemux_update_lead (rsdemux, buffer, imubuf, &rsdemux->imu_lead);
+  if (depth_grew || imu_grew)
   {
-    ret = gst_pad_push (rsdemux->imusrcpad, imubuf);
-    if (ret != GST_FLOW_OK)
-      GST_ELEMENT_WARNING(rsdemux, RESOURCE, SETTINGS, ("Pushing to IMU src gave %d.", ret), (NULL));
+    GST_DEBUG_OBJECT (rsdemux, "sub-stream latency grew, asking for a new latency");
+    gst_element_post_message (GST_ELEMENT (rsdemux), gst_message_new_latency (GST_OBJECT (rsdemux)));
   }
 
+  GST_CAT_DEBUG(rsdemux_debug, "pushing buffers");
+  const auto push_start = rsdemux->stats ? RSStats::now() : 0;
+
+  const auto frame = GST_BUFFER_OFFSET (buffer);
+
+  const auto color_ret = gst_rsdemux_send (rsdemux, rsdemux->colorsrcpad, colorbuf, frame, StreamBitColor, wanted);
+  const auto depth_ret = gst_rsdemux_send (rsdemux, rsdemux->depthsrcpad, depthbuf, frame, StreamBitDepth, wanted);
+  auto imu_ret = GST_FLOW_NOT_LINKED;
+  if (rsdemux->imusrcpad != nullptr)
+    imu_ret = gst_rsdemux_send (rsdemux, rsdemux->imusrcpad, imubuf, frame, StreamBitImu, wanted);
+  else if (imubuf != nullptr)
+    gst_buffer_unref(imubuf);
+  ret = gst_rsdemux_combine_flows ({color_ret, depth_ret, imu_ret});
+
   gst_buffer_unref(buffer);
+  if (rsdemux->stats)
+    rsdemux->stats->record(RSStage::Push, RSStats::now() - push_start);
+  if (rsdemux->stats && rsdemux->stats->due())
+    rsdemux->stats->post(GST_ELEMENT (rsdemux));
   return ret;
 }
 
@@ -522,6 +1135,10 @@ gst_rsdemux_change_state (GstElement * element, GstStateChange transition)
       break;
     case GST_STATE_CHANGE_READY_TO_PAUSED:
       gst_rsdemux_reset (rsdemux);
+      GST_OBJECT_LOCK (rsdemux);
+      if (rsdemux->huge_pages != HugePages::HugePagesOff && rsdemux->allocator == nullptr)
+        rsdemux->allocator = gst_realsense_allocator_new (rsdemux->huge_pages, rsdemux->mlock);
+      GST_OBJECT_UNLOCK (rsdemux);
       break;
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
       break;
@@ -537,6 +1154,12 @@ gst_rsdemux_change_state (GstElement * element, GstStateChange transition)
       break;
     case GST_STATE_CHANGE_PAUSED_TO_READY:
       gst_rsdemux_remove_pads (rsdemux);
+      // buffers still out hold their own reference
+      GST_OBJECT_LOCK (rsdemux);
+      if (rsdemux->allocator != nullptr)
+        gst_object_unref (rsdemux->allocator);
+      rsdemux->allocator = nullptr;
+      GST_OBJECT_UNLOCK (rsdemux);
       break;
     case GST_STATE_CHANGE_READY_TO_NULL:
       break;
@@ -23,6 +23,11 @@
 
 #include <gst/gst.h>
 #include "common.hpp"
+#include "rspadqueue.hpp"
+#include "rsstats.hpp"
+
+#include <atomic>
+#include <memory>
 
 G_BEGIN_DECLS
 
@@ -41,6 +46,18 @@ G_BEGIN_DECLS
 typedef struct _GstRSDemux GstRSDemux;
 typedef struct _GstRSDemuxClass GstRSDemuxClass;
 
+constexpr const guint DEFAULT_PROP_RSDEMUX_QUEUE_DEPTH = 2;
+
+/* A source pad's queue and task in threaded mode */
+struct RSDemuxPadThread
+{
+  /* replaced under the object lock, used without it by the streaming thread */
+  std::unique_ptr<RSPadQueue> queue = nullptr;
+  /* last result of the pad's task, protected by the object lock */
+  GstFlowReturn  last_flow = GST_FLOW_OK;
+  std::atomic<guint64> dropped {0};
+};
+
 struct _GstRSDemux {
   GstElement     element;
 
@@ -56,6 +73,41 @@ struct _GstRSDemux {
   gint           in_stride_bytes;
 
   gint           frame_count = 0;
+  /* how far depth and IMU timestamps run ahead of the muxed buffer's,
+   * added to their pads' latency, protected by the object lock */
+  GstClockTime   depth_lead = 0;
+  GstClockTime   imu_lead = 0;
+
+  /* StreamBits of pads that returned NOT_LINKED, cleared when they are
+   * linked again, protected by the object lock */
+  gint           not_linked = 0;
+  /* StreamBits last asked for upstream, -1 before the first frame, only
+   * used by the streaming thread */
+  gint           streams_sent = -1;
+
+  /* pads push from their own tasks, as of the last start */
+  gboolean       threaded_active = FALSE;
+  RSDemuxPadThread color_thread;
+  RSDemuxPadThread depth_thread;
+  RSDemuxPadThread imu_thread;
+  /* of the video streams, for the latency of the pad queues */
+  GstClockTime   frame_duration = GST_CLOCK_TIME_NONE;
+
+  /* slab allocator proposed upstream, made at READY to PAUSED when
+   * huge-pages is set, protected by the object lock */
+  GstAllocator  *allocator = nullptr;
+
+  /* per-stage timings, only allocated when stats are on */
+  std::unique_ptr<RSStats> stats = nullptr;
+
+  /* properties */
+  gboolean       stats_on = FALSE;
+  guint          stats_interval = DEFAULT_PROP_STATS_INTERVAL;
+  gboolean       threaded = FALSE;
+  guint          queue_depth = DEFAULT_PROP_RSDEMUX_QUEUE_DEPTH;
+  OverflowPolicy overflow_policy = OverflowPolicy::DropOldest;
+  HugePages      huge_pages = HugePages::HugePagesOff;
+  gboolean       mlock = FALSE;
   GstStateChange state_change = GST_STATE_CHANGE_NULL_TO_NULL;
 };
 
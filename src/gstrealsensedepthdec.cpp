@@ -0,0 +1,314 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* GStreamer realsense depth decoder
+ *
+ * SECTION:element-rsdepthdec
+ * @title: rsdepthdec
+ *
+ * Restores the GRAY16_LE depth frames compressed by rsdepthenc. Realsense
+ * metadata on the compressed buffers is passed on; if it was lost on the
+ * way, the depth units and intrinsics stored in the stream are put back as
+ * metadata.
+ *
+ * The decode-time property reports the last frame.
+ *
+ * ## Example launch line
+ * |[
+ *  gst-launch-1.0 tcpclientsrc port=5000 ! gdpdepay ! rsdepthdec ! videoconvert ! autovideosink
+ * ]|
+ *
+ * This pipeline displays the depth served by the rsdepthenc example.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstrealsensedepthdec.h"
+#include "gstrealsensedepthenc.h"
+#include "gstrealsensemeta.h"
+
+GST_DEBUG_CATEGORY_STATIC (rsdepthdec_debug);
+#define GST_CAT_DEFAULT rsdepthdec_debug
+
+enum
+{
+  PROP_0,
+  PROP_DECODE_TIME,
+};
+
+static GstStaticPadTemplate sink_tmpl = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (RS_COMPRESSED_DEPTH_CAPS)
+    );
+
+static GstStaticPadTemplate src_tmpl = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("GRAY16_LE"))
+    );
+
+#define gst_rsdepthdec_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstRSDepthDec, gst_rsdepthdec, GST_TYPE_ELEMENT,
+  GST_DEBUG_CATEGORY_INIT(rsdepthdec_debug, "rsdepthdec", 0,
+  "Depth decoder element for Realsense plugin"));
+
+static void gst_rsdepthdec_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
+
+static gboolean gst_rsdepthdec_handle_sink_event (GstPad * pad, GstObject * parent, GstEvent * event);
+static GstFlowReturn gst_rsdepthdec_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer);
+static GstStateChangeReturn gst_rsdepthdec_change_state (GstElement * element, GstStateChange transition);
+
+static void
+gst_rsdepthdec_class_init (GstRSDepthDecClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+
+  gobject_class->get_property = gst_rsdepthdec_get_property;
+
+  gstelement_class->change_state = GST_DEBUG_FUNCPTR (gst_rsdepthdec_change_state);
+
+  gst_element_class_add_static_pad_template (gstelement_class, &sink_tmpl);
+  gst_element_class_add_static_pad_template (gstelement_class, &src_tmpl);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "RealSense Depth Decoder", "Codec/Decoder/Video",
+      "Decompress RealSense depth frames from rsdepthenc",
+      "Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>");
+
+  g_object_class_install_property (gobject_class, PROP_DECODE_TIME,
+    g_param_spec_uint64 ("decode-time", "Decode time",
+        "Time spent decompressing the last frame, in nanoseconds",
+        0, G_MAXUINT64, 0,
+        (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+}
+
+static void
+gst_rsdepthdec_init (GstRSDepthDec * rsdepthdec)
+{
+  rsdepthdec->sinkpad = gst_pad_new_from_static_template (&sink_tmpl, "sink");
+  gst_pad_set_chain_function (rsdepthdec->sinkpad, GST_DEBUG_FUNCPTR (gst_rsdepthdec_chain));
+  gst_pad_set_event_function (rsdepthdec->sinkpad, GST_DEBUG_FUNCPTR (gst_rsdepthdec_handle_sink_event));
+  gst_element_add_pad (GST_ELEMENT (rsdepthdec), rsdepthdec->sinkpad);
+
+  rsdepthdec->srcpad = gst_pad_new_from_static_template (&src_tmpl, "src");
+  gst_pad_use_fixed_caps (rsdepthdec->srcpad);
+  gst_element_add_pad (GST_ELEMENT (rsdepthdec), rsdepthdec->srcpad);
+
+  gst_video_info_init (&rsdepthdec->out_info);
+}
+
+static void
+gst_rsdepthdec_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  auto rsdepthdec = GST_RSDEPTHDEC (object);
+
+  GST_OBJECT_LOCK (rsdepthdec);
+  switch (prop_id) {
+    case PROP_DECODE_TIME:
+      g_value_set_uint64 (value, rsdepthdec->decode_time);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (rsdepthdec);
+}
+
+static void
+gst_rsdepthdec_clear_pool (GstRSDepthDec * rsdepthdec)
+{
+  if (rsdepthdec->pool) {
+    gst_buffer_pool_set_active (rsdepthdec->pool, FALSE);
+    gst_object_unref (rsdepthdec->pool);
+    rsdepthdec->pool = nullptr;
+  }
+}
+
+/* reset to default values before starting streaming */
+static void
+gst_rsdepthdec_reset (GstRSDepthDec * rsdepthdec)
+{
+  gst_video_info_init (&rsdepthdec->out_info);
+  gst_rsdepthdec_clear_pool (rsdepthdec);
+
+  GST_OBJECT_LOCK (rsdepthdec);
+  rsdepthdec->decode_time = 0;
+  GST_OBJECT_UNLOCK (rsdepthdec);
+}
+
+static gboolean
+gst_rsdepthdec_set_caps (GstRSDepthDec * rsdepthdec, GstCaps * caps)
+{
+  const auto s = gst_caps_get_structure (caps, 0);
+  gint width, height, fps_n = 0, fps_d = 1;
+  if (!gst_structure_get_int (s, "width", &width) || !gst_structure_get_int (s, "height", &height))
+    return FALSE;
+  gst_structure_get_fraction (s, "framerate", &fps_n, &fps_d);
+
+  auto info = &rsdepthdec->out_info;
+  gst_video_info_set_format (info, GST_VIDEO_FORMAT_GRAY16_LE, width, height);
+  GST_VIDEO_INFO_FPS_N (info) = fps_n;
+  GST_VIDEO_INFO_FPS_D (info) = fps_d;
+
+  auto outcaps = gst_video_info_to_caps (info);
+  GST_DEBUG_OBJECT (rsdepthdec, "output caps %" GST_PTR_FORMAT, outcaps);
+  auto res = gst_pad_set_caps (rsdepthdec->srcpad, outcaps);
+
+  gst_rsdepthdec_clear_pool (rsdepthdec);
+  if (res) {
+    rsdepthdec->pool = gst_buffer_pool_new ();
+    auto config = gst_buffer_pool_get_config (rsdepthdec->pool);
+    gst_buffer_pool_config_set_params (config, outcaps, static_cast<guint>(GST_VIDEO_INFO_SIZE (info)), 2, 0);
+    res = gst_buffer_pool_set_config (rsdepthdec->pool, config) &&
+        gst_buffer_pool_set_active (rsdepthdec->pool, TRUE);
+  }
+  gst_caps_unref (outcaps);
+  return res;
+}
+
+static gboolean
+gst_rsdepthdec_handle_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  auto rsdepthdec = GST_RSDEPTHDEC (parent);
+  gboolean res = TRUE;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+    {
+      GstCaps *caps;
+      gst_event_parse_caps (event, &caps);
+      res = gst_rsdepthdec_set_caps (rsdepthdec, caps);
+      gst_event_unref (event);
+      break;
+    }
+    default:
+      res = gst_pad_event_default (pad, parent, event);
+      break;
+  }
+
+  return res;
+}
+
+static GstFlowReturn
+gst_rsdepthdec_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  auto rsdepthdec = GST_RSDEPTHDEC (parent);
+
+  if (rsdepthdec->pool == nullptr) {
+    gst_buffer_unref (buffer);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  GstMapInfo map;
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
+
+  auto fail = [&](GstFlowReturn ret) {
+    gst_buffer_unmap (buffer, &map);
+    gst_buffer_unref (buffer);
+    return ret;
+  };
+
+  RSDepthCodecHeader header;
+  if (!RSDepthCodec::parse_header (map.data, map.size, header) ||
+      header.width != GST_VIDEO_INFO_WIDTH (&rsdepthdec->out_info) ||
+      header.height != GST_VIDEO_INFO_HEIGHT (&rsdepthdec->out_info)) {
+    GST_ELEMENT_ERROR (rsdepthdec, STREAM, DECODE,
+        ("Invalid compressed depth frame or frame size does not match caps."), (NULL));
+    return fail (GST_FLOW_ERROR);
+  }
+
+  GstBuffer *outbuf = nullptr;
+  if (gst_buffer_pool_acquire_buffer (rsdepthdec->pool, &outbuf, nullptr) != GST_FLOW_OK)
+    return fail (GST_FLOW_FLUSHING);
+
+  const auto start = gst_util_get_timestamp ();
+
+  GstVideoFrame frame;
+  gst_video_frame_map (&frame, &rsdepthdec->out_info, outbuf, GST_MAP_WRITE);
+  const auto ok = RSDepthCodec::decode (map.data, header,
+      static_cast<uint16_t*>(GST_VIDEO_FRAME_PLANE_DATA (&frame, 0)), GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0));
+  gst_video_frame_unmap (&frame);
+
+  const auto elapsed = GST_CLOCK_DIFF (start, gst_util_get_timestamp ());
+  if (!ok) {
+    gst_buffer_unref (outbuf);
+    GST_ELEMENT_ERROR (rsdepthdec, STREAM, DECODE, ("Corrupt compressed depth frame."), (NULL));
+    return fail (GST_FLOW_ERROR);
+  }
+
+  GST_OBJECT_LOCK (rsdepthdec);
+  rsdepthdec->decode_time = elapsed;
+  GST_OBJECT_UNLOCK (rsdepthdec);
+  GST_LOG_OBJECT (rsdepthdec, "decompressed %" G_GSIZE_FORMAT " bytes in %" GST_TIME_FORMAT,
+      map.size, GST_TIME_ARGS (elapsed));
+
+  gst_buffer_unmap (buffer, &map);
+  gst_buffer_copy_into (outbuf, buffer,
+      static_cast<GstBufferCopyFlags>(GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS | GST_BUFFER_COPY_META),
+      0, -1);
+  gst_buffer_unref (buffer);
+
+  if (gst_buffer_get_realsense_meta (outbuf) == nullptr && header.depth_units > 0.f) {
+    GstRealsenseMeta values {};
+    values.depth_units = header.depth_units;
+    values.depth_intrinsics = header.depth_intrinsics;
+    values.json_descr = g_intern_static_string ("");
+    gst_buffer_add_realsense_meta_from (outbuf, &values);
+  }
+
+  return gst_pad_push (rsdepthdec->srcpad, outbuf);
+}
+
+static GstStateChangeReturn
+gst_rsdepthdec_change_state (GstElement * element, GstStateChange transition)
+{
+  auto rsdepthdec = GST_RSDEPTHDEC (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_rsdepthdec_reset (rsdepthdec);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_rsdepthdec_reset (rsdepthdec);
+      break;
+    default:
+      break;
+  }
+  return ret;
+}
@@ -0,0 +1,340 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* GStreamer realsense depth encoder
+ *
+ * SECTION:element-rsdepthenc
+ * @title: rsdepthenc
+ *
+ * Lossless compression of GRAY16_LE depth frames, such as rsdemux's depth
+ * pad, for recording or sending over the network. rsdepthdec restores the
+ * exact frames. Depth units and depth intrinsics from the Realsense metadata
+ * are stored in every compressed frame as well as carried in the metadata.
+ *
+ * The compression-ratio and encode-time properties report the last frame.
+ *
+ * ## Example launch line
+ * |[
+ *  gst-launch-1.0 realsensesrc stream-type=2 ! rsdemux name=demux demux.depth ! \
+ *  rsdepthenc ! gdppay ! tcpserversink port=5000
+ * ]|
+ *
+ * This pipeline serves compressed depth over TCP.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstrealsensedepthenc.h"
+#include "gstrealsensemeta.h"
+
+GST_DEBUG_CATEGORY_STATIC (rsdepthenc_debug);
+#define GST_CAT_DEFAULT rsdepthenc_debug
+
+enum
+{
+  PROP_0,
+  PROP_COMPRESSION_RATIO,
+  PROP_ENCODE_TIME,
+};
+
+static GstStaticPadTemplate sink_tmpl = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("GRAY16_LE"))
+    );
+
+static GstStaticPadTemplate src_tmpl = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (RS_COMPRESSED_DEPTH_CAPS)
+    );
+
+#define gst_rsdepthenc_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstRSDepthEnc, gst_rsdepthenc, GST_TYPE_ELEMENT,
+  GST_DEBUG_CATEGORY_INIT(rsdepthenc_debug, "rsdepthenc", 0,
+  "Depth encoder element for Realsense plugin"));
+
+static void gst_rsdepthenc_finalize (GObject * object);
+static void gst_rsdepthenc_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
+
+static gboolean gst_rsdepthenc_handle_sink_event (GstPad * pad, GstObject * parent, GstEvent * event);
+static GstFlowReturn gst_rsdepthenc_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer);
+static GstStateChangeReturn gst_rsdepthenc_change_state (GstElement * element, GstStateChange transition);
+
+static void
+gst_rsdepthenc_class_init (GstRSDepthEncClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+
+  gobject_class->finalize = gst_rsdepthenc_finalize;
+  gobject_class->get_property = gst_rsdepthenc_get_property;
+
+  gstelement_class->change_state = GST_DEBUG_FUNCPTR (gst_rsdepthenc_change_state);
+
+  gst_element_class_add_static_pad_template (gstelement_class, &sink_tmpl);
+  gst_element_class_add_static_pad_template (gstelement_class, &src_tmpl);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "RealSense Depth Encoder", "Codec/Encoder/Video",
+      "Lossless compression of RealSense depth frames",
+      "Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>");
+
+  g_object_class_install_property (gobject_class, PROP_COMPRESSION_RATIO,
+    g_param_spec_double ("compression-ratio", "Compression ratio",
+        "Raw size divided by compressed size of the last frame",
+        0, G_MAXDOUBLE, 0,
+        (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_ENCODE_TIME,
+    g_param_spec_uint64 ("encode-time", "Encode time",
+        "Time spent compressing the last frame, in nanoseconds",
+        0, G_MAXUINT64, 0,
+        (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+}
+
+static void
+gst_rsdepthenc_init (GstRSDepthEnc * rsdepthenc)
+{
+  rsdepthenc->sinkpad = gst_pad_new_from_static_template (&sink_tmpl, "sink");
+  gst_pad_set_chain_function (rsdepthenc->sinkpad, GST_DEBUG_FUNCPTR (gst_rsdepthenc_chain));
+  gst_pad_set_event_function (rsdepthenc->sinkpad, GST_DEBUG_FUNCPTR (gst_rsdepthenc_handle_sink_event));
+  gst_element_add_pad (GST_ELEMENT (rsdepthenc), rsdepthenc->sinkpad);
+
+  rsdepthenc->srcpad = gst_pad_new_from_static_template (&src_tmpl, "src");
+  gst_pad_use_fixed_caps (rsdepthenc->srcpad);
+  gst_element_add_pad (GST_ELEMENT (rsdepthenc), rsdepthenc->srcpad);
+
+  gst_video_info_init (&rsdepthenc->in_info);
+}
+
+static void
+gst_rsdepthenc_finalize (GObject * object)
+{
+  auto rsdepthenc = GST_RSDEPTHENC (object);
+  gst_event_replace (&rsdepthenc->pending_segment, nullptr);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_rsdepthenc_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  auto rsdepthenc = GST_RSDEPTHENC (object);
+
+  GST_OBJECT_LOCK (rsdepthenc);
+  switch (prop_id) {
+    case PROP_COMPRESSION_RATIO:
+      g_value_set_double (value, rsdepthenc->compression_ratio);
+      break;
+    case PROP_ENCODE_TIME:
+      g_value_set_uint64 (value, rsdepthenc->encode_time);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (rsdepthenc);
+}
+
+static void
+gst_rsdepthenc_clear_pool (GstRSDepthEnc * rsdepthenc)
+{
+  if (rsdepthenc->pool) {
+    gst_buffer_pool_set_active (rsdepthenc->pool, FALSE);
+    gst_object_unref (rsdepthenc->pool);
+    rsdepthenc->pool = nullptr;
+  }
+}
+
+/* reset to default values before starting streaming */
+static void
+gst_rsdepthenc_reset (GstRSDepthEnc * rsdepthenc)
+{
+  rsdepthenc->have_caps = FALSE;
+  gst_event_replace (&rsdepthenc->pending_segment, nullptr);
+  gst_rsdepthenc_clear_pool (rsdepthenc);
+
+  GST_OBJECT_LOCK (rsdepthenc);
+  rsdepthenc->compression_ratio = 0;
+  rsdepthenc->encode_time = 0;
+  GST_OBJECT_UNLOCK (rsdepthenc);
+}
+
+static gboolean
+gst_rsdepthenc_set_src_caps (GstRSDepthEnc * rsdepthenc)
+{
+  const auto info = &rsdepthenc->in_info;
+  auto caps = gst_caps_new_simple ("application/x-rs-compressed-depth",
+      "width", G_TYPE_INT, GST_VIDEO_INFO_WIDTH (info),
+      "height", G_TYPE_INT, GST_VIDEO_INFO_HEIGHT (info),
+      "framerate", GST_TYPE_FRACTION, GST_VIDEO_INFO_FPS_N (info), GST_VIDEO_INFO_FPS_D (info),
+      NULL);
+
+  GST_DEBUG_OBJECT (rsdepthenc, "output caps %" GST_PTR_FORMAT, caps);
+  auto res = gst_pad_set_caps (rsdepthenc->srcpad, caps);
+
+  // one pool sized for the worst case; every frame shrinks its buffer
+  gst_rsdepthenc_clear_pool (rsdepthenc);
+  if (res) {
+    const auto size = RSDepthCodec::max_encoded_size (GST_VIDEO_INFO_WIDTH (info), GST_VIDEO_INFO_HEIGHT (info));
+    rsdepthenc->pool = gst_buffer_pool_new ();
+    auto config = gst_buffer_pool_get_config (rsdepthenc->pool);
+    gst_buffer_pool_config_set_params (config, caps, static_cast<guint>(size), 2, 0);
+    res = gst_buffer_pool_set_config (rsdepthenc->pool, config) &&
+        gst_buffer_pool_set_active (rsdepthenc->pool, TRUE);
+  }
+  gst_caps_unref (caps);
+
+  if (res && rsdepthenc->pending_segment) {
+    gst_pad_push_event (rsdepthenc->srcpad, rsdepthenc->pending_segment);
+    rsdepthenc->pending_segment = nullptr;
+  }
+  rsdepthenc->have_caps = res;
+  return res;
+}
+
+static gboolean
+gst_rsdepthenc_handle_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  auto rsdepthenc = GST_RSDEPTHENC (parent);
+  gboolean res = TRUE;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+    {
+      GstCaps *caps;
+      gst_event_parse_caps (event, &caps);
+      res = gst_video_info_from_caps (&rsdepthenc->in_info, caps) &&
+          gst_rsdepthenc_set_src_caps (rsdepthenc);
+      gst_event_unref (event);
+      break;
+    }
+    case GST_EVENT_SEGMENT:
+      if (!rsdepthenc->have_caps) {
+        // segment must not overtake caps downstream
+        gst_event_replace (&rsdepthenc->pending_segment, event);
+        gst_event_unref (event);
+        break;
+      }
+      res = gst_pad_push_event (rsdepthenc->srcpad, event);
+      break;
+    default:
+      res = gst_pad_event_default (pad, parent, event);
+      break;
+  }
+
+  return res;
+}
+
+static GstFlowReturn
+gst_rsdepthenc_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  auto rsdepthenc = GST_RSDEPTHENC (parent);
+
+  if (!rsdepthenc->have_caps) {
+    gst_buffer_unref (buffer);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  GstVideoFrame frame;
+  if (!gst_video_frame_map (&frame, &rsdepthenc->in_info, buffer, GST_MAP_READ)) {
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
+
+  GstBuffer *outbuf = nullptr;
+  if (gst_buffer_pool_acquire_buffer (rsdepthenc->pool, &outbuf, nullptr) != GST_FLOW_OK) {
+    gst_video_frame_unmap (&frame);
+    gst_buffer_unref (buffer);
+    return GST_FLOW_FLUSHING;
+  }
+
+  // depth units and intrinsics go into the stream too, for consumers without the meta
+  const auto meta = gst_buffer_get_realsense_meta (buffer);
+  rs2_intrinsics intrinsics {};
+  float depth_units = 0.f;
+  if (meta != nullptr) {
+    intrinsics = meta->depth_intrinsics;
+    depth_units = meta->depth_units;
+  }
+
+  const auto start = gst_util_get_timestamp ();
+
+  GstMapInfo omap;
+  gst_buffer_map (outbuf, &omap, GST_MAP_WRITE);
+  const auto size = RSDepthCodec::encode (
+      static_cast<const uint16_t*>(GST_VIDEO_FRAME_PLANE_DATA (&frame, 0)),
+      GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0),
+      GST_VIDEO_FRAME_WIDTH (&frame), GST_VIDEO_FRAME_HEIGHT (&frame),
+      depth_units, intrinsics, omap.data);
+  gst_buffer_unmap (outbuf, &omap);
+  gst_buffer_set_size (outbuf, size);
+
+  const auto elapsed = GST_CLOCK_DIFF (start, gst_util_get_timestamp ());
+  const auto raw_size = static_cast<gdouble>(GST_VIDEO_FRAME_WIDTH (&frame)) * GST_VIDEO_FRAME_HEIGHT (&frame) * 2;
+  gst_video_frame_unmap (&frame);
+
+  GST_OBJECT_LOCK (rsdepthenc);
+  rsdepthenc->compression_ratio = raw_size / size;
+  rsdepthenc->encode_time = elapsed;
+  GST_OBJECT_UNLOCK (rsdepthenc);
+  GST_LOG_OBJECT (rsdepthenc, "compressed %" G_GSIZE_FORMAT " bytes, ratio %.2f in %" GST_TIME_FORMAT,
+      size, raw_size / size, GST_TIME_ARGS (elapsed));
+
+  gst_buffer_copy_into (outbuf, buffer,
+      static_cast<GstBufferCopyFlags>(GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS | GST_BUFFER_COPY_META),
+      0, -1);
+  gst_buffer_unref (buffer);
+
+  return gst_pad_push (rsdepthenc->srcpad, outbuf);
+}
+
+static GstStateChangeReturn
+gst_rsdepthenc_change_state (GstElement * element, GstStateChange transition)
+{
+  auto rsdepthenc = GST_RSDEPTHENC (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_rsdepthenc_reset (rsdepthenc);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_rsdepthenc_reset (rsdepthenc);
+      break;
+    default:
+      break;
+  }
+  return ret;
+}
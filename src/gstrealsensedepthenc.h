@@ -0,0 +1,77 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSDEPTHENC_ELEMENT_H__
+#define __GST_RSDEPTHENC_ELEMENT_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include "common.hpp"
+#include "rsdepthcodec.hpp"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_RSDEPTHENC \
+  (gst_rsdepthenc_get_type())
+#define GST_RSDEPTHENC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_RSDEPTHENC,GstRSDepthEnc))
+#define GST_RSDEPTHENC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_RSDEPTHENC,GstRSDepthEncClass))
+#define GST_IS_RSDEPTHENC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_RSDEPTHENC))
+#define GST_IS_RSDEPTHENC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_RSDEPTHENC))
+
+/* caps of the compressed depth stream between rsdepthenc and rsdepthdec */
+#define RS_COMPRESSED_DEPTH_CAPS "application/x-rs-compressed-depth, " \
+  "width = " GST_VIDEO_SIZE_RANGE ", "                                  \
+  "height = " GST_VIDEO_SIZE_RANGE ", "                                 \
+  "framerate = " GST_VIDEO_FPS_RANGE
+
+typedef struct _GstRSDepthEnc GstRSDepthEnc;
+typedef struct _GstRSDepthEncClass GstRSDepthEncClass;
+
+struct _GstRSDepthEnc {
+  GstElement     element;
+
+  GstPad        *sinkpad;
+  GstPad        *srcpad;
+
+  /* stream state */
+  GstVideoInfo   in_info;     // from the sink caps
+  gboolean       have_caps;
+  GstEvent      *pending_segment; // held until output caps are set
+  GstBufferPool *pool;
+
+  /* statistics of the last frame, protected by the object lock */
+  gdouble        compression_ratio;
+  guint64        encode_time; // ns
+};
+
+struct _GstRSDepthEncClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_rsdepthenc_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_RSDEPTHENC_ELEMENT_H__ */
@@ -0,0 +1,459 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* GStreamer realsense depth filter
+ *
+ * SECTION:element-rsdepthfilter
+ * @title: rsdepthfilter
+ *
+ * Depth post-processing after the librealsense filters: decimation,
+ * spatial (edge-preserving) smoothing, temporal smoothing and hole filling,
+ * applied in that order to a GRAY16_LE depth stream such as rsdemux's depth
+ * pad. Without decimation the frame is filtered in place. Decimation scales
+ * the depth intrinsics in the Realsense metadata along with the frame.
+ *
+ * ## Example launch line
+ * |[
+ *  gst-launch-1.0 realsensesrc stream-type=2 ! rsdemux name=demux demux.depth ! queue ! \
+ *  rsdepthfilter decimation=2 spatial=true temporal=true hole-filling=1 ! videoconvert ! autovideosink
+ * ]|
+ *
+ * This pipeline halves the depth resolution, smooths it and fills holes
+ * before display.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstrealsensedepthfilter.h"
+#include "gstrealsensemeta.h"
+
+GST_DEBUG_CATEGORY_STATIC (rsdepthfilter_debug);
+#define GST_CAT_DEFAULT rsdepthfilter_debug
+
+enum
+{
+  PROP_0,
+  PROP_DECIMATION,
+  PROP_SPATIAL,
+  PROP_SPATIAL_ALPHA,
+  PROP_SPATIAL_DELTA,
+  PROP_SPATIAL_ITERATIONS,
+  PROP_TEMPORAL,
+  PROP_TEMPORAL_ALPHA,
+  PROP_TEMPORAL_DELTA,
+  PROP_TEMPORAL_PERSISTENCE,
+  PROP_HOLE_FILLING,
+  PROP_N_THREADS,
+};
+
+#define DEPTH_CAPS GST_VIDEO_CAPS_MAKE ("GRAY16_LE")
+
+static GstStaticPadTemplate sink_tmpl = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (DEPTH_CAPS)
+    );
+
+static GstStaticPadTemplate src_tmpl = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (DEPTH_CAPS)
+    );
+
+#define gst_rsdepthfilter_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstRSDepthFilter, gst_rsdepthfilter, GST_TYPE_VIDEO_FILTER,
+  GST_DEBUG_CATEGORY_INIT(rsdepthfilter_debug, "rsdepthfilter", 0,
+  "Depth filter element for Realsense plugin"));
+
+static void gst_rsdepthfilter_finalize (GObject * object);
+static void gst_rsdepthfilter_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_rsdepthfilter_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
+
+static gboolean gst_rsdepthfilter_start (GstBaseTransform * trans);
+static GstCaps *gst_rsdepthfilter_transform_caps (GstBaseTransform * trans, GstPadDirection direction,
+    GstCaps * caps, GstCaps * filter);
+static gboolean gst_rsdepthfilter_transform_meta (GstBaseTransform * trans, GstBuffer * outbuf,
+    GstMeta * meta, GstBuffer * inbuf);
+static gboolean gst_rsdepthfilter_set_info (GstVideoFilter * vfilter, GstCaps * incaps, GstVideoInfo * in_info,
+    GstCaps * outcaps, GstVideoInfo * out_info);
+static GstFlowReturn gst_rsdepthfilter_transform_frame (GstVideoFilter * vfilter, GstVideoFrame * inframe,
+    GstVideoFrame * outframe);
+static GstFlowReturn gst_rsdepthfilter_transform_frame_ip (GstVideoFilter * vfilter, GstVideoFrame * frame);
+
+static void
+gst_rsdepthfilter_class_init (GstRSDepthFilterClass * klass)
+{
+  auto gobject_class = G_OBJECT_CLASS (klass);
+  auto gstelement_class = GST_ELEMENT_CLASS (klass);
+  auto trans_class = GST_BASE_TRANSFORM_CLASS (klass);
+  auto vfilter_class = GST_VIDEO_FILTER_CLASS (klass);
+
+  gobject_class->finalize = gst_rsdepthfilter_finalize;
+  gobject_class->set_property = gst_rsdepthfilter_set_property;
+  gobject_class->get_property = gst_rsdepthfilter_get_property;
+
+  gst_element_class_add_static_pad_template (gstelement_class, &sink_tmpl);
+  gst_element_class_add_static_pad_template (gstelement_class, &src_tmpl);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "RealSense Depth Filter", "Filter/Effect/Video",
+      "Decimation, spatial, temporal and hole filling filters for RealSense depth",
+      "Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>");
+
+  trans_class->start = GST_DEBUG_FUNCPTR (gst_rsdepthfilter_start);
+  trans_class->transform_caps = GST_DEBUG_FUNCPTR (gst_rsdepthfilter_transform_caps);
+  trans_class->transform_meta = GST_DEBUG_FUNCPTR (gst_rsdepthfilter_transform_meta);
+  // passthrough means nothing to do, not filter a read-only frame
+  trans_class->transform_ip_on_passthrough = FALSE;
+
+  vfilter_class->set_info = GST_DEBUG_FUNCPTR (gst_rsdepthfilter_set_info);
+  vfilter_class->transform_frame = GST_DEBUG_FUNCPTR (gst_rsdepthfilter_transform_frame);
+  vfilter_class->transform_frame_ip = GST_DEBUG_FUNCPTR (gst_rsdepthfilter_transform_frame_ip);
+
+  const RSDepthFilterSettings defaults;
+
+  g_object_class_install_property (gobject_class, PROP_DECIMATION,
+    g_param_spec_int ("decimation", "Decimation",
+        "Reduce width and height by this factor (1 = off)",
+        1, 8, defaults.decimation,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SPATIAL,
+    g_param_spec_boolean ("spatial", "Spatial filter",
+        "Edge-preserving spatial smoothing", defaults.spatial,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SPATIAL_ALPHA,
+    g_param_spec_float ("spatial-alpha", "Spatial alpha",
+        "Weight of the current pixel in spatial smoothing (1 = no smoothing)",
+        0.25f, 1.f, defaults.spatial_alpha,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SPATIAL_DELTA,
+    g_param_spec_int ("spatial-delta", "Spatial delta",
+        "Depth step, in depth units, treated as an edge and not smoothed",
+        1, 65535, defaults.spatial_delta,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SPATIAL_ITERATIONS,
+    g_param_spec_int ("spatial-iterations", "Spatial iterations",
+        "Number of spatial filter passes",
+        1, 5, defaults.spatial_iterations,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_TEMPORAL,
+    g_param_spec_boolean ("temporal", "Temporal filter",
+        "Smooth depth over time", defaults.temporal,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_TEMPORAL_ALPHA,
+    g_param_spec_float ("temporal-alpha", "Temporal alpha",
+        "Weight of the current frame in temporal smoothing (1 = no smoothing)",
+        0.f, 1.f, defaults.temporal_alpha,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_TEMPORAL_DELTA,
+    g_param_spec_int ("temporal-delta", "Temporal delta",
+        "Depth change, in depth units, treated as motion and not smoothed",
+        1, 65535, defaults.temporal_delta,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_TEMPORAL_PERSISTENCE,
+    g_param_spec_int ("temporal-persistence", "Temporal persistence",
+        "Fill a missing pixel with its last depth if it had depth in at least "
+        "this many of the last 8 frames (0 = off)",
+        0, 8, defaults.temporal_persistence,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_HOLE_FILLING,
+    g_param_spec_int ("hole-filling", "Hole filling",
+        "Fill pixels without depth: 0 = off, 1 = from the left, "
+        "2 = farthest neighbour, 3 = nearest neighbour",
+        HoleFillingOff, HoleFillingNearest, defaults.hole_filling,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_N_THREADS,
+    g_param_spec_uint ("n-threads", "Threads",
+        "Maximum number of threads used for filtering (0 = one per core)",
+        0, G_MAXUINT, DEFAULT_PROP_RSDEPTHFILTER_N_THREADS,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+}
+
+static void
+gst_rsdepthfilter_update_passthrough (GstRSDepthFilter * rsdepthfilter)
+{
+  GST_OBJECT_LOCK (rsdepthfilter);
+  const auto any = rsdepthfilter->settings.any ();
+  GST_OBJECT_UNLOCK (rsdepthfilter);
+  gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (rsdepthfilter), !any);
+}
+
+static void
+gst_rsdepthfilter_init (GstRSDepthFilter * rsdepthfilter)
+{
+  rsdepthfilter->settings = RSDepthFilterSettings {};
+  rsdepthfilter->n_threads = DEFAULT_PROP_RSDEPTHFILTER_N_THREADS;
+  rsdepthfilter->filter = new RSDepthFilter();
+  gst_rsdepthfilter_update_passthrough (rsdepthfilter);
+}
+
+static void
+gst_rsdepthfilter_finalize (GObject * object)
+{
+  auto rsdepthfilter = GST_RSDEPTHFILTER (object);
+  delete rsdepthfilter->filter;
+  rsdepthfilter->filter = nullptr;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_rsdepthfilter_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  auto rsdepthfilter = GST_RSDEPTHFILTER (object);
+  auto& s = rsdepthfilter->settings;
+  bool reconfigure = false;
+
+  GST_OBJECT_LOCK (rsdepthfilter);
+  switch (prop_id) {
+    case PROP_DECIMATION:
+      reconfigure = s.decimation != g_value_get_int (value);
+      s.decimation = g_value_get_int (value);
+      break;
+    case PROP_SPATIAL:
+      s.spatial = g_value_get_boolean (value);
+      break;
+    case PROP_SPATIAL_ALPHA:
+      s.spatial_alpha = g_value_get_float (value);
+      break;
+    case PROP_SPATIAL_DELTA:
+      s.spatial_delta = g_value_get_int (value);
+      break;
+    case PROP_SPATIAL_ITERATIONS:
+      s.spatial_iterations = g_value_get_int (value);
+      break;
+    case PROP_TEMPORAL:
+      s.temporal = g_value_get_boolean (value);
+      break;
+    case PROP_TEMPORAL_ALPHA:
+      s.temporal_alpha = g_value_get_float (value);
+      break;
+    case PROP_TEMPORAL_DELTA:
+      s.temporal_delta = g_value_get_int (value);
+      break;
+    case PROP_TEMPORAL_PERSISTENCE:
+      s.temporal_persistence = g_value_get_int (value);
+      break;
+    case PROP_HOLE_FILLING:
+      s.hole_filling = g_value_get_int (value);
+      break;
+    case PROP_N_THREADS:
+      rsdepthfilter->n_threads = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (rsdepthfilter);
+
+  gst_rsdepthfilter_update_passthrough (rsdepthfilter);
+  // decimation changes the output size
+  if (reconfigure)
+    gst_base_transform_reconfigure_src (GST_BASE_TRANSFORM (rsdepthfilter));
+}
+
+static void
+gst_rsdepthfilter_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  auto rsdepthfilter = GST_RSDEPTHFILTER (object);
+  const auto& s = rsdepthfilter->settings;
+
+  GST_OBJECT_LOCK (rsdepthfilter);
+  switch (prop_id) {
+    case PROP_DECIMATION:
+      g_value_set_int (value, s.decimation);
+      break;
+    case PROP_SPATIAL:
+      g_value_set_boolean (value, s.spatial);
+      break;
+    case PROP_SPATIAL_ALPHA:
+      g_value_set_float (value, s.spatial_alpha);
+      break;
+    case PROP_SPATIAL_DELTA:
+      g_value_set_int (value, s.spatial_delta);
+      break;
+    case PROP_SPATIAL_ITERATIONS:
+      g_value_set_int (value, s.spatial_iterations);
+      break;
+    case PROP_TEMPORAL:
+      g_value_set_boolean (value, s.temporal);
+      break;
+    case PROP_TEMPORAL_ALPHA:
+      g_value_set_float (value, s.temporal_alpha);
+      break;
+    case PROP_TEMPORAL_DELTA:
+      g_value_set_int (value, s.temporal_delta);
+      break;
+    case PROP_TEMPORAL_PERSISTENCE:
+      g_value_set_int (value, s.temporal_persistence);
+      break;
+    case PROP_HOLE_FILLING:
+      g_value_set_int (value, s.hole_filling);
+      break;
+    case PROP_N_THREADS:
+      g_value_set_uint (value, rsdepthfilter->n_threads);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (rsdepthfilter);
+}
+
+static gboolean
+gst_rsdepthfilter_start (GstBaseTransform * trans)
+{
+  GST_RSDEPTHFILTER (trans)->filter->reset_history ();
+  return TRUE;
+}
+
+/* Scale width and height through decimation. Sink to src divides, src to
+ * sink allows every size that divides down to the given one. */
+static GstCaps *
+gst_rsdepthfilter_transform_caps (GstBaseTransform * trans, GstPadDirection direction,
+    GstCaps * caps, GstCaps * filter)
+{
+  auto rsdepthfilter = GST_RSDEPTHFILTER (trans);
+  GST_OBJECT_LOCK (rsdepthfilter);
+  const auto factor = rsdepthfilter->settings.decimation;
+  GST_OBJECT_UNLOCK (rsdepthfilter);
+
+  auto ret = gst_caps_new_empty ();
+  for (guint i = 0; i < gst_caps_get_size (caps); ++i) {
+    auto s = gst_structure_copy (gst_caps_get_structure (caps, i));
+    if (factor > 1) {
+      for (auto name : {"width", "height"}) {
+        gint size;
+        if (!gst_structure_get_int (s, name, &size))
+          gst_structure_set (s, name, GST_TYPE_INT_RANGE, 1, G_MAXINT, NULL);
+        else if (direction == GST_PAD_SINK)
+          gst_structure_set (s, name, G_TYPE_INT, RSDepthFilter::decimated (size, factor), NULL);
+        else
+          gst_structure_set (s, name, GST_TYPE_INT_RANGE, size * factor, size * factor + factor - 1, NULL);
+      }
+    }
+    ret = gst_caps_merge_structure (ret, s);
+  }
+
+  if (filter) {
+    auto tmp = gst_caps_intersect_full (filter, ret, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (ret);
+    ret = tmp;
+  }
+
+  GST_DEBUG_OBJECT (trans, "transformed %" GST_PTR_FORMAT " into %" GST_PTR_FORMAT, caps, ret);
+  return ret;
+}
+
+static gboolean
+gst_rsdepthfilter_transform_meta (GstBaseTransform * trans, GstBuffer * outbuf,
+    GstMeta * meta, GstBuffer * inbuf)
+{
+  // the depth intrinsics are fixed up in transform_frame
+  if (meta->info->api == GST_REALSENSE_META_API_TYPE)
+    return TRUE;
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->transform_meta (trans, outbuf, meta, inbuf);
+}
+
+static gboolean
+gst_rsdepthfilter_set_info (GstVideoFilter * vfilter, GstCaps * incaps, GstVideoInfo * in_info,
+    GstCaps * outcaps, GstVideoInfo * out_info)
+{
+  const auto same_size = GST_VIDEO_INFO_WIDTH (in_info) == GST_VIDEO_INFO_WIDTH (out_info) &&
+      GST_VIDEO_INFO_HEIGHT (in_info) == GST_VIDEO_INFO_HEIGHT (out_info);
+  gst_base_transform_set_in_place (GST_BASE_TRANSFORM (vfilter), same_size);
+
+  GST_RSDEPTHFILTER (vfilter)->filter->reset_history ();
+  return TRUE;
+}
+
+static void
+gst_rsdepthfilter_filter (GstRSDepthFilter * rsdepthfilter, GstVideoFrame * frame)
+{
+  GST_OBJECT_LOCK (rsdepthfilter);
+  const auto settings = rsdepthfilter->settings;
+  const auto threads = rsdepthfilter->n_threads;
+  GST_OBJECT_UNLOCK (rsdepthfilter);
+
+  if (GST_BUFFER_FLAG_IS_SET (frame->buffer, GST_BUFFER_FLAG_DISCONT))
+    rsdepthfilter->filter->reset_history ();
+
+  rsdepthfilter->filter->filter (
+      static_cast<uint16_t*>(GST_VIDEO_FRAME_PLANE_DATA (frame, 0)),
+      GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0),
+      GST_VIDEO_FRAME_WIDTH (frame), GST_VIDEO_FRAME_HEIGHT (frame),
+      settings, RSWorkerPool::shared (), threads);
+}
+
+static GstFlowReturn
+gst_rsdepthfilter_transform_frame (GstVideoFilter * vfilter, GstVideoFrame * inframe,
+    GstVideoFrame * outframe)
+{
+  auto rsdepthfilter = GST_RSDEPTHFILTER (vfilter);
+
+  GST_OBJECT_LOCK (rsdepthfilter);
+  const auto factor = rsdepthfilter->settings.decimation;
+  const auto threads = rsdepthfilter->n_threads;
+  GST_OBJECT_UNLOCK (rsdepthfilter);
+
+  rsdepthfilter->filter->decimate (
+      static_cast<const uint16_t*>(GST_VIDEO_FRAME_PLANE_DATA (inframe, 0)),
+      GST_VIDEO_FRAME_PLANE_STRIDE (inframe, 0),
+      GST_VIDEO_FRAME_WIDTH (inframe), GST_VIDEO_FRAME_HEIGHT (inframe), factor,
+      static_cast<uint16_t*>(GST_VIDEO_FRAME_PLANE_DATA (outframe, 0)),
+      GST_VIDEO_FRAME_PLANE_STRIDE (outframe, 0),
+      RSWorkerPool::shared (), threads);
+
+  // the decimated frame is a lower resolution depth camera
+  auto meta = gst_buffer_get_realsense_meta (outframe->buffer);
+  if (meta != nullptr) {
+    auto& intr = meta->depth_intrinsics;
+    intr.width = GST_VIDEO_FRAME_WIDTH (outframe);
+    intr.height = GST_VIDEO_FRAME_HEIGHT (outframe);
+    intr.fx /= factor;
+    intr.fy /= factor;
+    intr.ppx = (intr.ppx + 0.5f) / factor - 0.5f;
+    intr.ppy = (intr.ppy + 0.5f) / factor - 0.5f;
+  }
+
+  gst_rsdepthfilter_filter (rsdepthfilter, outframe);
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_rsdepthfilter_transform_frame_ip (GstVideoFilter * vfilter, GstVideoFrame * frame)
+{
+  gst_rsdepthfilter_filter (GST_RSDEPTHFILTER (vfilter), frame);
+  return GST_FLOW_OK;
+}
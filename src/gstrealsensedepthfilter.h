@@ -0,0 +1,67 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSDEPTHFILTER_ELEMENT_H__
+#define __GST_RSDEPTHFILTER_ELEMENT_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideofilter.h>
+#include "common.hpp"
+#include "rsdepthfilter.hpp"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_RSDEPTHFILTER \
+  (gst_rsdepthfilter_get_type())
+#define GST_RSDEPTHFILTER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_RSDEPTHFILTER,GstRSDepthFilter))
+#define GST_RSDEPTHFILTER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_RSDEPTHFILTER,GstRSDepthFilterClass))
+#define GST_IS_RSDEPTHFILTER(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_RSDEPTHFILTER))
+#define GST_IS_RSDEPTHFILTER_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_RSDEPTHFILTER))
+
+#define DEFAULT_PROP_RSDEPTHFILTER_N_THREADS 0
+
+typedef struct _GstRSDepthFilter GstRSDepthFilter;
+typedef struct _GstRSDepthFilterClass GstRSDepthFilterClass;
+
+struct _GstRSDepthFilter {
+  GstVideoFilter videofilter;
+
+  /* properties, protected by the object lock */
+  RSDepthFilterSettings settings;
+  guint          n_threads;
+
+  RSDepthFilter *filter;
+};
+
+struct _GstRSDepthFilterClass
+{
+  GstVideoFilterClass parent_class;
+};
+
+GType gst_rsdepthfilter_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_RSDEPTHFILTER_ELEMENT_H__ */
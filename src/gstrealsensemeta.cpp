@@ -25,7 +25,8 @@
 
 #include <librealsense2/rs.hpp>
 
-#include <iostream>
+#include <cstddef>
+#include <cstring>
 
 GType gst_realsense_meta_api_get_type (void)
 {
@@ -48,14 +49,7 @@ static gboolean gst_realsense_meta_transform (GstBuffer * dest, GstMeta * meta,
 
     if(GST_META_TRANSFORM_IS_COPY(type))
     {
-        dest_meta = gst_buffer_add_realsense_meta(
-            dest, 
-            *source_meta->cam_model,
-            *source_meta->cam_serial_number,
-            source_meta->exposure,
-            *source_meta->json_descr,
-            source_meta->depth_units,
-            &(source_meta->color_intrinsics));
+        dest_meta = gst_buffer_add_realsense_meta_from(dest, source_meta);
     }
     
     return dest_meta != nullptr;
@@ -65,26 +59,17 @@ static gboolean gst_realsense_meta_init (GstMeta * meta, gpointer params,
                                       GstBuffer * buffer)
 {
     GstRealsenseMeta* rsmeta = reinterpret_cast<GstRealsenseMeta*>(meta);
-    rsmeta->cam_model = nullptr;
-    rsmeta->cam_serial_number = nullptr;
-    rsmeta->json_descr = nullptr;
     rsmeta->exposure = 0;
     rsmeta->depth_units = 0.f;
     rsmeta->color_intrinsics = {};
+    rsmeta->depth_intrinsics = {};
+    rsmeta->depth_to_color = {};
+    rsmeta->cam_model[0] = '\0';
+    rsmeta->cam_serial_number[0] = '\0';
+    rsmeta->json_descr = g_intern_static_string("");
     return TRUE;
 }
 
-static void gst_realsense_meta_free (GstMeta * meta, GstBuffer * buffer)
-{
-    auto rsmeta = reinterpret_cast<GstRealsenseMeta*>(meta);
-    delete rsmeta->cam_model;
-    delete rsmeta->cam_serial_number;
-    delete rsmeta->json_descr;
-    rsmeta->exposure = 0;
-    rsmeta->depth_units = 0.f;
-    rsmeta->color_intrinsics = {};
-}
-
 const GstMetaInfo * gst_realsense_meta_get_info (void)
 {
     static const GstMetaInfo *meta_info = NULL;
@@ -95,32 +80,56 @@ const GstMetaInfo * gst_realsense_meta_get_info (void)
                                    "GstRealsenseMeta",
                                    sizeof (GstRealsenseMeta),
                                    gst_realsense_meta_init,
-                                   gst_realsense_meta_free,
+                                   nullptr, // nothing to free
                                    gst_realsense_meta_transform);
         g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) mi);
     }
     return meta_info;
 }
 
+void gst_realsense_meta_set_values(GstRealsenseMeta* meta, const GstRealsenseMeta* values)
+{
+    constexpr auto offset = offsetof(GstRealsenseMeta, exposure);
+    std::memcpy(reinterpret_cast<guint8*>(meta) + offset, 
+        reinterpret_cast<const guint8*>(values) + offset, 
+        sizeof(GstRealsenseMeta) - offset);
+}
+
+GstRealsenseMeta* gst_buffer_add_realsense_meta_from(GstBuffer* buffer, const GstRealsenseMeta* values)
+{
+    g_return_val_if_fail (GST_IS_BUFFER (buffer), nullptr);
+
+    auto meta = 
+        reinterpret_cast<GstRealsenseMeta*>(gst_buffer_add_meta(buffer, GST_REALSENSE_META_INFO, nullptr));
+    gst_realsense_meta_set_values(meta, values);
+    return meta;
+}
+
 GstRealsenseMeta* gst_buffer_add_realsense_meta (GstBuffer * buffer, 
-        const std::string model,
-        const std::string serial_number,
+        const gchar* model,
+        const gchar* serial_number,
         const uint exposure,
-        const std::string json_descr,
+        const gchar* json_descr,
         float depth_units,
-        const rs2_intrinsics* color_intrinsics)
+        const rs2_intrinsics* color_intrinsics,
+        const rs2_intrinsics* depth_intrinsics,
+        const rs2_extrinsics* depth_to_color)
 {
     g_return_val_if_fail (GST_IS_BUFFER (buffer), nullptr);
 
     auto meta = 
         reinterpret_cast<GstRealsenseMeta*>(gst_buffer_add_meta(buffer, GST_REALSENSE_META_INFO, nullptr));
 
-    meta->cam_model = new std::string(model);
-    meta->cam_serial_number = new std::string(serial_number);
-    meta->json_descr = new std::string(json_descr);
+    g_strlcpy(meta->cam_model, model, sizeof(meta->cam_model));
+    g_strlcpy(meta->cam_serial_number, serial_number, sizeof(meta->cam_serial_number));
+    meta->json_descr = g_intern_string(json_descr);
     meta->exposure = exposure;
     meta->depth_units = depth_units;
     meta->color_intrinsics = *color_intrinsics;
+    if (depth_intrinsics != nullptr)
+        meta->depth_intrinsics = *depth_intrinsics;
+    if (depth_to_color != nullptr)
+        meta->depth_to_color = *depth_to_color;
     return meta;
 }
 
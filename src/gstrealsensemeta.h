@@ -25,19 +25,24 @@
 #include <gst/video/video.h>
 
 #include <librealsense2/rs.hpp>
-#include <string>
 
 G_BEGIN_DECLS
 
+#define GST_REALSENSE_META_STRING_SIZE 32
+
+/* Plain data only, so adding and copying the meta never allocates.
+ * realsensesrc fills one of these per session and copies it into every buffer. */
 struct _GstRealsenseMeta {
   GstMeta            meta;
   
   uint exposure = 0;
   float depth_units = 0.f;
   rs2_intrinsics color_intrinsics;
-  std::string* cam_model;
-  std::string* cam_serial_number;
-  std::string* json_descr; // generic json descriptor
+  rs2_intrinsics depth_intrinsics;
+  rs2_extrinsics depth_to_color; // transform from depth to color camera
+  gchar cam_model[GST_REALSENSE_META_STRING_SIZE];
+  gchar cam_serial_number[GST_REALSENSE_META_STRING_SIZE];
+  const gchar* json_descr; // generic json descriptor, interned with g_intern_string
 };
 
 GType gst_realsense_meta_api_get_type (void);
@@ -49,14 +54,23 @@ typedef struct _GstRealsenseMeta GstRealsenseMeta;
 #define gst_buffer_get_realsense_meta(b) ((GstRealsenseMeta*)gst_buffer_get_meta((b),GST_REALSENSE_META_API_TYPE))
 
 GstRealsenseMeta *gst_buffer_add_realsense_meta(GstBuffer* buffer, 
-        const std::string model,
-        const std::string serial_number,
+        const gchar* model,
+        const gchar* serial_number,
         uint exposure, 
-        const std::string json_descr,
+        const gchar* json_descr,
         float depth_units,
-        const rs2_intrinsics* color_intrinsics
+        const rs2_intrinsics* color_intrinsics,
+        const rs2_intrinsics* depth_intrinsics = nullptr,
+        const rs2_extrinsics* depth_to_color = nullptr
         );
 
+/* Add a meta holding the same values as values. Only the fields after
+ * the GstMeta header of values are read. */
+GstRealsenseMeta *gst_buffer_add_realsense_meta_from(GstBuffer* buffer, const GstRealsenseMeta* values);
+
+/* Copy everything but the GstMeta header from values into meta */
+void gst_realsense_meta_set_values(GstRealsenseMeta* meta, const GstRealsenseMeta* values);
+
 // for python access
 float gst_buffer_realsense_get_depth_meta(GstBuffer* buffer);
 rs2_intrinsics* gst_buffer_realsense_meta_get_instrinsics(GstBuffer* buffer);
@@ -0,0 +1,960 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:element-realsensemultisrc
+ *
+ * Source element for several Intel RealSense cameras. Request one src_%u
+ * pad per camera; src_N streams the Nth serial number of the serials
+ * property, or the Nth connected camera when serials is empty. Every pad
+ * carries the same buffers realsensesrc would for its camera.
+ *
+ * Devices are enumerated once for all cameras. Frames are taken from the
+ * SDK callbacks and muxed on the shared worker pool, so more cameras use
+ * more cores instead of more mostly idle capture threads. With hw-sync the
+ * first camera drives the others through the sync cable.
+ *
+ * Example launch line
+ * |[
+ * gst-launch-1.0 realsensemultisrc name=cams serials="918512070217,918512070218" stream-type=2 hw-sync=true \
+ *   cams.src_0 ! rsdemux ! fakesink cams.src_1 ! rsdemux ! fakesink
+ * ]|
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/audio/audio.h>
+
+#include "gstrealsensemultisrc.h"
+
+#include "rsmux.hpp"
+#include "rsgeometry.hpp"
+#include "rsworkers.hpp"
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+GST_DEBUG_CATEGORY_STATIC (gst_realsense_multisrc_debug);
+#define GST_CAT_DEFAULT gst_realsense_multisrc_debug
+
+enum
+{
+  PROP_0,
+  PROP_SERIALS,
+  PROP_STREAM_TYPE,
+  PROP_HW_SYNC,
+  PROP_QUEUE_DEPTH,
+  PROP_DROPPED,
+  PROP_COLOR_WIDTH,
+  PROP_COLOR_HEIGHT,
+  PROP_COLOR_FPS,
+  PROP_DEPTH_WIDTH,
+  PROP_DEPTH_HEIGHT,
+  PROP_DEPTH_FPS,
+  PROP_COLOR_FORMAT
+};
+
+// values of RS2_OPTION_INTER_CAM_SYNC_MODE
+constexpr float SYNC_MODE_MASTER = 1.f;
+constexpr float SYNC_MODE_SLAVE = 2.f;
+
+static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE
+        ("{ RGB, BGR, RGBA, BGRA, YUY2, GRAY16_LE, GRAY16_BE }")
+        "; " RS_MUX_CAPS)
+    );
+
+G_DEFINE_TYPE (GstRealsenseMultiSrcPad, gst_realsense_multisrc_pad, GST_TYPE_PAD);
+
+#define gst_realsense_multisrc_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstRealsenseMultiSrc, gst_realsense_multisrc,
+    GST_TYPE_ELEMENT,
+    GST_DEBUG_CATEGORY_INIT (gst_realsense_multisrc_debug, "realsensemultisrc",
+      0, "Multi camera RealSense source"));
+
+static void gst_realsense_multisrc_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_realsense_multisrc_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+static void gst_realsense_multisrc_finalize (GObject * object);
+
+static GstPad *gst_realsense_multisrc_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_realsense_multisrc_release_pad (GstElement * element, GstPad * pad);
+static GstStateChangeReturn gst_realsense_multisrc_change_state (GstElement * element,
+    GstStateChange transition);
+
+static gboolean gst_realsense_multisrc_src_query (GstPad * pad, GstObject * parent, GstQuery * query);
+static void gst_realsense_multisrc_loop (GstRealsenseMultiSrcPad * pad);
+static void gst_realsense_multisrc_pad_stop (GstRealsenseMultiSrc * src, GstRealsenseMultiSrcPad * pad);
+
+static void
+gst_realsense_multisrc_pad_finalize (GObject * object)
+{
+  auto pad = GST_REALSENSEMULTISRC_PAD (object);
+
+  g_mutex_clear (&pad->mux_lock);
+  g_cond_clear (&pad->mux_done);
+
+  G_OBJECT_CLASS (gst_realsense_multisrc_pad_parent_class)->finalize (object);
+}
+
+static void
+gst_realsense_multisrc_pad_class_init (GstRealsenseMultiSrcPadClass * klass)
+{
+  G_OBJECT_CLASS (klass)->finalize = gst_realsense_multisrc_pad_finalize;
+}
+
+static void
+gst_realsense_multisrc_pad_init (GstRealsenseMultiSrcPad * pad)
+{
+  pad->stream_type = StreamType::StreamDepth;
+  pad->color_format = GST_VIDEO_FORMAT_UNKNOWN;
+  pad->imu_active = false;
+  pad->frame_duration = GST_CLOCK_TIME_NONE;
+  pad->mux_scheduled = false;
+  g_mutex_init (&pad->mux_lock);
+  g_cond_init (&pad->mux_done);
+  pad->mux_jobs = 0;
+}
+
+static void
+gst_realsense_multisrc_class_init (GstRealsenseMultiSrcClass * klass)
+{
+  GObjectClass *gobject_class = (GObjectClass *) klass;
+  GstElementClass *gstelement_class = (GstElementClass *) klass;
+
+  gobject_class->set_property = gst_realsense_multisrc_set_property;
+  gobject_class->get_property = gst_realsense_multisrc_get_property;
+  gobject_class->finalize = gst_realsense_multisrc_finalize;
+
+  gstelement_class->request_new_pad = GST_DEBUG_FUNCPTR (gst_realsense_multisrc_request_new_pad);
+  gstelement_class->release_pad = GST_DEBUG_FUNCPTR (gst_realsense_multisrc_release_pad);
+  gstelement_class->change_state = GST_DEBUG_FUNCPTR (gst_realsense_multisrc_change_state);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+    "RealsenseMultiSrc",
+    "Source/Video/Sensors",
+    "Source element for several Intel RealSense cameras, one pad per camera",
+    "Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>");
+
+  gst_element_class_add_static_pad_template_with_gtype (gstelement_class,
+      &src_factory, GST_TYPE_REALSENSEMULTISRC_PAD);
+
+  g_object_class_install_property (gobject_class, PROP_SERIALS,
+    g_param_spec_string ("serials", "Serial numbers",
+        "Comma separated camera serial numbers, src_N streams the Nth. "
+        "Empty uses connected cameras in enumeration order.", nullptr,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STREAM_TYPE,
+    g_param_spec_int ("stream-type", "Stream type",
+        "Streams of every camera: 0 = color, 1 = depth, 2 = color and depth muxed",
+        StreamType::StreamColor, StreamType::StreamMux, StreamType::StreamDepth,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_HW_SYNC,
+    g_param_spec_boolean ("hw-sync", "Hardware sync",
+        "Make the first camera the sync master and the others slaves (inter-cam sync mode)", false,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_QUEUE_DEPTH,
+    g_param_spec_uint ("queue-depth", "Queue depth",
+        "Number of frames each camera may queue before muxing and before pushing",
+        1, 64, DEFAULT_PROP_MULTI_QUEUE_DEPTH,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DROPPED,
+    g_param_spec_uint64 ("dropped", "Dropped",
+          "Number of frames dropped over all cameras because a queue was full",
+          0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_COLOR_WIDTH,
+    g_param_spec_int ("color-width", "Color width",
+        "Width of every camera's color stream (0 = device default)",
+        0, 16384, 0,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_COLOR_HEIGHT,
+    g_param_spec_int ("color-height", "Color height",
+        "Height of every camera's color stream (0 = device default)",
+        0, 16384, 0,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_COLOR_FPS,
+    g_param_spec_int ("color-fps", "Color frame rate",
+        "Frame rate of every camera's color stream (0 = device default)",
+        0, 1000, 0,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DEPTH_WIDTH,
+    g_param_spec_int ("depth-width", "Depth width",
+        "Width of every camera's depth stream (0 = device default)",
+        0, 16384, 0,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DEPTH_HEIGHT,
+    g_param_spec_int ("depth-height", "Depth height",
+        "Height of every camera's depth stream (0 = device default)",
+        0, 16384, 0,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DEPTH_FPS,
+    g_param_spec_int ("depth-fps", "Depth frame rate",
+        "Frame rate of every camera's depth stream (0 = device default)",
+        0, 1000, 0,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_COLOR_FORMAT,
+    g_param_spec_int ("color-format", "Color format",
+        "Color format requested from every camera: 0 = RGB8, 1 = BGR8, 2 = RGBA8, 3 = BGRA8, "
+        "4 = YUYV (YUY2, the native format, no conversion in the SDK)",
+        ColorFormat::ColorRGB8, ColorFormat::ColorYUYV, ColorFormat::ColorRGB8,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+}
+
+static void
+gst_realsense_multisrc_init (GstRealsenseMultiSrc * src)
+{
+  src->serials = nullptr;
+  src->stream_type = StreamType::StreamDepth;
+  src->hw_sync = false;
+  src->queue_depth = DEFAULT_PROP_MULTI_QUEUE_DEPTH;
+  src->color_width = 0;
+  src->color_height = 0;
+  src->color_fps = 0;
+  src->depth_width = 0;
+  src->depth_height = 0;
+  src->depth_fps = 0;
+  src->color_format = ColorFormat::ColorRGB8;
+  src->playing = false;
+  src->dropped = 0;
+  src->next_pad = 0;
+}
+
+static void
+gst_realsense_multisrc_finalize (GObject * object)
+{
+  auto src = GST_REALSENSEMULTISRC (object);
+
+  g_free (src->serials);
+  src->serials = nullptr;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_realsense_multisrc_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  auto src = GST_REALSENSEMULTISRC (object);
+
+  switch (prop_id)
+  {
+    case PROP_SERIALS:
+      g_free(src->serials);
+      src->serials = g_value_dup_string(value);
+      break;
+    case PROP_STREAM_TYPE:
+      src->stream_type = static_cast<StreamType>(g_value_get_int(value));
+      break;
+    case PROP_HW_SYNC:
+      src->hw_sync = g_value_get_boolean(value);
+      break;
+    case PROP_QUEUE_DEPTH:
+      src->queue_depth = g_value_get_uint(value);
+      break;
+    case PROP_COLOR_WIDTH:
+      src->color_width = g_value_get_int(value);
+      break;
+    case PROP_COLOR_HEIGHT:
+      src->color_height = g_value_get_int(value);
+      break;
+    case PROP_COLOR_FPS:
+      src->color_fps = g_value_get_int(value);
+      break;
+    case PROP_DEPTH_WIDTH:
+      src->depth_width = g_value_get_int(value);
+      break;
+    case PROP_DEPTH_HEIGHT:
+      src->depth_height = g_value_get_int(value);
+      break;
+    case PROP_DEPTH_FPS:
+      src->depth_fps = g_value_get_int(value);
+      break;
+    case PROP_COLOR_FORMAT:
+      src->color_format = static_cast<ColorFormat>(g_value_get_int(value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_realsense_multisrc_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  auto src = GST_REALSENSEMULTISRC (object);
+
+  switch (prop_id)
+  {
+    case PROP_SERIALS:
+      g_value_set_string(value, src->serials);
+      break;
+    case PROP_STREAM_TYPE:
+      g_value_set_int(value, src->stream_type);
+      break;
+    case PROP_HW_SYNC:
+      g_value_set_boolean(value, src->hw_sync);
+      break;
+    case PROP_QUEUE_DEPTH:
+      g_value_set_uint(value, src->queue_depth);
+      break;
+    case PROP_DROPPED:
+      g_value_set_uint64(value, src->dropped.load());
+      break;
+    case PROP_COLOR_WIDTH:
+      g_value_set_int(value, src->color_width);
+      break;
+    case PROP_COLOR_HEIGHT:
+      g_value_set_int(value, src->color_height);
+      break;
+    case PROP_COLOR_FPS:
+      g_value_set_int(value, src->color_fps);
+      break;
+    case PROP_DEPTH_WIDTH:
+      g_value_set_int(value, src->depth_width);
+      break;
+    case PROP_DEPTH_HEIGHT:
+      g_value_set_int(value, src->depth_height);
+      break;
+    case PROP_DEPTH_FPS:
+      g_value_set_int(value, src->depth_fps);
+      break;
+    case PROP_COLOR_FORMAT:
+      g_value_set_int(value, src->color_format);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static GstPad *
+gst_realsense_multisrc_request_new_pad (GstElement * element, GstPadTemplate * templ,
+    const gchar * name, const GstCaps * caps)
+{
+  auto src = GST_REALSENSEMULTISRC (element);
+
+  GST_OBJECT_LOCK (src);
+  guint index = src->next_pad;
+  if (name != nullptr && sscanf (name, "src_%u", &index) != 1)
+  {
+    GST_OBJECT_UNLOCK (src);
+    GST_WARNING_OBJECT (src, "Invalid pad name %s", name);
+    return nullptr;
+  }
+  src->next_pad = MAX (src->next_pad, index + 1);
+  GST_OBJECT_UNLOCK (src);
+
+  auto pad_name = g_strdup_printf ("src_%u", index);
+  auto existing = gst_element_get_static_pad (element, pad_name);
+  if (existing != nullptr)
+  {
+    gst_object_unref (existing);
+    GST_WARNING_OBJECT (src, "Pad %s already exists", pad_name);
+    g_free (pad_name);
+    return nullptr;
+  }
+
+  auto pad = GST_REALSENSEMULTISRC_PAD (g_object_new (GST_TYPE_REALSENSEMULTISRC_PAD,
+      "name", pad_name, "direction", GST_PAD_SRC, "template", templ, NULL));
+  g_free (pad_name);
+  pad->index = index;
+
+  gst_pad_set_query_function (GST_PAD (pad), GST_DEBUG_FUNCPTR (gst_realsense_multisrc_src_query));
+  gst_pad_use_fixed_caps (GST_PAD (pad));
+
+  // on failure the element has already sunk and dropped the pad
+  if (!gst_element_add_pad (element, GST_PAD (pad)))
+    return nullptr;
+
+  return GST_PAD (pad);
+}
+
+static void
+gst_realsense_multisrc_release_pad (GstElement * element, GstPad * pad)
+{
+  auto src = GST_REALSENSEMULTISRC (element);
+
+  gst_pad_stop_task (pad);
+  gst_realsense_multisrc_pad_stop (src, GST_REALSENSEMULTISRC_PAD (pad));
+  gst_element_remove_pad (element, pad);
+}
+
+static std::vector<std::string>
+gst_realsense_multisrc_parse_serials (const gchar * serials)
+{
+  std::vector<std::string> out;
+  if (serials == nullptr)
+    return out;
+
+  std::stringstream ss(serials);
+  std::string serial;
+  while (std::getline(ss, serial, ','))
+  {
+    serial.erase(0, serial.find_first_not_of(" \t"));
+    serial.erase(serial.find_last_not_of(" \t") + 1);
+    if (!serial.empty())
+      out.push_back(serial);
+  }
+  return out;
+}
+
+/* Same values realsensesrc puts in its GstRealsenseMeta, from the stream
+ * profiles since no frame has arrived yet. */
+static void
+gst_realsense_multisrc_set_meta_values (GstRealsenseMultiSrcPad * pad, rs2::device& dev,
+    const rs2::pipeline_profile& profile)
+{
+  auto& values = pad->meta_values;
+  values = GstRealsenseMeta {};
+
+  g_strlcpy(values.cam_model, dev.supports(RS2_CAMERA_INFO_NAME) ? dev.get_info(RS2_CAMERA_INFO_NAME) : "unknown",
+      sizeof(values.cam_model));
+  g_strlcpy(values.cam_serial_number, dev.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER), sizeof(values.cam_serial_number));
+  values.json_descr = g_intern_static_string("");
+
+  const bool color_on = pad->stream_type != StreamType::StreamDepth;
+  const bool depth_on = pad->stream_type != StreamType::StreamColor;
+  rs2::video_stream_profile cstream, dstream;
+  if (color_on)
+  {
+    cstream = profile.get_stream(RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
+    values.color_intrinsics = cstream.get_intrinsics();
+  }
+  if (depth_on)
+  {
+    dstream = profile.get_stream(RS2_STREAM_DEPTH).as<rs2::video_stream_profile>();
+    values.depth_intrinsics = dstream.get_intrinsics();
+    values.depth_units = RSDeviceCache::shared().info(dev).depth_units;
+  }
+  if (color_on && depth_on)
+  {
+    values.depth_to_color = dstream.get_extrinsics_to(cstream);
+  }
+  else if (depth_on)
+  {
+    values.color_intrinsics = values.depth_intrinsics;
+    values.depth_to_color = rs_identity_extrinsics();
+  }
+}
+
+/* Caps, sizes and pool from the stream profiles. Mux caps and sizes are
+ * the same as realsensesrc's. */
+static void
+gst_realsense_multisrc_pad_configure (GstRealsenseMultiSrcPad * pad, const rs2::pipeline_profile& profile)
+{
+  const auto depth_fmt = G_BYTE_ORDER == G_LITTLE_ENDIAN ? GST_VIDEO_FORMAT_GRAY16_LE : GST_VIDEO_FORMAT_GRAY16_BE;
+  const auto first = profile.get_stream(pad->stream_type == StreamType::StreamDepth ?
+      RS2_STREAM_DEPTH : RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
+  const auto fmt = pad->stream_type == StreamType::StreamDepth ? depth_fmt : RSMux::video_format(first.format());
+  pad->color_format = fmt;
+
+  GstVideoInfo info;
+  gst_video_info_set_format(&info, fmt, first.width(), first.height());
+  pad->gst_stride = GST_VIDEO_INFO_COMP_STRIDE (&info, 0);
+  pad->out_size = static_cast<gsize>(first.height()) * pad->gst_stride;
+
+  GST_VIDEO_INFO_FPS_N (&info) = first.fps();
+  GST_VIDEO_INFO_FPS_D (&info) = 1;
+  pad->frame_duration = gst_util_uint64_scale_int (GST_SECOND, 1, first.fps());
+
+  gst_caps_replace (&pad->caps, nullptr);
+  if (pad->stream_type == StreamType::StreamMux)
+  {
+    const auto depth = profile.get_stream(RS2_STREAM_DEPTH).as<rs2::video_stream_profile>();
+    RSHeader header {};
+    header.color_width = first.width();
+    header.color_height = first.height();
+    header.color_stride = pad->gst_stride;
+    header.color_format = fmt;
+    header.depth_width = depth.width();
+    header.depth_height = depth.height();
+    header.depth_stride = depth.width() * static_cast<int>(sizeof(uint16_t));
+    header.depth_format = depth_fmt;
+    header.color_fps = first.fps();
+    header.depth_fps = depth.fps();
+    pad->caps = RSMux::caps(header, false);
+    pad->out_size = RSMux::layout_size(RSMux::layout(header, pad->out_size,
+        static_cast<gsize>(header.depth_height) * header.depth_stride, 0));
+  }
+  else
+  {
+    pad->caps = gst_video_info_to_caps (&info);
+  }
+
+  pad->pool = gst_buffer_pool_new ();
+  auto config = gst_buffer_pool_get_config (pad->pool);
+  gst_buffer_pool_config_set_params (config, pad->caps, pad->out_size, 0, 0);
+  auto params = RSMux::allocation_params ();
+  gst_buffer_pool_config_set_allocator (config, nullptr, &params);
+  gst_buffer_pool_set_config (pad->pool, config);
+  gst_buffer_pool_set_active (pad->pool, TRUE);
+}
+
+/* Runs on the shared worker pool. Only one job per pad is queued or running
+ * at a time, so frames of a camera are muxed in order while different
+ * cameras are muxed in parallel. */
+static void
+gst_realsense_multisrc_mux_job (GstRealsenseMultiSrc * src, GstRealsenseMultiSrcPad * pad)
+{
+  for (;;)
+  {
+    RSMultiSrcFrame item;
+    while (pad->frames->try_pop(item))
+    {
+      GstBuffer *buffer = nullptr;
+      if (gst_buffer_pool_acquire_buffer (pad->pool, &buffer, nullptr) != GST_FLOW_OK)
+        buffer = nullptr;
+
+      try
+      {
+        if (pad->stream_type == StreamType::StreamMux)
+        {
+          auto frame_set = item.frame.as<rs2::frameset>();
+          auto cframe = frame_set.get_color_frame();
+          auto depth = frame_set.get_depth_frame();
+          if (!cframe || !depth)
+          {
+            if (buffer != nullptr)
+              gst_buffer_unref (buffer);
+            continue;
+          }
+          RSHeader header {};
+          header.color_height = cframe.get_height();
+          header.color_width = cframe.get_width();
+          header.color_stride = pad->gst_stride;
+          header.color_format = pad->color_format;
+          header.depth_height = depth.get_height();
+          header.depth_width = depth.get_width();
+          header.depth_stride = depth.get_stride_in_bytes();
+          header.depth_format = G_BYTE_ORDER == G_LITTLE_ENDIAN ? GST_VIDEO_FORMAT_GRAY16_LE : GST_VIDEO_FORMAT_GRAY16_BE;
+          header.accel_format = GST_AUDIO_FORMAT_UNKNOWN;
+          header.gyro_format = GST_AUDIO_FORMAT_UNKNOWN;
+          // rsdemux takes its pads' frame rates from these
+          header.color_fps = cframe.get_profile().fps();
+          header.depth_fps = depth.get_profile().fps();
+          buffer = RSMux::mux(frame_set, header, pad, buffer);
+        }
+        else
+        {
+          // single stream pipelines hand out plain frames, not framesets
+          auto frame = item.frame.as<rs2::video_frame>();
+          if (buffer == nullptr)
+            buffer = gst_buffer_new_and_alloc (pad->out_size);
+          GstMapInfo minfo;
+          gst_buffer_map (buffer, &minfo, GST_MAP_WRITE);
+          const auto size = RSMux::copy_plane(minfo.data, pad->gst_stride, frame);
+          gst_buffer_unmap (buffer, &minfo);
+          gst_buffer_set_size (buffer, size);
+        }
+        GST_BUFFER_PTS (buffer) = item.pts;
+        GST_BUFFER_DURATION (buffer) = pad->frame_duration;
+        GST_BUFFER_OFFSET (buffer) = item.frame.get_frame_number();
+
+        auto meta = gst_buffer_get_realsense_meta(buffer);
+        if (meta == nullptr)
+        {
+          meta = gst_buffer_add_realsense_meta_from(buffer, &pad->meta_values);
+          GST_META_FLAG_SET(meta, GST_META_FLAG_POOLED);
+        }
+        else
+        {
+          gst_realsense_meta_set_values(meta, &pad->meta_values);
+        }
+        if (item.frame.supports_frame_metadata(RS2_FRAME_METADATA_ACTUAL_EXPOSURE))
+          meta->exposure = static_cast<uint>(item.frame.get_frame_metadata(RS2_FRAME_METADATA_ACTUAL_EXPOSURE));
+      }
+      catch (rs2::error & e)
+      {
+        GST_WARNING_OBJECT (pad, "RealSense error calling %s (%s)",
+            e.get_failed_function().c_str(), e.get_failed_args().c_str());
+        if (buffer != nullptr)
+          gst_buffer_unref (buffer);
+        continue;
+      }
+
+      if (pad->buffers->push(rs_buffer_ptr(buffer), OverflowPolicy::DropOldest) != RSRing<rs_buffer_ptr>::PushResult::Pushed)
+        ++(src->dropped);
+    }
+
+    // a frame that arrived after the last pop but before this store would
+    // otherwise wait for the next one, so look again. The job still counts
+    // as running here, so pad_stop keeps frames alive until it is done.
+    pad->mux_scheduled = false;
+    if (pad->frames->size() == 0 || pad->mux_scheduled.exchange(true))
+      break;
+  }
+
+  g_mutex_lock (&pad->mux_lock);
+  if (--pad->mux_jobs == 0)
+    g_cond_broadcast (&pad->mux_done);
+  g_mutex_unlock (&pad->mux_lock);
+}
+
+/* SDK callback thread of one camera */
+static void
+gst_realsense_multisrc_on_frame (GstRealsenseMultiSrc * src, GstRealsenseMultiSrcPad * pad, rs2::frame frame)
+{
+  if (!src->playing)
+    return;
+
+  auto clock = gst_element_get_clock (GST_ELEMENT (src));
+  if (clock == nullptr)
+    return;
+  const auto now = gst_clock_get_time (clock);
+  const auto base_time = gst_element_get_base_time (GST_ELEMENT (src));
+  gst_object_unref (clock);
+
+  RSMultiSrcFrame item {frame, now > base_time ? now - base_time : 0};
+  if (pad->frames->push(std::move(item), OverflowPolicy::DropOldest) != RSRing<RSMultiSrcFrame>::PushResult::Pushed)
+    ++(src->dropped);
+
+  if (!pad->mux_scheduled.exchange(true))
+  {
+    g_mutex_lock (&pad->mux_lock);
+    ++pad->mux_jobs;
+    g_mutex_unlock (&pad->mux_lock);
+    RSWorkerPool::shared().submit([src, pad] { gst_realsense_multisrc_mux_job(src, pad); });
+  }
+}
+
+/* Stop the camera of pad and free what start created. The pad task must
+ * already be stopped. */
+static void
+gst_realsense_multisrc_pad_stop (GstRealsenseMultiSrc * src, GstRealsenseMultiSrcPad * pad)
+{
+  if (pad->rs_pipeline != nullptr)
+  {
+    try
+    {
+      pad->rs_pipeline->stop();
+    }
+    catch (rs2::error & e)
+    {
+      GST_WARNING_OBJECT (pad, "RealSense error calling %s (%s)",
+          e.get_failed_function().c_str(), e.get_failed_args().c_str());
+    }
+    pad->rs_pipeline = nullptr;
+  }
+
+  // no more callbacks, wait for the last mux job
+  g_mutex_lock (&pad->mux_lock);
+  while (pad->mux_jobs > 0)
+    g_cond_wait (&pad->mux_done, &pad->mux_lock);
+  g_mutex_unlock (&pad->mux_lock);
+
+  pad->frames = nullptr;
+  pad->buffers = nullptr;
+  if (pad->pool != nullptr)
+  {
+    gst_buffer_pool_set_active (pad->pool, FALSE);
+    gst_object_unref (pad->pool);
+    pad->pool = nullptr;
+  }
+  gst_caps_replace (&pad->caps, nullptr);
+}
+
+static void
+gst_realsense_multisrc_stop (GstRealsenseMultiSrc * src)
+{
+  GST_OBJECT_LOCK (src);
+  auto pads = g_list_copy_deep (GST_ELEMENT (src)->srcpads, (GCopyFunc) gst_object_ref, nullptr);
+  GST_OBJECT_UNLOCK (src);
+
+  for (auto l = pads; l != nullptr; l = l->next)
+  {
+    auto pad = GST_REALSENSEMULTISRC_PAD (l->data);
+    if (pad->buffers != nullptr)
+      pad->buffers->interrupt();
+    gst_pad_stop_task (GST_PAD (pad));
+    gst_realsense_multisrc_pad_stop (src, pad);
+  }
+  g_list_free_full (pads, gst_object_unref);
+}
+
+static gboolean
+gst_realsense_multisrc_start (GstRealsenseMultiSrc * src)
+{
+  GST_OBJECT_LOCK (src);
+  auto pads = g_list_copy_deep (GST_ELEMENT (src)->srcpads, (GCopyFunc) gst_object_ref, nullptr);
+  GST_OBJECT_UNLOCK (src);
+
+  if (pads == nullptr)
+  {
+    GST_ELEMENT_ERROR (src, RESOURCE, SETTINGS, ("No src pads requested."), (NULL));
+    return FALSE;
+  }
+
+  try
+  {
+    // one enumeration for every camera, shared with the other elements
+    auto& devices = RSDeviceCache::shared();
+    const auto dev_list = devices.devices();
+
+    auto serials = gst_realsense_multisrc_parse_serials (src->serials);
+    if (serials.empty())
+    {
+      for (auto&& dev : dev_list)
+        serials.emplace_back(dev.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER));
+    }
+
+    // start slaves first so none of them misses the master's first trigger
+    pads = g_list_reverse (pads);
+    bool found_all = true;
+    for (auto l = pads; l != nullptr; l = l->next)
+    {
+      auto pad = GST_REALSENSEMULTISRC_PAD (l->data);
+      if (pad->index >= serials.size())
+      {
+        GST_ELEMENT_ERROR (src, RESOURCE, NOT_FOUND,
+            ("No camera for pad %s, %lu cameras available.", GST_PAD_NAME (pad), serials.size()), (NULL));
+        found_all = false;
+        break;
+      }
+
+      const auto& serial = serials[pad->index];
+      rs2::device dev;
+      for (auto&& candidate : dev_list)
+      {
+        if (serial == candidate.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER))
+        {
+          dev = candidate;
+          break;
+        }
+      }
+      if (!dev)
+      {
+        GST_ELEMENT_ERROR (src, RESOURCE, NOT_FOUND,
+            ("Camera with serial number %s not found.", serial.c_str()), (NULL));
+        found_all = false;
+        break;
+      }
+
+      if (src->hw_sync)
+      {
+        auto sensor = dev.first<rs2::depth_sensor>();
+        if (sensor.supports(RS2_OPTION_INTER_CAM_SYNC_MODE))
+          sensor.set_option(RS2_OPTION_INTER_CAM_SYNC_MODE, pad->index == 0 ? SYNC_MODE_MASTER : SYNC_MODE_SLAVE);
+        else
+          GST_ELEMENT_WARNING (src, RESOURCE, SETTINGS,
+              ("Camera %s does not support hardware sync.", serial.c_str()), (NULL));
+      }
+
+      rs2::config cfg;
+      cfg.enable_device(serial);
+      pad->stream_type = src->stream_type;
+      if (pad->stream_type != StreamType::StreamDepth)
+        cfg.enable_stream(RS2_STREAM_COLOR, src->color_width, src->color_height,
+            RSMux::rs_format(src->color_format), src->color_fps);
+      if (pad->stream_type != StreamType::StreamColor)
+        cfg.enable_stream(RS2_STREAM_DEPTH, src->depth_width, src->depth_height, RS2_FORMAT_Z16, src->depth_fps);
+
+      pad->rs_pipeline = std::make_unique<rs2::pipeline>(devices.context());
+      if (!cfg.can_resolve(*pad->rs_pipeline))
+      {
+        GST_ELEMENT_ERROR (src, RESOURCE, SETTINGS,
+            ("No stream profile of camera %s matches color %dx%d@%d and depth %dx%d@%d (0 = any).",
+                serial.c_str(), src->color_width, src->color_height, src->color_fps,
+                src->depth_width, src->depth_height, src->depth_fps), (NULL));
+        pad->rs_pipeline = nullptr;
+        found_all = false;
+        break;
+      }
+
+      pad->frames = std::make_unique<RSRing<RSMultiSrcFrame>>(src->queue_depth);
+      pad->buffers = std::make_unique<RSRing<rs_buffer_ptr>>(src->queue_depth);
+      pad->mux_scheduled = false;
+      pad->need_events = TRUE;
+
+      const auto profile = pad->rs_pipeline->start(cfg, [src, pad](rs2::frame frame) {
+        gst_realsense_multisrc_on_frame(src, pad, frame);
+      });
+      gst_realsense_multisrc_pad_configure (pad, profile);
+      gst_realsense_multisrc_set_meta_values (pad, dev, profile);
+
+      GST_INFO_OBJECT (pad, "streaming camera %s, caps %" GST_PTR_FORMAT, serial.c_str(), pad->caps);
+    }
+
+    g_list_free_full (pads, gst_object_unref);
+    if (!found_all)
+      gst_realsense_multisrc_stop (src);
+    return found_all;
+  }
+  catch (rs2::error & e)
+  {
+    GST_ELEMENT_ERROR (src, RESOURCE, FAILED,
+        ("RealSense error calling %s (%s)", e.get_failed_function().c_str(), e.get_failed_args().c_str()),
+        (NULL));
+  }
+
+  g_list_free_full (pads, gst_object_unref);
+  gst_realsense_multisrc_stop (src);
+  return FALSE;
+}
+
+static void
+gst_realsense_multisrc_start_tasks (GstRealsenseMultiSrc * src)
+{
+  GST_OBJECT_LOCK (src);
+  auto pads = g_list_copy_deep (GST_ELEMENT (src)->srcpads, (GCopyFunc) gst_object_ref, nullptr);
+  GST_OBJECT_UNLOCK (src);
+
+  for (auto l = pads; l != nullptr; l = l->next)
+  {
+    auto pad = GST_PAD (l->data);
+    gst_pad_start_task (pad, (GstTaskFunction) gst_realsense_multisrc_loop, pad, nullptr);
+  }
+  g_list_free_full (pads, gst_object_unref);
+}
+
+/* Pad task. Pushes the buffers the mux jobs made for this camera. */
+static void
+gst_realsense_multisrc_loop (GstRealsenseMultiSrcPad * pad)
+{
+  auto src = GST_REALSENSEMULTISRC (gst_pad_get_parent_element (GST_PAD (pad)));
+  if (src == nullptr)
+  {
+    gst_pad_pause_task (GST_PAD (pad));
+    return;
+  }
+
+  if (pad->need_events)
+  {
+    auto stream_id = gst_pad_create_stream_id_printf (GST_PAD (pad), GST_ELEMENT (src), "%u", pad->index);
+    gst_pad_push_event (GST_PAD (pad), gst_event_new_stream_start (stream_id));
+    g_free (stream_id);
+    gst_pad_push_event (GST_PAD (pad), gst_event_new_caps (pad->caps));
+
+    GstSegment segment;
+    gst_segment_init (&segment, GST_FORMAT_TIME);
+    gst_pad_push_event (GST_PAD (pad), gst_event_new_segment (&segment));
+    pad->need_events = FALSE;
+  }
+
+  rs_buffer_ptr buffer;
+  if (!pad->buffers->try_pop(buffer))
+  {
+    pad->buffers->wait_for_item(std::chrono::milliseconds(100));
+    gst_object_unref (src);
+    return;
+  }
+
+  const auto ret = gst_pad_push (GST_PAD (pad), buffer.release());
+  if (ret != GST_FLOW_OK)
+  {
+    GST_DEBUG_OBJECT (pad, "pausing task, reason %s", gst_flow_get_name (ret));
+    gst_pad_pause_task (GST_PAD (pad));
+    if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS)
+      GST_ELEMENT_FLOW_ERROR (src, ret);
+  }
+  gst_object_unref (src);
+}
+
+static gboolean
+gst_realsense_multisrc_src_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  auto mpad = GST_REALSENSEMULTISRC_PAD (pad);
+  auto src = GST_REALSENSEMULTISRC (parent);
+
+  switch (GST_QUERY_TYPE (query))
+  {
+    case GST_QUERY_LATENCY:
+    {
+      if (!GST_CLOCK_TIME_IS_VALID (mpad->frame_duration))
+        return FALSE;
+      // a frame is complete one frame duration after its exposure starts
+      // and may wait in both queues
+      gst_query_set_latency (query, TRUE, mpad->frame_duration,
+          mpad->frame_duration * (1 + 2 * src->queue_depth));
+      return TRUE;
+    }
+    default:
+      return gst_pad_query_default (pad, parent, query);
+  }
+}
+
+static GstStateChangeReturn
+gst_realsense_multisrc_change_state (GstElement * element, GstStateChange transition)
+{
+  auto src = GST_REALSENSEMULTISRC (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      src->dropped = 0;
+      if (!gst_realsense_multisrc_start (src))
+        return GST_STATE_CHANGE_FAILURE;
+      break;
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      src->playing = false;
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_realsense_multisrc_stop (src);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+  {
+    if (transition == GST_STATE_CHANGE_READY_TO_PAUSED)
+      gst_realsense_multisrc_stop (src);
+    return ret;
+  }
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_realsense_multisrc_start_tasks (src);
+      // live, nothing to preroll
+      ret = GST_STATE_CHANGE_NO_PREROLL;
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+      src->playing = true;
+      break;
+    case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+      ret = GST_STATE_CHANGE_NO_PREROLL;
+      break;
+    default:
+      break;
+  }
+  return ret;
+}
@@ -0,0 +1,147 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_REALSENSEMULTISRC_H__
+#define __GST_REALSENSEMULTISRC_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include <librealsense2/rs.hpp>
+
+#include "common.hpp"
+#include "gstrealsensemeta.h"
+#include "rsdevices.hpp"
+#include "rsring.hpp"
+
+#include <atomic>
+#include <memory>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_REALSENSEMULTISRC \
+  (gst_realsense_multisrc_get_type())
+#define GST_REALSENSEMULTISRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_REALSENSEMULTISRC,GstRealsenseMultiSrc))
+#define GST_REALSENSEMULTISRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_REALSENSEMULTISRC,GstRealsenseMultiSrcClass))
+#define GST_IS_REALSENSEMULTISRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_REALSENSEMULTISRC))
+#define GST_IS_REALSENSEMULTISRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_REALSENSEMULTISRC))
+
+#define GST_TYPE_REALSENSEMULTISRC_PAD \
+  (gst_realsense_multisrc_pad_get_type())
+#define GST_REALSENSEMULTISRC_PAD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_REALSENSEMULTISRC_PAD,GstRealsenseMultiSrcPad))
+
+typedef struct _GstRealsenseMultiSrc         GstRealsenseMultiSrc;
+typedef struct _GstRealsenseMultiSrcClass    GstRealsenseMultiSrcClass;
+typedef struct _GstRealsenseMultiSrcPad      GstRealsenseMultiSrcPad;
+typedef struct _GstRealsenseMultiSrcPadClass GstRealsenseMultiSrcPadClass;
+
+struct GstBufferUnref
+{
+  void operator()(GstBuffer *buffer) const { gst_buffer_unref (buffer); }
+};
+
+// A frame from the SDK callback and the running time it arrived at
+struct RSMultiSrcFrame
+{
+  rs2::frame frame;
+  GstClockTime pts = GST_CLOCK_TIME_NONE;
+};
+
+using rs_multi_pipe_ptr = std::unique_ptr<rs2::pipeline>;
+using rs_buffer_ptr = std::unique_ptr<GstBuffer, GstBufferUnref>;
+using rs_frame_ring_ptr = std::unique_ptr<RSRing<RSMultiSrcFrame>>;
+using rs_buffer_ring_ptr = std::unique_ptr<RSRing<rs_buffer_ptr>>;
+constexpr const guint DEFAULT_PROP_MULTI_QUEUE_DEPTH = 4;
+
+/* One camera. src_N streams the Nth camera of the serials property. Frames
+ * arrive on the SDK callback thread, are muxed by a job on the shared
+ * RSWorkerPool and pushed downstream by the pad's task. */
+struct _GstRealsenseMultiSrcPad
+{
+  GstPad pad;
+
+  guint index;
+
+  // read by RSMux, set in start
+  StreamType stream_type;
+  GstVideoFormat color_format; // of the color plane, as resolved by the SDK
+  gint gst_stride;
+  bool imu_active; // always false, the callback gets motion frames on their own
+  gsize out_size;
+  GstCaps *caps;
+  GstClockTime frame_duration;
+  GstRealsenseMeta meta_values;
+  GstBufferPool *pool;
+  gboolean need_events; // stream-start, caps and segment go out before the first buffer
+
+  rs_multi_pipe_ptr rs_pipeline;
+  rs_frame_ring_ptr frames;    // SDK callback to mux job
+  rs_buffer_ring_ptr buffers;  // mux job to pad task
+  std::atomic<bool> mux_scheduled;
+  // mux jobs submitted and not finished, pad_stop waits for 0
+  GMutex mux_lock;
+  GCond mux_done;
+  guint mux_jobs;
+};
+
+struct _GstRealsenseMultiSrcPadClass
+{
+  GstPadClass parent_class;
+};
+
+struct _GstRealsenseMultiSrc
+{
+  GstElement element;
+
+  std::atomic<bool> playing; // frames are only taken in PLAYING
+  std::atomic<guint64> dropped;
+  guint next_pad;
+
+  // Properties
+  gchar *serials;
+  StreamType stream_type;
+  bool hw_sync;
+  guint queue_depth;
+  // requested stream profiles of every camera, 0 leaves the choice to the SDK
+  int color_width;
+  int color_height;
+  int color_fps;
+  int depth_width;
+  int depth_height;
+  int depth_fps;
+  ColorFormat color_format;
+};
+
+struct _GstRealsenseMultiSrcClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_realsense_multisrc_get_type (void);
+GType gst_realsense_multisrc_pad_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_REALSENSEMULTISRC_H__ */
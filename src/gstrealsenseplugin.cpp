@@ -48,6 +48,12 @@
 
 #include "gstrealsensesrc.h"
 #include "gstrealsensedemux.h"
+#include "gstrealsensealign.h"
+#include "gstrealsensepointcloud.h"
+#include "gstrealsensedepthfilter.h"
+#include "gstrealsensedepthenc.h"
+#include "gstrealsensedepthdec.h"
+#include "gstrealsensemultisrc.h"
 
 #ifndef PACKAGE
 #define PACKAGE "realsensesrc"
@@ -63,9 +69,27 @@ realsensesrc_init (GstPlugin * realsensesrc)
   if (!gst_element_register (realsensesrc, "rsdemux", GST_RANK_MARGINAL, GST_TYPE_RSDEMUX))
     return FALSE;
 
+  if (!gst_element_register (realsensesrc, "rsalign", GST_RANK_MARGINAL, GST_TYPE_RSALIGN))
+    return FALSE;
+
+  if (!gst_element_register (realsensesrc, "rspointcloud", GST_RANK_MARGINAL, GST_TYPE_RSPOINTCLOUD))
+    return FALSE;
+
+  if (!gst_element_register (realsensesrc, "rsdepthfilter", GST_RANK_MARGINAL, GST_TYPE_RSDEPTHFILTER))
+    return FALSE;
+
+  if (!gst_element_register (realsensesrc, "rsdepthenc", GST_RANK_MARGINAL, GST_TYPE_RSDEPTHENC))
+    return FALSE;
+
+  if (!gst_element_register (realsensesrc, "rsdepthdec", GST_RANK_MARGINAL, GST_TYPE_RSDEPTHDEC))
+    return FALSE;
+
   if(!gst_element_register (realsensesrc, "realsensesrc", GST_RANK_PRIMARY, GST_TYPE_REALSENSESRC))
     return FALSE;
 
+  if (!gst_element_register (realsensesrc, "realsensemultisrc", GST_RANK_MARGINAL, GST_TYPE_REALSENSEMULTISRC))
+    return FALSE;
+
   return TRUE;
 }
 
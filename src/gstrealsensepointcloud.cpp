@@ -0,0 +1,460 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* GStreamer realsense point cloud
+ *
+ * SECTION:element-rspointcloud
+ * @title: rspointcloud
+ *
+ * Turns depth frames into XYZ point clouds using the depth units and
+ * intrinsics carried in the Realsense metadata.
+ * rspointcloud accepts the depth pad of rsdemux or a muxed realsensesrc
+ * stream. Each output buffer holds float32 points (x, y, z in meters, plus
+ * u, v texture coordinates into the color frame if texture=true).
+ *
+ * ## Example launch line
+ * |[
+ *  gst-launch-1.0 realsensesrc stream-type=2 ! rsdemux name=demux \
+ *  demux.depth ! queue ! rspointcloud compact=true ! fakesink \
+ *  demux.color ! queue ! videoconvert ! autovideosink
+ * ]|
+ *
+ * This pipeline computes a compact point cloud from the depth stream while
+ * rendering color.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/video/video.h>
+
+#include "gstrealsensepointcloud.h"
+#include "gstrealsensemeta.h"
+
+#include "rsmux.hpp"
+#include <stdexcept>
+
+GST_DEBUG_CATEGORY_STATIC (rspointcloud_debug);
+#define GST_CAT_DEFAULT rspointcloud_debug
+
+enum
+{
+  PROP_0,
+  PROP_TEXTURE,
+  PROP_COMPACT,
+  PROP_N_THREADS,
+};
+
+#define RS_POINTCLOUD_CAPS "application/x-rs-pointcloud, " \
+  "format = (string) { XYZ, XYZUV }, "                     \
+  "layout = (string) { organized, compact }, "             \
+  "width = " GST_VIDEO_SIZE_RANGE ", "                     \
+  "height = " GST_VIDEO_SIZE_RANGE ", "                    \
+  "framerate = " GST_VIDEO_FPS_RANGE
+
+static GstStaticPadTemplate sink_tmpl = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE
+        ("{ RGB, RGBA, BGR, BGRA, GRAY16_LE, GRAY16_BE, YUY2, UYVY }")
+        "; " RS_MUX_CAPS)
+    );
+
+static GstStaticPadTemplate src_tmpl = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (RS_POINTCLOUD_CAPS)
+    );
+
+#define gst_rspointcloud_parent_class parent_class
+G_DEFINE_TYPE_WITH_CODE (GstRSPointCloud, gst_rspointcloud, GST_TYPE_ELEMENT,
+  GST_DEBUG_CATEGORY_INIT(rspointcloud_debug, "rspointcloud", 0,
+  "Point cloud element for Realsense plugin"));
+
+static void gst_rspointcloud_finalize (GObject * object);
+static void gst_rspointcloud_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_rspointcloud_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
+
+static gboolean gst_rspointcloud_sink_query (GstPad * pad, GstObject * parent, GstQuery * query);
+static gboolean gst_rspointcloud_handle_sink_event (GstPad * pad, GstObject * parent, GstEvent * event);
+static GstFlowReturn gst_rspointcloud_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer);
+static GstStateChangeReturn gst_rspointcloud_change_state (GstElement * element, GstStateChange transition);
+
+static void
+gst_rspointcloud_class_init (GstRSPointCloudClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstElementClass *gstelement_class;
+
+  gobject_class = (GObjectClass *) klass;
+  gstelement_class = (GstElementClass *) klass;
+
+  gobject_class->finalize = gst_rspointcloud_finalize;
+  gobject_class->set_property = gst_rspointcloud_set_property;
+  gobject_class->get_property = gst_rspointcloud_get_property;
+
+  gstelement_class->change_state = GST_DEBUG_FUNCPTR (gst_rspointcloud_change_state);
+
+  gst_element_class_add_static_pad_template (gstelement_class, &sink_tmpl);
+  gst_element_class_add_static_pad_template (gstelement_class, &src_tmpl);
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "RealSense Point Cloud", "Filter/Converter/Video",
+      "Compute XYZ point clouds from RealSense depth frames",
+      "Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>");
+
+  g_object_class_install_property (gobject_class, PROP_TEXTURE,
+    g_param_spec_boolean ("texture", "Texture coordinates",
+        "Add u, v texture coordinates into the color frame to every point",
+        DEFAULT_PROP_RSPOINTCLOUD_TEXTURE,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_COMPACT,
+    g_param_spec_boolean ("compact", "Compact",
+        "Only output points with depth instead of one point per depth pixel",
+        DEFAULT_PROP_RSPOINTCLOUD_COMPACT,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_N_THREADS,
+    g_param_spec_uint ("n-threads", "Threads",
+        "Maximum number of threads used for deprojection (0 = one per core)",
+        0, G_MAXUINT, DEFAULT_PROP_RSPOINTCLOUD_N_THREADS,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+}
+
+static void
+gst_rspointcloud_init (GstRSPointCloud * rspointcloud)
+{
+  rspointcloud->sinkpad = gst_pad_new_from_static_template (&sink_tmpl, "sink");
+  gst_pad_set_chain_function (rspointcloud->sinkpad, GST_DEBUG_FUNCPTR (gst_rspointcloud_chain));
+  gst_pad_set_event_function (rspointcloud->sinkpad, GST_DEBUG_FUNCPTR (gst_rspointcloud_handle_sink_event));
+  gst_pad_set_query_function (rspointcloud->sinkpad, GST_DEBUG_FUNCPTR (gst_rspointcloud_sink_query));
+  gst_element_add_pad (GST_ELEMENT (rspointcloud), rspointcloud->sinkpad);
+
+  rspointcloud->srcpad = gst_pad_new_from_static_template (&src_tmpl, "src");
+  gst_pad_use_fixed_caps (rspointcloud->srcpad);
+  gst_element_add_pad (GST_ELEMENT (rspointcloud), rspointcloud->srcpad);
+
+  rspointcloud->texture = DEFAULT_PROP_RSPOINTCLOUD_TEXTURE;
+  rspointcloud->compact = DEFAULT_PROP_RSPOINTCLOUD_COMPACT;
+  rspointcloud->n_threads = DEFAULT_PROP_RSPOINTCLOUD_N_THREADS;
+  gst_video_info_init (&rspointcloud->in_info);
+  rspointcloud->pointcloud = new RSPointCloud();
+}
+
+static void
+gst_rspointcloud_finalize (GObject * object)
+{
+  auto rspointcloud = GST_RSPOINTCLOUD (object);
+  delete rspointcloud->pointcloud;
+  rspointcloud->pointcloud = nullptr;
+  gst_event_replace (&rspointcloud->pending_segment, nullptr);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_rspointcloud_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  auto rspointcloud = GST_RSPOINTCLOUD (object);
+
+  GST_OBJECT_LOCK (rspointcloud);
+  switch (prop_id) {
+    case PROP_TEXTURE:
+      rspointcloud->texture = g_value_get_boolean (value);
+      break;
+    case PROP_COMPACT:
+      rspointcloud->compact = g_value_get_boolean (value);
+      break;
+    case PROP_N_THREADS:
+      rspointcloud->n_threads = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+  GST_OBJECT_UNLOCK (rspointcloud);
+}
+
+static void
+gst_rspointcloud_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  auto rspointcloud = GST_RSPOINTCLOUD (object);
+
+  switch (prop_id) {
+    case PROP_TEXTURE:
+      g_value_set_boolean (value, rspointcloud->texture);
+      break;
+    case PROP_COMPACT:
+      g_value_set_boolean (value, rspointcloud->compact);
+      break;
+    case PROP_N_THREADS:
+      g_value_set_uint (value, rspointcloud->n_threads);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_rspointcloud_clear_pool (GstRSPointCloud * rspointcloud)
+{
+  if (rspointcloud->pool) {
+    gst_buffer_pool_set_active (rspointcloud->pool, FALSE);
+    gst_object_unref (rspointcloud->pool);
+    rspointcloud->pool = nullptr;
+  }
+}
+
+/* reset to default values before starting streaming */
+static void
+gst_rspointcloud_reset (GstRSPointCloud * rspointcloud)
+{
+  rspointcloud->out_width = 0;
+  rspointcloud->out_height = 0;
+  rspointcloud->have_caps = FALSE;
+  gst_event_replace (&rspointcloud->pending_segment, nullptr);
+  gst_rspointcloud_clear_pool (rspointcloud);
+}
+
+static gboolean
+gst_rspointcloud_sink_query (GstPad * pad, GstObject * parent, GstQuery * query)
+{
+  gboolean res = TRUE;
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_ALLOCATION:
+      // downstream gets point clouds, not video; upstream uses its own pool
+      res = FALSE;
+      break;
+    default:
+      res = gst_pad_query_default (pad, parent, query);
+      break;
+  }
+
+  return res;
+}
+
+static gboolean
+gst_rspointcloud_handle_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  auto rspointcloud = GST_RSPOINTCLOUD (parent);
+  gboolean res = TRUE;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:
+    {
+      GstCaps *caps;
+      gst_event_parse_caps (event, &caps);
+      // muxed streams from older sources came as video/x-raw of the color format
+      rspointcloud->muxed = RSMux::is_mux_caps (caps);
+      res = rspointcloud->muxed || gst_video_info_from_caps (&rspointcloud->in_info, caps);
+      if (res && !rspointcloud->muxed)
+        rspointcloud->muxed = GST_VIDEO_INFO_FORMAT (&rspointcloud->in_info) != GST_VIDEO_FORMAT_GRAY16_LE;
+      // output caps are set in the chain function once the depth size is known
+      rspointcloud->have_caps = FALSE;
+      gst_event_unref (event);
+      if (res && rspointcloud->muxed) {
+        // keep depth coming should an rsdemux share the source through a tee
+        auto sender = gst_object_get_path_string (parent);
+        gst_pad_push_event (rspointcloud->sinkpad, RSMux::streams_event (sender, StreamBitDepth));
+        g_free (sender);
+      }
+      break;
+    }
+    case GST_EVENT_SEGMENT:
+      if (!rspointcloud->have_caps) {
+        // segment must not overtake caps downstream
+        gst_event_replace (&rspointcloud->pending_segment, event);
+        gst_event_unref (event);
+        break;
+      }
+      res = gst_pad_push_event (rspointcloud->srcpad, event);
+      break;
+    default:
+      res = gst_pad_event_default (pad, parent, event);
+      break;
+  }
+
+  return res;
+}
+
+static gboolean
+gst_rspointcloud_set_src_caps (GstRSPointCloud * rspointcloud, gint width, gint height, gboolean texture, gboolean compact)
+{
+  auto caps = gst_caps_new_simple ("application/x-rs-pointcloud",
+      "format", G_TYPE_STRING, texture ? "XYZUV" : "XYZ",
+      "layout", G_TYPE_STRING, compact ? "compact" : "organized",
+      "width", G_TYPE_INT, width,
+      "height", G_TYPE_INT, height,
+      "framerate", GST_TYPE_FRACTION,
+        GST_VIDEO_INFO_FPS_N (&rspointcloud->in_info), GST_VIDEO_INFO_FPS_D (&rspointcloud->in_info),
+      NULL);
+
+  GST_DEBUG_OBJECT (rspointcloud, "output caps %" GST_PTR_FORMAT, caps);
+  auto res = gst_pad_set_caps (rspointcloud->srcpad, caps);
+
+  // one pool sized for an organized cloud; compact clouds shrink the buffer
+  gst_rspointcloud_clear_pool (rspointcloud);
+  if (res) {
+    const guint size = static_cast<guint>(width) * height * (texture ? 5 : 3) * sizeof (float);
+    rspointcloud->pool = gst_buffer_pool_new ();
+    auto config = gst_buffer_pool_get_config (rspointcloud->pool);
+    gst_buffer_pool_config_set_params (config, caps, size, 2, 0);
+    res = gst_buffer_pool_set_config (rspointcloud->pool, config) &&
+        gst_buffer_pool_set_active (rspointcloud->pool, TRUE);
+  }
+  gst_caps_unref (caps);
+
+  if (res && rspointcloud->pending_segment) {
+    gst_pad_push_event (rspointcloud->srcpad, rspointcloud->pending_segment);
+    rspointcloud->pending_segment = nullptr;
+  }
+  return res;
+}
+
+static GstFlowReturn
+gst_rspointcloud_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  auto rspointcloud = GST_RSPOINTCLOUD (parent);
+
+  GST_OBJECT_LOCK (rspointcloud);
+  auto texture = rspointcloud->texture;
+  const auto compact = rspointcloud->compact;
+  const auto threads = rspointcloud->n_threads;
+  GST_OBJECT_UNLOCK (rspointcloud);
+
+  GstMapInfo map;
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ)) {
+    gst_buffer_unref (buffer);
+    return GST_FLOW_ERROR;
+  }
+
+  auto fail = [&](GstFlowReturn ret) {
+    gst_buffer_unmap (buffer, &map);
+    gst_buffer_unref (buffer);
+    return ret;
+  };
+
+  // locate the depth plane
+  const guint8 *depth = map.data;
+  gint width = GST_VIDEO_INFO_WIDTH (&rspointcloud->in_info);
+  gint height = GST_VIDEO_INFO_HEIGHT (&rspointcloud->in_info);
+  gint stride = GST_VIDEO_INFO_PLANE_STRIDE (&rspointcloud->in_info, 0);
+  if (rspointcloud->muxed) {
+    RSMuxPrefix prefix;
+    const auto header = RSMux::GetRSHeader (rspointcloud, buffer, &prefix);
+    // an rsdemux sharing the source through a tee may have had depth left out
+    if (header.skipped & StreamBitDepth) {
+      GST_LOG_OBJECT (rspointcloud, "no depth in this buffer, dropping it");
+      return fail (GST_FLOW_OK);
+    }
+    depth += prefix.planes[RSMuxDepth].offset;
+    width = header.depth_width;
+    height = header.depth_height;
+    stride = header.depth_stride;
+  }
+
+  const auto meta = gst_buffer_get_realsense_meta (buffer);
+  if (meta == nullptr || meta->depth_intrinsics.width != width || meta->depth_intrinsics.height != height ||
+      depth + static_cast<gsize>(height) * stride > map.data + map.size) {
+    GST_ELEMENT_ERROR (rspointcloud, STREAM, FORMAT,
+        ("rspointcloud needs depth frames with calibration metadata from realsensesrc."), (NULL));
+    return fail (GST_FLOW_ERROR);
+  }
+  texture = texture && meta->color_intrinsics.width > 0;
+
+  try
+  {
+    if (!rspointcloud->have_caps || width != rspointcloud->out_width || height != rspointcloud->out_height ||
+        texture != rspointcloud->out_texture || compact != rspointcloud->out_compact) {
+      if (!gst_rspointcloud_set_src_caps (rspointcloud, width, height, texture, compact))
+        return fail (GST_FLOW_NOT_NEGOTIATED);
+      rspointcloud->out_width = width;
+      rspointcloud->out_height = height;
+      rspointcloud->out_texture = texture;
+      rspointcloud->out_compact = compact;
+      rspointcloud->have_caps = TRUE;
+    }
+
+    auto pc = rspointcloud->pointcloud;
+    if (pc->configure (meta->depth_intrinsics,
+        texture ? &meta->color_intrinsics : nullptr, texture ? &meta->depth_to_color : nullptr,
+        meta->depth_units)) {
+      GST_INFO_OBJECT (rspointcloud, "Built ray tables for %dx%d depth (%s)", width, height, RSGeometry::isa_name ());
+    }
+
+    auto& pool = RSWorkerPool::shared ();
+    const auto depth16 = reinterpret_cast<const uint16_t*>(depth);
+    const auto n_points = pc->prepare (depth16, stride, compact, pool, threads);
+
+    GstBuffer *outbuf = nullptr;
+    if (gst_buffer_pool_acquire_buffer (rspointcloud->pool, &outbuf, nullptr) != GST_FLOW_OK)
+      return fail (GST_FLOW_FLUSHING);
+    gst_buffer_set_size (outbuf, n_points * pc->point_size ());
+
+    GstMapInfo omap;
+    gst_buffer_map (outbuf, &omap, GST_MAP_WRITE);
+    pc->compute (depth16, stride, reinterpret_cast<float*>(omap.data), pool, threads);
+    gst_buffer_unmap (outbuf, &omap);
+
+    gst_buffer_unmap (buffer, &map);
+    gst_buffer_copy_into (outbuf, buffer,
+        static_cast<GstBufferCopyFlags>(GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS | GST_BUFFER_COPY_META),
+        0, -1);
+    gst_buffer_unref (buffer);
+
+    return gst_pad_push (rspointcloud->srcpad, outbuf);
+  }
+  catch (const std::exception& e)
+  {
+    GST_ELEMENT_ERROR (rspointcloud, RESOURCE, FAILED, ("gst_rspointcloud_chain: %s", e.what ()), (NULL));
+    return fail (GST_FLOW_ERROR);
+  }
+}
+
+static GstStateChangeReturn
+gst_rspointcloud_change_state (GstElement * element, GstStateChange transition)
+{
+  auto rspointcloud = GST_RSPOINTCLOUD (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_rspointcloud_reset (rspointcloud);
+      break;
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_rspointcloud_reset (rspointcloud);
+      break;
+    default:
+      break;
+  }
+  return ret;
+}
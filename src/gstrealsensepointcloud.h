@@ -0,0 +1,83 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSPOINTCLOUD_ELEMENT_H__
+#define __GST_RSPOINTCLOUD_ELEMENT_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include "common.hpp"
+#include "rspointcloud.hpp"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_RSPOINTCLOUD \
+  (gst_rspointcloud_get_type())
+#define GST_RSPOINTCLOUD(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_RSPOINTCLOUD,GstRSPointCloud))
+#define GST_RSPOINTCLOUD_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_RSPOINTCLOUD,GstRSPointCloudClass))
+#define GST_IS_RSPOINTCLOUD(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_RSPOINTCLOUD))
+#define GST_IS_RSPOINTCLOUD_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_RSPOINTCLOUD))
+
+#define DEFAULT_PROP_RSPOINTCLOUD_TEXTURE FALSE
+#define DEFAULT_PROP_RSPOINTCLOUD_COMPACT FALSE
+#define DEFAULT_PROP_RSPOINTCLOUD_N_THREADS 0
+
+typedef struct _GstRSPointCloud GstRSPointCloud;
+typedef struct _GstRSPointCloudClass GstRSPointCloudClass;
+
+struct _GstRSPointCloud {
+  GstElement     element;
+
+  GstPad        *sinkpad;
+  GstPad        *srcpad;
+
+  /* properties */
+  gboolean       texture;
+  gboolean       compact;
+  guint          n_threads;
+
+  /* stream state */
+  GstVideoInfo   in_info;     // from the sink caps
+  gboolean       muxed;       // input is a muxed realsensesrc stream, not a depth plane
+  gint           out_width;   // depth size of the caps that were last set
+  gint           out_height;
+  gboolean       out_texture;
+  gboolean       out_compact;
+  gboolean       have_caps;
+  GstEvent      *pending_segment; // held until output caps are set
+  GstBufferPool *pool;
+
+  RSPointCloud  *pointcloud;
+};
+
+struct _GstRSPointCloudClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_rspointcloud_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_RSPOINTCLOUD_ELEMENT_H__ */
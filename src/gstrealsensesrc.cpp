@@ -51,7 +51,10 @@
 
 #include "gstrealsensemeta.h"
 #include "rsmux.hpp"
+#include "rsgeometry.hpp"
+#include <algorithm>
 #include <cmath>
+#include <functional>
 
 GST_DEBUG_CATEGORY_STATIC (gst_realsense_src_debug);
 #define GST_CAT_DEFAULT gst_realsense_src_debug
@@ -62,7 +65,36 @@ enum
   PROP_CAM_SN,
   PROP_ALIGN,
   PROP_DEPTH_ON,
-  PROP_IMU_ON
+  PROP_IMU_ON,
+  PROP_POOL_HITS,
+  PROP_POOL_MISSES,
+  PROP_ZERO_COPY,
+  PROP_QUEUE_DEPTH,
+  PROP_OVERFLOW_POLICY,
+  PROP_DROPPED_OLDEST,
+  PROP_DROPPED_NEWEST,
+  PROP_SYNTHETIC,
+  PROP_SYNTHETIC_WIDTH,
+  PROP_SYNTHETIC_HEIGHT,
+  PROP_SYNTHETIC_FPS,
+  PROP_SYNTHETIC_PATTERN,
+  PROP_FILE,
+  PROP_REAL_TIME,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_COLOR_WIDTH,
+  PROP_COLOR_HEIGHT,
+  PROP_COLOR_FPS,
+  PROP_DEPTH_WIDTH,
+  PROP_DEPTH_HEIGHT,
+  PROP_DEPTH_FPS,
+  PROP_COLOR_FORMAT,
+  PROP_HUGE_PAGES,
+  PROP_MLOCK,
+  PROP_ALLOC_LIVE,
+  PROP_ALLOC_PEAK,
+  PROP_SLAB_REFILLS,
+  PROP_SKIP_UNUSED
 };
 
 /* the capabilities of the inputs and outputs.
@@ -80,7 +112,8 @@ static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
     GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE
-        ("{ RGB, RGBA, BGR, BGRA, GRAY16_LE, GRAY16_BE, YVYU }"))
+        ("{ RGB, RGBA, BGR, BGRA, GRAY16_LE, GRAY16_BE, YUY2, UYVY }")
+        "; " RS_MUX_CAPS)
     );
 
 #define gst_realsense_src_parent_class parent_class
@@ -93,6 +126,7 @@ static void gst_realsense_src_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_realsense_src_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
+static void gst_realsense_src_finalize (GObject * object);
 
 static GstFlowReturn gst_realsense_src_create (GstPushSrc * src, GstBuffer ** buf);
 
@@ -102,6 +136,9 @@ static GstCaps *gst_realsense_src_get_caps (GstBaseSrc * src, GstCaps * filter);
 static gboolean gst_realsense_src_set_caps (GstBaseSrc * src, GstCaps * caps);
 static gboolean gst_realsense_src_unlock (GstBaseSrc * basesrc);
 static gboolean gst_realsense_src_unlock_stop (GstBaseSrc * basesrc);
+static gboolean gst_realsense_src_decide_allocation (GstBaseSrc * bsrc, GstQuery * query);
+static gboolean gst_realsense_src_query (GstBaseSrc * bsrc, GstQuery * query);
+static gboolean gst_realsense_src_event (GstBaseSrc * bsrc, GstEvent * event);
 
 /* initialize the realsensesrc's class */
 static void
@@ -119,6 +156,7 @@ gst_realsense_src_class_init (GstRealsenseSrcClass * klass)
 
   gobject_class->set_property = gst_realsense_src_set_property;
   gobject_class->get_property = gst_realsense_src_get_property;
+  gobject_class->finalize = gst_realsense_src_finalize;
 
   gst_element_class_set_details_simple(gstelement_class,
     "RealsenseSrc",
@@ -135,11 +173,12 @@ gst_realsense_src_class_init (GstRealsenseSrcClass * klass)
   // gstbasesrc_class->fixate = gst_video_test_src_src_fixate;
   // gstbasesrc_class->is_seekable = gst_video_test_src_is_seekable;
   // gstbasesrc_class->do_seek = gst_video_test_src_do_seek;
-  // gstbasesrc_class->query = gst_video_test_src_query;
+  gstbasesrc_class->query = GST_DEBUG_FUNCPTR (gst_realsense_src_query);
+  gstbasesrc_class->event = GST_DEBUG_FUNCPTR (gst_realsense_src_event);
   // gstbasesrc_class->get_times = gst_video_test_src_get_times;
   gstbasesrc_class->start = gst_realsense_src_start;
   gstbasesrc_class->stop = gst_realsense_src_stop;
-  // gstbasesrc_class->decide_allocation = gst_video_test_src_decide_allocation;
+  gstbasesrc_class->decide_allocation = GST_DEBUG_FUNCPTR (gst_realsense_src_decide_allocation);
   gstbasesrc_class->unlock = GST_DEBUG_FUNCPTR (gst_realsense_src_unlock);
   gstbasesrc_class->unlock_stop = GST_DEBUG_FUNCPTR (gst_realsense_src_unlock_stop);
 
@@ -171,6 +210,181 @@ gst_realsense_src_class_init (GstRealsenseSrcClass * klass)
           (GParamFlags) (G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS)
         )
     );
+
+  g_object_class_install_property (gobject_class, PROP_ZERO_COPY,
+    g_param_spec_boolean ("zero-copy", "Zero copy",
+        "Wrap RealSense frame data in the output buffer instead of copying it. "
+        "Falls back to copying if the frame strides do not match the caps.", false,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_QUEUE_DEPTH,
+    g_param_spec_uint ("queue-depth", "Queue depth",
+        "Number of framesets the capture thread may queue ahead of the streaming thread",
+        1, 64, DEFAULT_PROP_QUEUE_DEPTH,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_OVERFLOW_POLICY,
+    g_param_spec_int ("overflow-policy", "Overflow policy",
+        "What to do when the frame queue is full: 0 = drop oldest frameset, 1 = drop newest frameset, "
+        "2 = block the capture thread until there is room (only useful for file playback)",
+        OverflowPolicy::DropOldest, OverflowPolicy::Block, OverflowPolicy::DropOldest,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DROPPED_OLDEST,
+    g_param_spec_uint64 ("dropped-oldest", "Dropped oldest",
+          "Number of queued framesets discarded to make room for newer ones",
+          0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DROPPED_NEWEST,
+    g_param_spec_uint64 ("dropped-newest", "Dropped newest",
+          "Number of captured framesets discarded because the queue was full",
+          0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  const RSSyntheticSettings synthetic_defaults;
+  g_object_class_install_property (gobject_class, PROP_COLOR_WIDTH,
+    g_param_spec_int ("color-width", "Color width",
+        "Width of the color stream (0 = device default)",
+        0, 16384, 0,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_COLOR_HEIGHT,
+    g_param_spec_int ("color-height", "Color height",
+        "Height of the color stream (0 = device default)",
+        0, 16384, 0,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_COLOR_FPS,
+    g_param_spec_int ("color-fps", "Color frame rate",
+        "Frame rate of the color stream (0 = device default)",
+        0, 1000, 0,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DEPTH_WIDTH,
+    g_param_spec_int ("depth-width", "Depth width",
+        "Width of the depth stream (0 = device default)",
+        0, 16384, 0,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DEPTH_HEIGHT,
+    g_param_spec_int ("depth-height", "Depth height",
+        "Height of the depth stream (0 = device default)",
+        0, 16384, 0,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_DEPTH_FPS,
+    g_param_spec_int ("depth-fps", "Depth frame rate",
+        "Frame rate of the depth stream (0 = device default)",
+        0, 1000, 0,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_COLOR_FORMAT,
+    g_param_spec_int ("color-format", "Color format",
+        "Color format requested from the camera: 0 = RGB8, 1 = BGR8, 2 = RGBA8, 3 = BGRA8, "
+        "4 = YUYV (YUY2, the native format, no conversion in the SDK)",
+        ColorFormat::ColorRGB8, ColorFormat::ColorYUYV, ColorFormat::ColorRGB8,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SYNTHETIC,
+    g_param_spec_boolean ("synthetic", "Synthetic",
+        "Generate frames with a software device instead of using a camera", false,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SYNTHETIC_WIDTH,
+    g_param_spec_int ("synthetic-width", "Synthetic width",
+        "Width of the synthetic color and depth frames",
+        1, 16384, synthetic_defaults.width,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SYNTHETIC_HEIGHT,
+    g_param_spec_int ("synthetic-height", "Synthetic height",
+        "Height of the synthetic color and depth frames",
+        1, 16384, synthetic_defaults.height,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SYNTHETIC_FPS,
+    g_param_spec_int ("synthetic-fps", "Synthetic frame rate",
+        "Frame rate of the synthetic streams",
+        1, 1000, synthetic_defaults.fps,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SYNTHETIC_PATTERN,
+    g_param_spec_int ("synthetic-pattern", "Synthetic pattern",
+        "Content of synthetic frames: 0 = static bars and depth ramp, 1 = moving bars and ramp, 2 = noise",
+        SyntheticPattern::PatternStatic, SyntheticPattern::PatternNoise, synthetic_defaults.pattern,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_FILE,
+    g_param_spec_string ("file", "File",
+        "Play back a recorded .bag file instead of using a camera", nullptr,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_REAL_TIME,
+    g_param_spec_boolean ("real-time", "Real time",
+        "Play back the file at its recorded rate. When false every frame is read as fast "
+        "as downstream takes it and the source is not live.", true,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+    g_param_spec_boolean ("stats", "Stats",
+        "Time each stage of every frame and post the histograms as realsense-stats element messages", false,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+    g_param_spec_uint ("stats-interval", "Stats interval",
+        "Milliseconds between realsense-stats messages (0 = only at EOS)",
+        0, G_MAXUINT, DEFAULT_PROP_STATS_INTERVAL,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_POOL_HITS,
+    g_param_spec_uint64 ("pool-hits", "Pool hits",
+          "Number of output buffers reused from the buffer pool",
+          0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_POOL_MISSES,
+    g_param_spec_uint64 ("pool-misses", "Pool misses",
+          "Number of output buffers that had to be freshly allocated",
+          0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SKIP_UNUSED,
+    g_param_spec_boolean ("skip-unused", "Skip unused streams",
+        "Leave streams out of the multiplexed buffer once every rsdemux, rsalign and rspointcloud "
+        "downstream reported not consuming them. Only safe when no other element reads the "
+        "multiplexed stream", false,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_HUGE_PAGES,
+    g_param_spec_int ("huge-pages", "Huge pages",
+        "Memory of output buffers: 0 = default allocator, 1 = 64-byte aligned slabs of transparent huge pages, "
+        "2 = slabs of explicit (hugetlbfs) huge pages, falling back to transparent ones",
+        HugePages::HugePagesOff, HugePages::HugePagesExplicit, HugePages::HugePagesOff,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_MLOCK,
+    g_param_spec_boolean ("mlock", "mlock",
+        "Lock the huge page slabs into memory. Needs a large enough RLIMIT_MEMLOCK", false,
+        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_ALLOC_LIVE,
+    g_param_spec_uint64 ("alloc-live", "Allocated live",
+          "Bytes of huge page slab memory held by buffers now",
+          0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_ALLOC_PEAK,
+    g_param_spec_uint64 ("alloc-peak", "Allocated peak",
+          "Most bytes of huge page slab memory held by buffers at once",
+          0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+  g_object_class_install_property (gobject_class, PROP_SLAB_REFILLS,
+    g_param_spec_uint64 ("slab-refills", "Slab refills",
+          "Number of huge page slabs mapped",
+          0, G_MAXUINT64, 0,
+          (GParamFlags) (G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
 }
 
 /* initialize the new element
@@ -188,6 +402,46 @@ gst_realsense_src_init (GstRealsenseSrc * src)
   gst_base_src_set_format (GST_BASE_SRC (src), GST_FORMAT_TIME);
 
   src->stop_requested = FALSE;
+  src->queue_depth = DEFAULT_PROP_QUEUE_DEPTH;
+  src->overflow_policy = OverflowPolicy::DropOldest;
+  src->synthetic = false;
+  src->synthetic_settings = RSSyntheticSettings {};
+  src->file = nullptr;
+  src->real_time = true;
+  src->frame_duration = GST_CLOCK_TIME_NONE;
+  src->stats_on = false;
+  src->stats_interval = DEFAULT_PROP_STATS_INTERVAL;
+  src->huge_pages = HugePages::HugePagesOff;
+  src->skip_unused = false;
+  src->stream_consumers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, nullptr);
+  src->streams_wanted = StreamBitsAll;
+}
+
+static void
+gst_realsense_src_finalize (GObject * object)
+{
+  GstRealsenseSrc *src = GST_REALSENSESRC (object);
+
+  g_free (src->file);
+  src->file = nullptr;
+  g_hash_table_unref (src->stream_consumers);
+  src->stream_consumers = nullptr;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+/* Non real time playback reads frames as fast as downstream takes them, so
+ * the source is only live when it is attached to a camera or paced. */
+static bool
+gst_realsense_src_batch_mode (GstRealsenseSrc * src)
+{
+  return src->file != nullptr && !src->real_time && !src->synthetic;
+}
+
+static void
+gst_realsense_src_update_live (GstRealsenseSrc * src)
+{
+  gst_base_src_set_live (GST_BASE_SRC (src), !gst_realsense_src_batch_mode (src));
 }
 
 static void
@@ -210,6 +464,76 @@ gst_realsense_src_set_property (GObject * object, guint prop_id, const GValue *
     case PROP_IMU_ON:
       src->imu_on = g_value_get_boolean(value);
       break;
+    case PROP_ZERO_COPY:
+      src->zero_copy = g_value_get_boolean(value);
+      break;
+    case PROP_QUEUE_DEPTH:
+      src->queue_depth = g_value_get_uint(value);
+      break;
+    case PROP_OVERFLOW_POLICY:
+      src->overflow_policy = static_cast<OverflowPolicy>(g_value_get_int(value));
+      break;
+    case PROP_SYNTHETIC:
+      src->synthetic = g_value_get_boolean(value);
+      gst_realsense_src_update_live(src);
+      break;
+    case PROP_SYNTHETIC_WIDTH:
+      src->synthetic_settings.width = g_value_get_int(value);
+      break;
+    case PROP_SYNTHETIC_HEIGHT:
+      src->synthetic_settings.height = g_value_get_int(value);
+      break;
+    case PROP_SYNTHETIC_FPS:
+      src->synthetic_settings.fps = g_value_get_int(value);
+      break;
+    case PROP_SYNTHETIC_PATTERN:
+      src->synthetic_settings.pattern = g_value_get_int(value);
+      break;
+    case PROP_FILE:
+      g_free(src->file);
+      src->file = g_value_dup_string(value);
+      gst_realsense_src_update_live(src);
+      break;
+    case PROP_REAL_TIME:
+      src->real_time = g_value_get_boolean(value);
+      gst_realsense_src_update_live(src);
+      break;
+    case PROP_COLOR_WIDTH:
+      src->color_width = g_value_get_int(value);
+      break;
+    case PROP_COLOR_HEIGHT:
+      src->color_height = g_value_get_int(value);
+      break;
+    case PROP_COLOR_FPS:
+      src->color_fps = g_value_get_int(value);
+      break;
+    case PROP_DEPTH_WIDTH:
+      src->depth_width = g_value_get_int(value);
+      break;
+    case PROP_DEPTH_HEIGHT:
+      src->depth_height = g_value_get_int(value);
+      break;
+    case PROP_DEPTH_FPS:
+      src->depth_fps = g_value_get_int(value);
+      break;
+    case PROP_COLOR_FORMAT:
+      src->color_format_prop = static_cast<ColorFormat>(g_value_get_int(value));
+      break;
+    case PROP_STATS:
+      src->stats_on = g_value_get_boolean(value);
+      break;
+    case PROP_STATS_INTERVAL:
+      src->stats_interval = g_value_get_uint(value);
+      break;
+    case PROP_HUGE_PAGES:
+      src->huge_pages = static_cast<HugePages>(g_value_get_int(value));
+      break;
+    case PROP_MLOCK:
+      src->mlock = g_value_get_boolean(value);
+      break;
+    case PROP_SKIP_UNUSED:
+      src->skip_unused = g_value_get_boolean(value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -234,6 +558,96 @@ gst_realsense_src_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_IMU_ON:
       g_value_set_boolean(value, src->imu_on);
       break;
+    case PROP_ZERO_COPY:
+      g_value_set_boolean(value, src->zero_copy);
+      break;
+    case PROP_QUEUE_DEPTH:
+      g_value_set_uint(value, src->queue_depth);
+      break;
+    case PROP_OVERFLOW_POLICY:
+      g_value_set_int(value, src->overflow_policy);
+      break;
+    case PROP_SYNTHETIC:
+      g_value_set_boolean(value, src->synthetic);
+      break;
+    case PROP_SYNTHETIC_WIDTH:
+      g_value_set_int(value, src->synthetic_settings.width);
+      break;
+    case PROP_SYNTHETIC_HEIGHT:
+      g_value_set_int(value, src->synthetic_settings.height);
+      break;
+    case PROP_SYNTHETIC_FPS:
+      g_value_set_int(value, src->synthetic_settings.fps);
+      break;
+    case PROP_SYNTHETIC_PATTERN:
+      g_value_set_int(value, src->synthetic_settings.pattern);
+      break;
+    case PROP_FILE:
+      g_value_set_string(value, src->file);
+      break;
+    case PROP_REAL_TIME:
+      g_value_set_boolean(value, src->real_time);
+      break;
+    case PROP_COLOR_WIDTH:
+      g_value_set_int(value, src->color_width);
+      break;
+    case PROP_COLOR_HEIGHT:
+      g_value_set_int(value, src->color_height);
+      break;
+    case PROP_COLOR_FPS:
+      g_value_set_int(value, src->color_fps);
+      break;
+    case PROP_DEPTH_WIDTH:
+      g_value_set_int(value, src->depth_width);
+      break;
+    case PROP_DEPTH_HEIGHT:
+      g_value_set_int(value, src->depth_height);
+      break;
+    case PROP_DEPTH_FPS:
+      g_value_set_int(value, src->depth_fps);
+      break;
+    case PROP_COLOR_FORMAT:
+      g_value_set_int(value, src->color_format_prop);
+      break;
+    case PROP_STATS:
+      g_value_set_boolean(value, src->stats_on);
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint(value, src->stats_interval);
+      break;
+    case PROP_DROPPED_OLDEST:
+      g_value_set_uint64(value, src->dropped_oldest.load());
+      break;
+    case PROP_DROPPED_NEWEST:
+      g_value_set_uint64(value, src->dropped_newest.load());
+      break;
+    case PROP_POOL_HITS:
+      g_value_set_uint64(value, src->pool_hits.load());
+      break;
+    case PROP_POOL_MISSES:
+      g_value_set_uint64(value, src->pool_misses.load());
+      break;
+    case PROP_HUGE_PAGES:
+      g_value_set_int(value, src->huge_pages);
+      break;
+    case PROP_MLOCK:
+      g_value_set_boolean(value, src->mlock);
+      break;
+    case PROP_SKIP_UNUSED:
+      g_value_set_boolean(value, src->skip_unused);
+      break;
+    case PROP_ALLOC_LIVE:
+    case PROP_ALLOC_PEAK:
+    case PROP_SLAB_REFILLS:
+    {
+      GST_OBJECT_LOCK (src);
+      const auto counters = src->pool_allocator != nullptr ?
+          gst_realsense_allocator_get_counters (src->pool_allocator) : RSSlabCounters {};
+      GST_OBJECT_UNLOCK (src);
+      g_value_set_uint64(value, prop_id == PROP_ALLOC_LIVE ? counters.live :
+          prop_id == PROP_ALLOC_PEAK ? counters.peak : counters.refills);
+      break;
+    }
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -248,6 +662,8 @@ gst_realsense_src_unlock (GstBaseSrc * basesrc)
   GST_LOG_OBJECT (src, "unlock");
 
   src->stop_requested = TRUE;
+  if (src->ring != nullptr)
+    src->ring->interrupt();
 
   return TRUE;
 }
@@ -260,32 +676,294 @@ gst_realsense_src_unlock_stop (GstBaseSrc * basesrc)
   GST_LOG_OBJECT (src, "unlock_stop");
 
   src->stop_requested = FALSE;
+  if (src->ring != nullptr)
+    src->ring->resume();
 
   return TRUE;
 }
 
+/* Buffers that have already been handed out once are tagged with this quark,
+ * so a tagged buffer coming back out of the pool is a reuse (hit) and an
+ * untagged one was freshly allocated (miss). Works with downstream pools too. */
+static GQuark
+gst_realsense_src_pooled_quark (void)
+{
+  static GQuark quark = 0;
+  if (G_UNLIKELY (quark == 0))
+    quark = g_quark_from_static_string ("GstRealsenseSrcPooled");
+  return quark;
+}
+
 static GstBuffer *
-gst_realsense_src_create_buffer_from_frameset (GstRealsenseSrc * src, rs2::frameset& frame_set)
-{
-  auto cframe = frame_set.get_color_frame();
-  auto depth = frame_set.get_depth_frame();
-
-  auto header = RSHeader{
-    cframe.get_height(),
-    cframe.get_width(),
-    src->gst_stride,
-    src->color_format,
-    depth.get_height(),
-    depth.get_width(),
-    depth.get_stride_in_bytes(),
-    src->depth_format,
-    src->accel_format,
-    src->gyro_format
-  };
+gst_realsense_src_acquire_buffer (GstRealsenseSrc * src, gsize size)
+{
+  GstBuffer *buffer = nullptr;
+  auto pool = gst_base_src_get_buffer_pool (GST_BASE_SRC (src));
+
+  if (pool != nullptr)
+  {
+    if (gst_buffer_pool_acquire_buffer (pool, &buffer, nullptr) != GST_FLOW_OK)
+      buffer = nullptr;
+    gst_object_unref (pool);
+  }
+
+  if (buffer != nullptr)
+  {
+    gsize maxsize = 0;
+    gst_buffer_get_sizes (buffer, nullptr, &maxsize);
+    if (maxsize < size)
+    {
+      GST_DEBUG_OBJECT (src, "Pooled buffer too small (%lu < %lu)", maxsize, size);
+      gst_buffer_unref (buffer);
+      buffer = nullptr;
+    }
+  }
+
+  if (buffer == nullptr)
+  {
+    // RSMux::mux will allocate
+    ++(src->pool_misses);
+    return nullptr;
+  }
+
+  const auto quark = gst_realsense_src_pooled_quark ();
+  if (gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer), quark) != nullptr)
+  {
+    ++(src->pool_hits);
+  }
+  else
+  {
+    ++(src->pool_misses);
+    gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (buffer), quark, GINT_TO_POINTER (1), nullptr);
+  }
+
+  return buffer;
+}
+
+/* SDK timestamp (ms) of the frame that stamps the buffer. Depth and IMU
+ * timestamps travel in the header relative to it. */
+static double
+gst_realsense_src_reference_timestamp (GstRealsenseSrc * src, const rs2::frameset& frame_set)
+{
+  if (src->stream_type == StreamType::StreamDepth)
+    return frame_set.get_depth_frame().get_timestamp();
+  return frame_set.get_color_frame().get_timestamp();
+}
+
+/* The stream the aligner rewrites onto the other camera's geometry */
+static int
+gst_realsense_src_aligned_stream (GstRealsenseSrc * src)
+{
+  return src->align == Align::Color ? StreamBitDepth : StreamBitColor;
+}
+
+/* Streams of a muxed buffer nobody downstream consumes, as StreamBits.
+ * Consumers that read the muxed stream without announcing themselves
+ * would lose planes, so this is only done when skip-unused asks for it. */
+static int
+gst_realsense_src_skipped_streams (GstRealsenseSrc * src)
+{
+  if (src->stream_type != StreamType::StreamMux || !src->skip_unused)
+    return 0;
+  const int present = StreamBitColor | StreamBitDepth | (src->imu_active ? StreamBitImu : 0);
+  return present & ~src->streams_wanted;
+}
+
+static GstBuffer *
+gst_realsense_src_create_buffer_from_frameset (GstRealsenseSrc * src, rs2::frameset& frame_set, int skipped)
+{
+  RSHeader header {};
+  if (src->stream_type == StreamType::StreamMux)
+  {
+    auto cframe = frame_set.get_color_frame();
+    auto depth = frame_set.get_depth_frame();
+
+    header = RSHeader{
+      cframe.get_height(),
+      cframe.get_width(),
+      src->gst_stride,
+      src->color_format,
+      depth.get_height(),
+      depth.get_width(),
+      depth.get_stride_in_bytes(),
+      src->depth_format,
+      src->accel_format,
+      src->gyro_format
+    };
+    header.depth_offset = static_cast<int64_t>(
+        (depth.get_timestamp() - cframe.get_timestamp()) * GST_MSECOND);
+    header.color_fps = cframe.get_profile().fps();
+    header.depth_fps = depth.get_profile().fps();
+    header.skipped = skipped;
+
+    // not aligned as nobody wants it, but described as it would have been
+    if (src->aligner != nullptr && (skipped & gst_realsense_src_aligned_stream(src)))
+    {
+      if (src->align == Align::Color)
+      {
+        header.depth_width = header.color_width;
+        header.depth_height = header.color_height;
+        header.depth_stride = header.color_width * static_cast<int>(sizeof(uint16_t));
+      }
+      else
+      {
+        header.color_width = header.depth_width;
+        header.color_height = header.depth_height;
+      }
+    }
+
+    if (src->imu_active)
+    {
+      // every motion sample since the last frame
+      src->imu->pop(*src->imu_batch);
+      header.imu_rate = src->imu->rate();
+      header.imu_count = static_cast<int>(src->imu_batch->count);
+      header.imu_offset = static_cast<int64_t>(
+          (src->imu_batch->first_timestamp - cframe.get_timestamp()) * GST_MSECOND);
+    }
+  }
+  const RSImuBatch* imu = src->imu_active ? src->imu_batch.get() : nullptr;
   
+  if (src->zero_copy)
+  {
+    if (RSMux::can_wrap(frame_set, src))
+    {
+      GST_CAT_DEBUG(gst_realsense_src_debug, "wrapping frame data into GstBuffer");
+      return RSMux::mux_zero_copy(frame_set, header, src, imu);
+    }
+    
+    if (!src->zero_copy_fallback)
+    {
+      GST_INFO_OBJECT(src, "Frame stride does not match caps stride %d, falling back to copy.",
+          src->gst_stride);
+      src->zero_copy_fallback = true;
+    }
+  }
+
   GST_CAT_DEBUG(gst_realsense_src_debug, "muxing data into GstBuffer");
 
-  return RSMux::mux(frame_set, header, src);
+  auto buffer = gst_realsense_src_acquire_buffer(src, RSMux::buffer_size(frame_set, header, src, imu));
+  return RSMux::mux(frame_set, header, src, buffer, imu);
+}
+
+/* Active stream profile of the camera or the synthetic device */
+static rs2::stream_profile
+gst_realsense_src_get_stream (GstRealsenseSrc * src, rs2_stream stream)
+{
+  if (src->rs_synthetic != nullptr)
+    return src->rs_synthetic->stream(stream);
+  return src->rs_pipeline->get_active_profile().get_stream(stream);
+}
+
+/* Runs on the SDK thread of the motion sensor */
+static std::function<void(rs2::frame)>
+gst_realsense_src_motion_callback (GstRealsenseSrc * src)
+{
+  return [src](rs2::frame frame) {
+    auto motion = frame.as<rs2::motion_frame>();
+    if (!motion)
+      return;
+    if (motion.get_profile().stream_type() == RS2_STREAM_ACCEL)
+      src->imu->push_accel(motion.get_timestamp(), motion.get_motion_data());
+    else
+      src->imu->push_gyro(motion.get_timestamp(), motion.get_motion_data());
+  };
+}
+
+/* Accel and gyro run at several hundred Hz, far faster than the video, and
+ * framesets only carry one sample of each. So the motion sensor is run on
+ * its own with a callback that sees every sample, at the highest rates the
+ * device offers. */
+static void
+gst_realsense_src_start_imu (GstRealsenseSrc * src, const rs2::device& dev)
+{
+  for (auto&& sensor : dev.query_sensors())
+  {
+    rs2::stream_profile accel, gyro;
+    for (auto&& profile : sensor.get_stream_profiles())
+    {
+      if (profile.format() != RS2_FORMAT_MOTION_XYZ32F ||
+          (profile.stream_type() != RS2_STREAM_ACCEL && profile.stream_type() != RS2_STREAM_GYRO))
+        continue;
+      auto& best = profile.stream_type() == RS2_STREAM_ACCEL ? accel : gyro;
+      if (!best || profile.fps() > best.fps())
+        best = profile;
+    }
+    if (!accel || !gyro)
+      continue;
+
+    GST_INFO_OBJECT (src, "IMU accel at %d Hz, gyro at %d Hz", accel.fps(), gyro.fps());
+    src->imu = std::make_unique<RSImuBatcher>(std::max(accel.fps(), gyro.fps()));
+    src->motion_sensor = std::make_unique<rs2::sensor>(sensor);
+    src->motion_sensor->open({accel, gyro});
+    src->motion_sensor->start(gst_realsense_src_motion_callback(src));
+    return;
+  }
+  GST_ELEMENT_WARNING (src, RESOURCE, SETTINGS, ("No accel and gyro streams found. IMU is off."), (NULL));
+  src->imu_active = false;
+}
+
+static bool
+gst_realsense_src_try_wait_for_frames (GstRealsenseSrc * src, rs2::frameset * frame_set, unsigned int timeout_ms)
+{
+  if (src->rs_synthetic != nullptr)
+    return src->rs_synthetic->try_wait_for_frames(frame_set, timeout_ms);
+  return src->rs_pipeline->try_wait_for_frames(frame_set, timeout_ms);
+}
+
+/* Fill the meta values that stay fixed for a session, so create() only has
+ * to copy them into each buffer. */
+static void
+gst_realsense_src_set_meta_values (GstRealsenseSrc * src, rs2::device& dev, float depth_units)
+{
+  auto& values = src->meta_values;
+  values = GstRealsenseMeta {};
+
+  g_strlcpy(values.cam_model, dev.supports(RS2_CAMERA_INFO_NAME) ? dev.get_info(RS2_CAMERA_INFO_NAME) : "unknown",
+      sizeof(values.cam_model));
+  g_strlcpy(values.cam_serial_number, dev.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER), sizeof(values.cam_serial_number));
+  values.json_descr = g_intern_static_string("");
+
+  rs2::video_stream_profile cstream, dstream;
+  if (src->color_on)
+  {
+    cstream = gst_realsense_src_get_stream(src, RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
+    values.color_intrinsics = cstream.get_intrinsics();
+  }
+  if (src->depth_on)
+  {
+    dstream = gst_realsense_src_get_stream(src, RS2_STREAM_DEPTH).as<rs2::video_stream_profile>();
+    values.depth_intrinsics = dstream.get_intrinsics();
+    values.depth_units = depth_units;
+  }
+  if (src->color_on && src->depth_on)
+  {
+    values.depth_to_color = dstream.get_extrinsics_to(cstream);
+  }
+  else if (src->depth_on)
+  {
+    // as before, color_intrinsics describes the output
+    values.color_intrinsics = values.depth_intrinsics;
+    values.depth_to_color = rs_identity_extrinsics();
+  }
+
+  if (src->aligner != nullptr)
+  {
+    // both planes now share one camera geometry
+    if (src->align == Align::Color)
+      values.depth_intrinsics = values.color_intrinsics;
+    else
+      values.color_intrinsics = values.depth_intrinsics;
+    values.depth_to_color = rs_identity_extrinsics();
+  }
+}
+
+/* A timeout during playback is either a slow file or its end */
+static bool
+gst_realsense_src_playback_stopped (GstRealsenseSrc * src)
+{
+  auto playback = src->rs_pipeline->get_active_profile().get_device().as<rs2::playback>();
+  return playback && playback.current_status() == RS2_PLAYBACK_STATUS_STOPPED;
 }
 
 static void calculate_frame_rate(GstRealsenseSrc* src, GstClockTime new_time)
@@ -300,6 +978,134 @@ static void calculate_frame_rate(GstRealsenseSrc* src, GstClockTime new_time)
   GST_CAT_DEBUG(gst_realsense_src_debug, "Instant frame rate: %.02f, Avg frame rate: %.2f", instant_fr, mean_fr);
 }
 
+/* Runs on the capture thread as soon as a frameset arrives, before it waits in
+ * the ring and gets aligned and copied. The device timestamp is mapped onto
+ * running time so PTS reflects capture, not when create() got around to it. */
+static GstClockTime
+gst_realsense_src_capture_time (GstRealsenseSrc * src, const rs2::frameset& frame_set)
+{
+  // frames from before PLAYING have no base time to map onto
+  if (!gst_base_src_is_live (GST_BASE_SRC (src)) || GST_STATE (src) != GST_STATE_PLAYING)
+    return GST_CLOCK_TIME_NONE;
+
+  const auto clock = gst_element_get_clock (GST_ELEMENT (src));
+  if (clock == nullptr)
+    return GST_CLOCK_TIME_NONE;
+  const auto base_time = gst_element_get_base_time (GST_ELEMENT (src));
+  const auto arrival = GST_CLOCK_DIFF (base_time, gst_clock_get_time (clock));
+  gst_object_unref (clock);
+
+  if (base_time != src->mapper_base_time)
+  {
+    // paused and resumed, running time restarted
+    src->clock_mapper->reset();
+    src->mapper_base_time = base_time;
+  }
+  if (arrival < 0)
+    return GST_CLOCK_TIME_NONE;
+
+  const auto pts = src->clock_mapper->map(gst_realsense_src_reference_timestamp(src, frame_set), arrival);
+  if (src->stats)
+    src->stats->record(RSStage::Capture, arrival - pts);
+  return pts;
+}
+
+/* Capture to push delay of a buffer. The largest seen is reported as the
+ * minimum latency, and when it outgrows the last report the pipeline is asked
+ * to query again. */
+static void
+gst_realsense_src_update_latency (GstRealsenseSrc * src, GstClockTimeDiff delay)
+{
+  if (delay <= 0 || static_cast<GstClockTime>(delay) <= src->measured_latency)
+    return;
+
+  src->measured_latency = delay;
+  if (static_cast<GstClockTime>(delay) > src->reported_latency + GST_MSECOND)
+  {
+    GST_DEBUG_OBJECT (src, "latency grew to %" GST_TIME_FORMAT, GST_TIME_ARGS (delay));
+    gst_element_post_message (GST_ELEMENT (src), gst_message_new_latency (GST_OBJECT (src)));
+  }
+}
+
+/* Runs on the capture thread. Keeps pulling framesets from the SDK so a slow 
+ * downstream never stalls librealsense; the ring's overflow policy decides
+ * what gets dropped instead. */
+static void
+gst_realsense_src_capture_loop (GstRealsenseSrc * src)
+{
+  constexpr unsigned int poll_timeout_ms = 100;
+
+  GST_DEBUG_OBJECT (src, "capture thread started");
+
+  while (src->capture_running)
+  {
+    RSTimedFrameset frame;
+    try
+    {
+      if (!gst_realsense_src_try_wait_for_frames(src, &frame.frame_set, poll_timeout_ms))
+      {
+        if (src->file != nullptr && gst_realsense_src_playback_stopped(src))
+        {
+          GST_DEBUG_OBJECT (src, "end of file");
+          src->capture_eos = true;
+          src->ring->interrupt();
+          break;
+        }
+        continue;
+      }
+    }
+    catch (rs2::error & e)
+    {
+      GST_ELEMENT_ERROR (src, RESOURCE, FAILED, 
+          ("RealSense error calling %s (%s)", e.get_failed_function().c_str(), e.get_failed_args().c_str()),
+          (NULL));
+      src->capture_error = true;
+      src->ring->interrupt();
+      break;
+    }
+    frame.pts = gst_realsense_src_capture_time(src, frame.frame_set);
+    if (src->stats)
+      frame.arrival = RSStats::now();
+
+    if (src->overflow_policy == OverflowPolicy::Block || gst_realsense_src_batch_mode(src))
+    {
+      // pace the file by downstream instead of dropping
+      while (src->capture_running && !src->ring->try_push(std::move(frame)))
+        src->ring->wait_for_space(std::chrono::milliseconds(poll_timeout_ms));
+      continue;
+    }
+
+    switch (src->ring->push(std::move(frame), src->overflow_policy))
+    {
+      case RSRing<RSTimedFrameset>::PushResult::DroppedOldest:
+        ++(src->dropped_oldest);
+        GST_LOG_OBJECT (src, "frame queue full, dropped oldest frameset");
+        break;
+      case RSRing<RSTimedFrameset>::PushResult::DroppedNewest:
+        ++(src->dropped_newest);
+        GST_LOG_OBJECT (src, "frame queue full, dropped newest frameset");
+        break;
+      default:
+        break;
+    }
+  }
+
+  GST_DEBUG_OBJECT (src, "capture thread stopped");
+}
+
+static void
+gst_realsense_src_stop_capture (GstRealsenseSrc * src)
+{
+  src->capture_running = false;
+  if (src->capture_thread != nullptr)
+  {
+    src->capture_thread->join();
+    src->capture_thread = nullptr;
+  }
+  if (src->ring != nullptr)
+    src->ring->clear();
+}
+
 static GstFlowReturn
 gst_realsense_src_create (GstPushSrc * psrc, GstBuffer ** buf)
 {
@@ -310,36 +1116,95 @@ gst_realsense_src_create (GstPushSrc * psrc, GstBuffer ** buf)
   GST_CAT_DEBUG(gst_realsense_src_debug, "creating frame buffer");
 
   /* wait for next frame to be available */
+  RSTimedFrameset frame;
+  {
+    RSStageTimer timer (src->stats.get(), RSStage::Wait);
+    while (!src->ring->try_pop(frame))
+    {
+      if (src->stop_requested)
+        return GST_FLOW_FLUSHING;
+      if (src->capture_error)
+        return GST_FLOW_ERROR;
+      if (src->capture_eos)
+      {
+        // the capture thread may have queued its last framesets after we looked
+        if (src->ring->try_pop(frame))
+          break;
+        if (src->stats)
+          src->stats->post(GST_ELEMENT (src));
+        return GST_FLOW_EOS;
+      }
+      src->ring->wait_for_item(std::chrono::milliseconds(100));
+    }
+  }
+  if (src->stats && frame.arrival != 0)
+    src->stats->record(RSStage::Queue, RSStats::now() - frame.arrival);
+
+  auto& frame_set = frame.frame_set;
+  // read once, rsdemux may change it at any time
+  const int skipped = gst_realsense_src_skipped_streams(src);
   try 
   {
-    auto frame_set = src->rs_pipeline->wait_for_frames();
-    if(src->aligner != nullptr)
+    if(src->aligner != nullptr && !(skipped & gst_realsense_src_aligned_stream(src)))
+    {
+      RSStageTimer timer (src->stats.get(), RSStage::Align);
       frame_set = src->aligner->process(frame_set);
+    }
     
     GST_CAT_DEBUG(gst_realsense_src_debug, "received frame from realsense");
 
     /* create GstBuffer then release */
-    *buf = gst_realsense_src_create_buffer_from_frameset(src, frame_set);
+    {
+      RSStageTimer timer (src->stats.get(), RSStage::Mux);
+      *buf = gst_realsense_src_create_buffer_from_frameset(src, frame_set, skipped);
+    }
 
     GST_CAT_DEBUG(gst_realsense_src_debug, "setting timestamp.");
     
-    const auto clock = gst_element_get_clock (GST_ELEMENT (src));
-    const auto clock_time = gst_clock_get_time (clock);
-    auto tdiff = GST_CLOCK_DIFF (gst_element_get_base_time (GST_ELEMENT (src)), clock_time);
+    GstClockTimeDiff tdiff = 0;
+    if (gst_base_src_is_live (GST_BASE_SRC (src)))
+    {
+      const auto clock = gst_element_get_clock (GST_ELEMENT (src));
+      const auto clock_time = gst_clock_get_time (clock);
+      tdiff = GST_CLOCK_DIFF (gst_element_get_base_time (GST_ELEMENT (src)), clock_time);
+      gst_object_unref (clock);
+      if (GST_CLOCK_TIME_IS_VALID (frame.pts))
+      {
+        gst_realsense_src_update_latency(src, tdiff - static_cast<GstClockTimeDiff>(frame.pts));
+        tdiff = frame.pts;
+      }
+    }
+    else
+    {
+      // no clock to follow, so use the recorded timeline of the file
+      const auto timestamp = gst_realsense_src_reference_timestamp(src, frame_set);
+      if (src->first_timestamp < 0)
+        src->first_timestamp = timestamp;
+      tdiff = std::max<GstClockTimeDiff>(0,
+          static_cast<GstClockTimeDiff>((timestamp - src->first_timestamp) * GST_MSECOND));
+    }
     GST_BUFFER_TIMESTAMP (*buf) = tdiff;
+    GST_BUFFER_DURATION (*buf) = src->frame_duration;
         
     GST_BUFFER_OFFSET (*buf) = frame_set.get_frame_number();
-    gst_object_unref (clock);
 
     ++(src->frame_count);
     calculate_frame_rate(src, tdiff);
     src->prev_time = tdiff;
-    const auto depth_units = frame_set.get_depth_frame().get_units();
-    const auto exposure = static_cast<uint>(frame_set.get_frame_metadata(RS2_FRAME_METADATA_ACTUAL_EXPOSURE));
 
-    auto cstream = src->rs_pipeline->get_active_profile().get_stream(RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
-    auto cintrinsics = cstream.get_intrinsics();
-    gst_buffer_add_realsense_meta(*buf, "unknown", std::to_string(src->serial_number), exposure, "", depth_units, &cintrinsics);
+    RSStageTimer timer (src->stats.get(), RSStage::Meta);
+    auto meta = gst_buffer_get_realsense_meta(*buf);
+    if (meta == nullptr)
+    {
+      meta = gst_buffer_add_realsense_meta_from(*buf, &src->meta_values);
+      // keep the meta on the buffer when it goes back to the pool
+      GST_META_FLAG_SET(meta, GST_META_FLAG_POOLED);
+    }
+    else
+    {
+      gst_realsense_meta_set_values(meta, &src->meta_values);
+    }
+    meta->exposure = static_cast<uint>(frame_set.get_frame_metadata(RS2_FRAME_METADATA_ACTUAL_EXPOSURE));
   }
   catch (rs2::error & e)
   {
@@ -358,42 +1223,15 @@ gst_realsense_src_create (GstPushSrc * psrc, GstBuffer ** buf)
     return GST_FLOW_FLUSHING;
   }
 
+  if (src->stats && src->stats->due())
+    src->stats->post(GST_ELEMENT (src));
+
   GST_CAT_DEBUG(gst_realsense_src_debug, "create method done");
 
   
   return GST_FLOW_OK;
 }
 
-static GstVideoFormat RS_to_Gst_Video_Format(rs2_format fmt)
-{
-  switch(fmt){
-        case RS2_FORMAT_RGB8:
-          return GST_VIDEO_FORMAT_RGB;
-        case RS2_FORMAT_BGR8:
-          return GST_VIDEO_FORMAT_BGR;
-        case RS2_FORMAT_RGBA8:
-          return GST_VIDEO_FORMAT_RGBA;
-        case RS2_FORMAT_BGRA8:
-          return GST_VIDEO_FORMAT_BGRA;
-        case RS2_FORMAT_Z16:
-        case RS2_FORMAT_RAW16:
-        case RS2_FORMAT_Y16:
-          if (G_BYTE_ORDER == G_LITTLE_ENDIAN) 
-          {
-            return GST_VIDEO_FORMAT_GRAY16_LE;
-          } 
-          else if (G_BYTE_ORDER == G_BIG_ENDIAN) 
-          {
-            return GST_VIDEO_FORMAT_GRAY16_BE;
-          }
-        case RS2_FORMAT_YUYV:
-          // FIXME Not exact format match
-          return GST_VIDEO_FORMAT_YVYU;
-        default:
-          return GST_VIDEO_FORMAT_UNKNOWN;
-      }
-}
-
 static GstAudioFormat RS_to_Gst_Audio_Format(rs2_format fmt)
 {
   switch(fmt){
@@ -405,31 +1243,6 @@ static GstAudioFormat RS_to_Gst_Audio_Format(rs2_format fmt)
       }
 }
 
-/* Adapted from librealsense/example/motion/rs-motion.cpp */
-bool check_imu_is_supported(const rs2::device& dev)
-{
-    bool found_gyro = false;
-    bool found_accel = false;
-    rs2::context ctx;
-    
-    // The same device should support gyro and accel
-    found_gyro = false;
-    found_accel = false;
-    for (auto sensor : dev.query_sensors())
-    {
-        for (auto profile : sensor.get_stream_profiles())
-        {
-            if (profile.stream_type() == RS2_STREAM_GYRO)
-                found_gyro = true;
-
-            if (profile.stream_type() == RS2_STREAM_ACCEL)
-                found_accel = true;
-        }
-    }
-        
-    return found_gyro && found_accel;
-}
-
 static gboolean
 gst_realsense_src_start (GstBaseSrc * basesrc)
 {
@@ -438,135 +1251,293 @@ gst_realsense_src_start (GstBaseSrc * basesrc)
 
   try 
   {
-      GST_LOG_OBJECT(src, "Creating RealSense pipeline");
-      src->rs_pipeline = std::make_unique<rs2::pipeline>();
-      if(src->rs_pipeline == nullptr)
+      rs2::config cfg;
+      rs2::device dev;
+      RSDeviceInfo dev_info;
+      src->rs_pipeline = nullptr;
+      src->rs_synthetic = nullptr;
+      if (src->synthetic)
       {
-        GST_ELEMENT_ERROR (src, RESOURCE, FAILED, ("Failed to create RealSense pipeline."), (NULL));
-        return FALSE;
+        GST_LOG_OBJECT(src, "Creating synthetic RealSense device");
+        src->rs_synthetic = std::make_unique<RSSynthetic>(src->synthetic_settings);
+        dev = src->rs_synthetic->device();
+        dev_info = RSDeviceCache::probe(dev);
       }
-      rs2::config cfg;
-      
-      rs2::context ctx;
-      const auto dev_list = ctx.query_devices();      
-      auto serial_number = std::to_string(src->serial_number);
+      else if (src->file != nullptr)
+      {
+        GST_LOG_OBJECT(src, "Creating RealSense pipeline for file %s", src->file);
+        src->rs_pipeline = std::make_unique<rs2::pipeline>();
+        // look at what was recorded before the pipeline takes the file
+        rs2::context ctx;
+        dev = ctx.load_device(src->file);
+        dev_info = RSDeviceCache::probe(dev);
+        ctx.unload_device(src->file);
+        cfg.enable_device_from_file(src->file, false);
+      }
+      else
+      {
+        GST_LOG_OBJECT(src, "Creating RealSense pipeline");
+        // enumeration and capabilities are shared by every start and element
+        auto& devices = RSDeviceCache::shared();
+        src->rs_pipeline = std::make_unique<rs2::pipeline>(devices.context());
+        if(src->rs_pipeline == nullptr)
+        {
+          GST_ELEMENT_ERROR (src, RESOURCE, FAILED, ("Failed to create RealSense pipeline."), (NULL));
+          return FALSE;
+        }
+        const auto dev_list = devices.devices();
+        auto serial_number = std::to_string(src->serial_number);
+
+        if(dev_list.size() == 0)
+        {
+          GST_ELEMENT_ERROR (src, RESOURCE, FAILED, 
+          ("No RealSense devices found. Cannot start pipeline."),
+          (NULL));
+          return FALSE;
+        }
+
+        dev = dev_list[0];
+        if(src->serial_number != DEFAULT_PROP_CAM_SN)
+        {
+          auto val = dev_list.begin();
+          for (; val != dev_list.end(); ++val)
+          {
+            if (0 == serial_number.compare(val->get_info(RS2_CAMERA_INFO_SERIAL_NUMBER)))
+            {
+              break;
+            }
+          }
+        
+          if (val == dev_list.end())
+          {
+            GST_ELEMENT_WARNING(src, RESOURCE, FAILED,
+                                ("Specified serial number %lu not found. Using first found device.", src->serial_number),
+                                (NULL));
+          }
+          else
+          {
+            dev = *val;
+          }
+        }
+        serial_number = std::string(dev.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER));
+        dev_info = devices.info(dev);
 
-      if(dev_list.size() == 0)
+        cfg.enable_device(serial_number);
+      }
+
+      // Only stream what stream-type and imu-on ask for
+      src->has_imu = dev_info.has_imu;
+      src->color_on = src->stream_type == StreamType::StreamColor || src->stream_type == StreamType::StreamMux;
+      src->depth_on = src->stream_type == StreamType::StreamDepth || src->stream_type == StreamType::StreamMux;
+      src->imu_active = src->imu_on && src->has_imu && src->stream_type == StreamType::StreamMux;
+      if (src->imu_on && !src->imu_active)
       {
-        GST_ELEMENT_ERROR (src, RESOURCE, FAILED, 
-        ("No RealSense devices found. Cannot start pipeline."),
-        (NULL));
-        return FALSE;
+        GST_ELEMENT_WARNING (src, RESOURCE, SETTINGS, 
+            ("IMU data requires an IMU capable device and stream-type=%d. IMU is off.", StreamType::StreamMux), (NULL));
       }
 
-      if(src->serial_number == DEFAULT_PROP_CAM_SN)
+      // a recording only holds the format it was made with
+      if (src->color_on)
+        cfg.enable_stream(RS2_STREAM_COLOR, src->color_width, src->color_height,
+            src->file != nullptr ? RS2_FORMAT_ANY : RSMux::rs_format(src->color_format_prop), src->color_fps);
+      if (src->depth_on)
+        cfg.enable_stream(RS2_STREAM_DEPTH, src->depth_width, src->depth_height, RS2_FORMAT_Z16, src->depth_fps);
+
+      src->aligner = nullptr;
+      if (src->align != Align::None && src->stream_type != StreamType::StreamMux)
       {
-        serial_number = std::string(dev_list[0].get_info(RS2_CAMERA_INFO_SERIAL_NUMBER));
+        GST_ELEMENT_WARNING (src, RESOURCE, SETTINGS, 
+            ("Alignment needs both color and depth (stream-type=%d). Alignment is off.", StreamType::StreamMux), (NULL));
       }
       else
       {
-        auto val = dev_list.begin();
-        for (; val != dev_list.end(); ++val)
+        switch(src->align)
         {
-          if (0 == serial_number.compare(val.operator*().get_info(RS2_CAMERA_INFO_SERIAL_NUMBER)))
-          {
+          case Align::None:
             break;
-          }
-        }
-        
-        if (val == dev_list.end())
+          case Align::Color:
+            src->aligner = std::make_unique<rs2::align>(RS2_STREAM_COLOR);
+            break;
+          case Align::Depth:
+            src->aligner = std::make_unique<rs2::align>(RS2_STREAM_DEPTH);
+            break;
+          default:
+            GST_ELEMENT_WARNING (src, RESOURCE, SETTINGS, ("Unknown alignment parameter %d", src->align), (NULL));
+      }
+      }
+
+      // IMU is started next to the video, see gst_realsense_src_start_imu
+      src->imu = nullptr;
+      src->motion_sensor = nullptr;
+      src->imu_batch = nullptr;
+      if (src->rs_synthetic != nullptr)
+      {
+        if (src->imu_active)
+          src->imu = std::make_unique<RSImuBatcher>(std::max(src->rs_synthetic->stream(RS2_STREAM_ACCEL).fps(),
+              src->rs_synthetic->stream(RS2_STREAM_GYRO).fps()));
+        src->rs_synthetic->start(src->color_on, src->depth_on, src->imu_active, gst_realsense_src_motion_callback(src));
+      }
+      else
+      {
+        if (!cfg.can_resolve(*src->rs_pipeline))
         {
-          GST_ELEMENT_WARNING(src, RESOURCE, FAILED,
-                              ("Specified serial number %lu not found. Using first found device.", src->serial_number),
-                              (NULL));
-          serial_number = dev_list[0].get_info(RS2_CAMERA_INFO_SERIAL_NUMBER);
+          GST_ELEMENT_ERROR (src, RESOURCE, SETTINGS,
+              ("No stream profile of the device matches color %dx%d@%d and depth %dx%d@%d (0 = any).",
+                  src->color_width, src->color_height, src->color_fps,
+                  src->depth_width, src->depth_height, src->depth_fps), (NULL));
+          return FALSE;
         }
+        src->rs_pipeline->start(cfg);
+        if (src->imu_active)
+          gst_realsense_src_start_imu(src, src->rs_pipeline->get_active_profile().get_device());
       }
+      if (src->imu_active)
+        src->imu_batch = std::make_unique<RSImuBatch>();
 
-      cfg.enable_device(serial_number);
-
-      cfg.enable_stream(RS2_STREAM_ACCEL, RS2_FORMAT_MOTION_XYZ32F);      
-      cfg.enable_stream(RS2_STREAM_GYRO, RS2_FORMAT_MOTION_XYZ32F);
-      cfg.enable_stream(RS2_STREAM_COLOR, RS2_FORMAT_RGB8);
-      cfg.enable_stream(RS2_STREAM_DEPTH, RS2_FORMAT_Z16);
-      // auto profile = src->rs_pipeline->get_active_profile();
-      // auto streams = profile.get_streams();     
-      // auto s0 = streams[0].get();
-           
-      switch(src->align)
+      if (src->file != nullptr)
       {
-        case Align::None:
-          break;
-        case Align::Color:
-          src->aligner = std::make_unique<rs2::align>(RS2_STREAM_COLOR);
-          break;
-        case Align::Depth:
-          src->aligner = std::make_unique<rs2::align>(RS2_STREAM_DEPTH);
-          break;
-        default:
-          GST_ELEMENT_WARNING (src, RESOURCE, SETTINGS, ("Unknown alignment parameter %d", src->align), (NULL));
+        auto playback = src->rs_pipeline->get_active_profile().get_device().as<rs2::playback>();
+        playback.set_real_time(src->real_time);
       }
 
-      src->rs_pipeline->start(cfg);
-      src->has_imu = check_imu_is_supported(src->rs_pipeline->get_active_profile().get_device());
-
       GST_LOG_OBJECT(src, "RealSense pipeline started");
 
-      auto frame_set = src->rs_pipeline->wait_for_frames();
-      if(src->aligner != nullptr)
-        frame_set = src->aligner->process(frame_set);
-      
+      // Caps come from the active stream profiles, no need to wait for a frame
+      const auto fps = gst_realsense_src_get_stream(src,
+          src->stream_type == StreamType::StreamDepth ? RS2_STREAM_DEPTH : RS2_STREAM_COLOR).fps();
+      src->frame_duration = fps > 0 ? gst_util_uint64_scale_int(GST_SECOND, 1, fps) : GST_CLOCK_TIME_NONE;
+
+      rs2::video_stream_profile cprofile, dprofile;
+      int color_width = 0, color_height = 0, depth_width = 0, depth_height = 0;
+      src->color_format = GST_VIDEO_FORMAT_UNKNOWN;
+      src->depth_format = GST_VIDEO_FORMAT_UNKNOWN;
+      src->accel_format = GST_AUDIO_FORMAT_UNKNOWN;
+      src->gyro_format = GST_AUDIO_FORMAT_UNKNOWN;
+      if (src->color_on)
+      {
+        cprofile = gst_realsense_src_get_stream(src, RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
+        src->color_format = RSMux::video_format(cprofile.format());
+        color_width = cprofile.width();
+        color_height = cprofile.height();
+      }
+      if (src->depth_on)
+      {
+        dprofile = gst_realsense_src_get_stream(src, RS2_STREAM_DEPTH).as<rs2::video_stream_profile>();
+        src->depth_format = RSMux::video_format(dprofile.format());
+        depth_width = dprofile.width();
+        depth_height = dprofile.height();
+      }
+      // the aligner resamples one stream onto the other's geometry
+      if (src->aligner != nullptr && src->align == Align::Color)
+      {
+        depth_width = color_width;
+        depth_height = color_height;
+      }
+      else if (src->aligner != nullptr && src->align == Align::Depth)
+      {
+        color_width = depth_width;
+        color_height = depth_height;
+      }
+      // SDK frames are packed without row padding
+      const auto pixel_stride = [](GstVideoFormat format) {
+        return format == GST_VIDEO_FORMAT_UNKNOWN ? 0 :
+            GST_VIDEO_FORMAT_INFO_PSTRIDE (gst_video_format_get_info (format), 0);
+      };
+      const int depth_stride = depth_width * pixel_stride(src->depth_format);
+
       int height = 0;
       int width = 0;
       GstVideoFormat fmt = GST_VIDEO_FORMAT_UNKNOWN;
       if(src->stream_type == StreamType::StreamColor)
       {
-        auto cframe = frame_set.get_color_frame();
-        height = cframe.get_height();
-        width = cframe.get_width();
-        src->color_format = RS_to_Gst_Video_Format(cframe.get_profile().format());
+        height = color_height;
+        width = color_width;
         fmt = src->color_format;
       }
       else if(src->stream_type == StreamType::StreamDepth)
       {
-        auto depth = frame_set.get_depth_frame();
-        height = depth.get_height();
-        width = depth.get_width();
-        src->depth_format = RS_to_Gst_Video_Format(depth.get_profile().format());
+        height = depth_height;
+        width = depth_width;
         fmt = src->depth_format;
       }
       else if(src->stream_type == StreamType::StreamMux)
       {
-        auto depth = frame_set.get_depth_frame();
-        auto cframe = frame_set.get_color_frame();
-
-        height = cframe.get_height();
-        width = cframe.get_width();
-        src->depth_format = RS_to_Gst_Video_Format(depth.get_profile().format());
-        src->color_format = RS_to_Gst_Video_Format(cframe.get_profile().format());
-
-        auto depth_height = depth.get_height();
-        height += (depth_height * depth.get_stride_in_bytes()) / cframe.get_stride_in_bytes();
+        // the video info describes the color plane, the caps the whole layout
+        height = color_height;
+        width = color_width;
         fmt = src->color_format;
-      
-        if(src->has_imu && src->imu_on)
+        if(src->imu_active)
         {
-          src->accel_format = RS_to_Gst_Audio_Format(frame_set.first_or_default(RS2_STREAM_ACCEL).get_profile().format());
-          src->gyro_format = RS_to_Gst_Audio_Format(frame_set.first_or_default(RS2_STREAM_GYRO).get_profile().format());
-          constexpr auto imu_size = 2 * sizeof(rs2_vector);
-          // add enough for imu data
-          height += std::ceil(imu_size / cframe.get_stride_in_bytes()); 
+          src->accel_format = RS_to_Gst_Audio_Format(RS2_FORMAT_MOTION_XYZ32F);
+          src->gyro_format = RS_to_Gst_Audio_Format(RS2_FORMAT_MOTION_XYZ32F);
         }
       }
      
       gst_video_info_init(&src->info);
       
       if(fmt ==GST_VIDEO_FORMAT_UNKNOWN)
+      {
         GST_ELEMENT_ERROR (src, RESOURCE, FAILED, ("Unhandled RealSense format %d", fmt), (NULL));
+        gst_realsense_src_stop (basesrc);
+        return FALSE;
+      }
 
       gst_video_info_set_format(&src->info, fmt, width, height);
+      GST_VIDEO_INFO_FPS_N(&src->info) = fps;
+      GST_VIDEO_INFO_FPS_D(&src->info) = 1;
 
-      src->caps = gst_video_info_to_caps (&src->info);
+      src->height = src->info.height;
+      src->gst_stride = GST_VIDEO_INFO_COMP_STRIDE (&src->info, 0);
+      if (src->stream_type == StreamType::StreamMux)
+      {
+        RSHeader header {};
+        header.color_width = color_width;
+        header.color_height = color_height;
+        header.color_stride = src->gst_stride;
+        header.color_format = fmt;
+        header.depth_width = depth_width;
+        header.depth_height = depth_height;
+        header.depth_stride = depth_stride;
+        header.depth_format = src->depth_format;
+        header.color_fps = fps;
+        src->caps = RSMux::caps(header, src->imu_active);
+        // what RSMux::buffer_size gives for a full frameset and the largest IMU batch
+        src->out_size = RSMux::layout_size(RSMux::layout(header,
+            static_cast<gsize>(color_height) * src->gst_stride, static_cast<gsize>(depth_height) * depth_stride,
+            src->imu_active ? RSImuBatch::max_bytes() : 0));
+      }
+      else
+      {
+        src->caps = gst_video_info_to_caps (&src->info);
+        src->out_size = static_cast<gsize>(height) * src->gst_stride;
+      }
+      src->pool_hits = 0;
+      src->pool_misses = 0;
+      src->zero_copy_fallback = false;
+      GST_OBJECT_LOCK (src);
+      src->allocator = src->huge_pages != HugePages::HugePagesOff ?
+          gst_realsense_allocator_new (src->huge_pages, src->mlock) : nullptr;
+      GST_OBJECT_UNLOCK (src);
+      gst_realsense_src_set_meta_values(src, dev, dev_info.depth_units);
+
+      src->ring = std::make_unique<RSRing<RSTimedFrameset>>(src->queue_depth);
+      src->clock_mapper = std::make_unique<RSClockMapper>();
+      src->mapper_base_time = GST_CLOCK_TIME_NONE;
+      src->measured_latency = 0;
+      src->reported_latency = 0;
+      GST_OBJECT_LOCK (src);
+      g_hash_table_remove_all (src->stream_consumers);
+      GST_OBJECT_UNLOCK (src);
+      src->streams_wanted = StreamBitsAll;
+      src->stats = src->stats_on ?
+          std::make_unique<RSStats>(src->stats_interval * GST_MSECOND) : nullptr;
+      src->dropped_oldest = 0;
+      src->dropped_newest = 0;
+      src->capture_error = false;
+      src->capture_eos = false;
+      src->first_timestamp = -1.0;
+      src->capture_running = true;
+      src->capture_thread = std::make_unique<std::thread>(gst_realsense_src_capture_loop, src);
   }
   catch (rs2::error & e)
   {
@@ -581,9 +1552,6 @@ gst_realsense_src_start (GstBaseSrc * basesrc)
       return FALSE;
   }
 
-  src->height = src->info.height;
-  src->gst_stride = GST_VIDEO_INFO_COMP_STRIDE (&src->info, 0);
-  
   // GST_OBJECT_UNLOCK (src);
 
   return TRUE;
@@ -594,8 +1562,29 @@ gst_realsense_src_stop (GstBaseSrc * basesrc)
 {
   auto *src = GST_REALSENSESRC (basesrc);
   
+  gst_realsense_src_stop_capture (src);
+
+  if(src->motion_sensor != nullptr)
+  {
+    src->motion_sensor->stop();
+    src->motion_sensor->close();
+    src->motion_sensor = nullptr;
+  }
   if(src->rs_pipeline != nullptr)
     src->rs_pipeline->stop();
+  if(src->rs_synthetic != nullptr)
+    src->rs_synthetic->stop();
+  src->frame_duration = GST_CLOCK_TIME_NONE;
+  src->stats = nullptr;
+
+  // buffers still out hold their own reference
+  GST_OBJECT_LOCK (src);
+  for (auto allocator : {&src->allocator, &src->pool_allocator}) {
+    if (*allocator != nullptr)
+      gst_object_unref (*allocator);
+    *allocator = nullptr;
+  }
+  GST_OBJECT_UNLOCK (src);
 
   return TRUE;
 }
@@ -606,7 +1595,7 @@ gst_realsense_src_get_caps (GstBaseSrc * bsrc, GstCaps * filter)
   GstRealsenseSrc *src = GST_REALSENSESRC (bsrc);
   GstCaps *caps;
 
-  if (src->rs_pipeline == nullptr) {
+  if (src->caps == nullptr) {
     caps = gst_pad_get_pad_template_caps (GST_BASE_SRC_PAD (src));
   } else {
     caps = gst_caps_copy (src->caps);
@@ -635,9 +1624,11 @@ gst_realsense_src_set_caps (GstBaseSrc * bsrc, GstCaps * caps)
 
   GST_DEBUG_OBJECT (src, "The caps being set are %" GST_PTR_FORMAT, caps);
 
-  gst_video_info_from_caps (&vinfo, caps);
+  // the muxed layout was fixed in start, with the color stride
+  if (RSMux::is_mux_caps (caps))
+    return TRUE;
 
-  if (GST_VIDEO_INFO_FORMAT (&vinfo) != GST_VIDEO_FORMAT_UNKNOWN) {
+  if (gst_video_info_from_caps (&vinfo, caps) && GST_VIDEO_INFO_FORMAT (&vinfo) != GST_VIDEO_FORMAT_UNKNOWN) {
     src->gst_stride = GST_VIDEO_INFO_COMP_STRIDE (&vinfo, 0);
   } else {
     goto unsupported_caps;
@@ -649,3 +1640,147 @@ unsupported_caps:
   GST_ERROR_OBJECT (src, "Unsupported caps: %" GST_PTR_FORMAT, caps);
   return FALSE;
 }
+
+/* Based on GstVideoTestSrc. The muxed caps don't give a size, so the pool
+ * is sized from out_size, and its memory aligned for the muxed planes. The
+ * memory comes from our slab allocator when huge-pages is set, else from
+ * the allocator downstream proposes, if any (rsdemux proposes its slabs). */
+static gboolean
+gst_realsense_src_decide_allocation (GstBaseSrc * bsrc, GstQuery * query)
+{
+  GstRealsenseSrc *src = GST_REALSENSESRC (bsrc);
+  GstBufferPool *pool = nullptr;
+  GstAllocator *allocator = nullptr;
+  GstAllocationParams params;
+  GstStructure *config;
+  GstCaps *caps = nullptr;
+  guint size, min, max;
+  gboolean update;
+
+  if (gst_query_get_n_allocation_pools (query) > 0) {
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+    size = MAX (size, src->out_size);
+    update = TRUE;
+  } else {
+    size = src->out_size;
+    min = max = 0;
+    update = FALSE;
+  }
+
+  gst_query_parse_allocation (query, &caps, NULL);
+
+  // the base class configures the pool again from the first param, so ours goes there
+  const auto aligned = RSMux::allocation_params ();
+  const bool has_params = gst_query_get_n_allocation_params (query) > 0;
+  if (has_params) {
+    gst_query_parse_nth_allocation_param (query, 0, &allocator, &params);
+    params.align = MAX (params.align, aligned.align);
+  } else {
+    params = aligned;
+  }
+
+  // huge-pages replaces whatever downstream offers, else downstream's
+  // allocator (DMABuf, GL, rsdemux's slabs...) is kept as it is
+  GST_OBJECT_LOCK (src);
+  if (src->allocator != nullptr) {
+    if (allocator != nullptr)
+      gst_object_unref (allocator);
+    allocator = GST_ALLOCATOR_CAST (gst_object_ref (src->allocator));
+  }
+  if (src->pool_allocator != nullptr)
+    gst_object_unref (src->pool_allocator);
+  src->pool_allocator = allocator != nullptr && GST_IS_REALSENSE_ALLOCATOR (allocator) ?
+      GST_ALLOCATOR_CAST (gst_object_ref (allocator)) : nullptr;
+  GST_OBJECT_UNLOCK (src);
+
+  if (has_params)
+    gst_query_set_nth_allocation_param (query, 0, allocator, &params);
+  else
+    gst_query_add_allocation_param (query, allocator, &params);
+
+  if (pool != nullptr) {
+    config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_set_params (config, caps, size, min, max);
+    gst_buffer_pool_config_set_allocator (config, allocator, &params);
+    if (!gst_buffer_pool_set_config (pool, config)) {
+      GST_INFO_OBJECT (src, "Downstream pool rejected size %u, using internal pool", size);
+      gst_object_unref (pool);
+      pool = nullptr;
+    }
+  }
+
+  /* no (usable) downstream pool, make our own */
+  if (pool == nullptr) {
+    pool = gst_buffer_pool_new ();
+    config = gst_buffer_pool_get_config (pool);
+    gst_buffer_pool_config_set_params (config, caps, size, min, max);
+    gst_buffer_pool_config_set_allocator (config, allocator, &params);
+    gst_buffer_pool_set_config (pool, config);
+  }
+
+  GST_DEBUG_OBJECT (src, "Using pool %" GST_PTR_FORMAT " with buffer size %u and allocator %" GST_PTR_FORMAT,
+      pool, size, allocator);
+
+  if (update)
+    gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+  else
+    gst_query_add_allocation_pool (query, pool, size, min, max);
+
+  gst_object_unref (pool);
+  if (allocator != nullptr)
+    gst_object_unref (allocator);
+
+  return GST_BASE_SRC_CLASS (parent_class)->decide_allocation (bsrc, query);
+}
+
+static gboolean
+gst_realsense_src_query (GstBaseSrc * bsrc, GstQuery * query)
+{
+  auto *src = GST_REALSENSESRC (bsrc);
+
+  if (GST_QUERY_TYPE (query) != GST_QUERY_LATENCY || !gst_base_src_is_live (bsrc) ||
+      !GST_CLOCK_TIME_IS_VALID (src->frame_duration))
+    return GST_BASE_SRC_CLASS (parent_class)->query (bsrc, query);
+
+  // until frames have been measured, a frame spends at least a frame time in transfer
+  GstClockTime min = src->measured_latency;
+  if (min == 0)
+    min = src->frame_duration;
+  // frames can wait in the ring for up to queue-depth frame times
+  const GstClockTime max = min + src->queue_depth * src->frame_duration;
+  src->reported_latency = min;
+
+  GST_DEBUG_OBJECT (src, "latency min %" GST_TIME_FORMAT " max %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (min), GST_TIME_ARGS (max));
+  gst_query_set_latency (query, TRUE, min, max);
+  return TRUE;
+}
+
+static gboolean
+gst_realsense_src_event (GstBaseSrc * bsrc, GstEvent * event)
+{
+  auto *src = GST_REALSENSESRC (bsrc);
+
+  int streams;
+  const gchar *sender;
+  if (RSMux::parse_streams_event (event, &streams, &sender))
+  {
+    // a stream is muxed as long as any consumer wants it
+    GST_OBJECT_LOCK (src);
+    g_hash_table_insert (src->stream_consumers, g_strdup (sender), GINT_TO_POINTER (streams));
+    int wanted = 0;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init (&iter, src->stream_consumers);
+    while (g_hash_table_iter_next (&iter, nullptr, &value))
+      wanted |= GPOINTER_TO_INT (value);
+    GST_OBJECT_UNLOCK (src);
+
+    // picked up by the next create(), the camera keeps streaming
+    GST_INFO_OBJECT (src, "%s consumes streams 0x%x, muxing 0x%x", sender, streams, wanted);
+    src->streams_wanted = wanted;
+    return TRUE;
+  }
+
+  return GST_BASE_SRC_CLASS (parent_class)->event (bsrc, event);
+}
@@ -30,6 +30,17 @@
 #include <librealsense2/rs.hpp>
 
 #include "common.hpp"
+#include "gstrealsenseallocator.h"
+#include "gstrealsensemeta.h"
+#include "rsdevices.hpp"
+#include "rsimu.hpp"
+#include "rsring.hpp"
+#include "rsstats.hpp"
+#include "rssynthetic.hpp"
+#include "rstime.hpp"
+
+#include <atomic>
+#include <thread>
 
 G_BEGIN_DECLS
 
@@ -50,7 +61,24 @@ typedef struct _GstRealsenseSrcClass GstRealsenseSrcClass;
 
 using rs_pipe_ptr = std::unique_ptr<rs2::pipeline>;
 using rs_aligner_ptr = std::unique_ptr<rs2::align>;
+/* A frameset and the running time it was captured at, GST_CLOCK_TIME_NONE
+ * when it arrived with no clock to map it onto */
+struct RSTimedFrameset
+{
+  rs2::frameset frame_set;
+  GstClockTime pts = GST_CLOCK_TIME_NONE;
+  int64_t arrival = 0; // RSStats::now() at arrival, only with stats on
+};
+
+using rs_ring_ptr = std::unique_ptr<RSRing<RSTimedFrameset>>;
+using rs_synthetic_ptr = std::unique_ptr<RSSynthetic>;
+using rs_sensor_ptr = std::unique_ptr<rs2::sensor>;
+using rs_imu_ptr = std::unique_ptr<RSImuBatcher>;
+using rs_imu_batch_ptr = std::unique_ptr<RSImuBatch>;
+using rs_clock_mapper_ptr = std::unique_ptr<RSClockMapper>;
+using rs_stats_ptr = std::unique_ptr<RSStats>;
 constexpr const auto DEFAULT_PROP_CAM_SN = 0;
+constexpr const guint DEFAULT_PROP_QUEUE_DEPTH = 4;
 
 struct _GstRealsenseSrc
 {
@@ -71,16 +99,84 @@ struct _GstRealsenseSrc
   GstClockTime prev_time = 0;
   guint64 frame_count = 0;
 
+  // Output buffer pool bookkeeping
+  gsize out_size = 0; // size of one muxed buffer, computed in start
+  std::atomic<guint64> pool_hits {0};
+  std::atomic<guint64> pool_misses {0};
+  // slab allocator made in start when huge-pages is set, and the allocator
+  // of the current pool if it is one of ours (that or rsdemux's), for the
+  // alloc-* properties. Both protected by the object lock.
+  GstAllocator *allocator = nullptr;
+  GstAllocator *pool_allocator = nullptr;
+
   // Realsense vars
   rs_pipe_ptr rs_pipeline = nullptr;
   rs_aligner_ptr aligner = nullptr;
+  rs_synthetic_ptr rs_synthetic = nullptr; // replaces rs_pipeline in synthetic mode
+  double first_timestamp = -1.0; // SDK timestamp (ms) of the first frameset when not live
   bool has_imu = false;
+  // streams actually configured in start, from stream-type and imu-on
+  bool color_on = false;
+  bool depth_on = false;
+  bool imu_active = false;
+  // motion samples from the motion sensor callback, batched per frame in create
+  rs_sensor_ptr motion_sensor = nullptr; // not used in synthetic mode
+  rs_imu_ptr imu = nullptr;
+  rs_imu_batch_ptr imu_batch = nullptr;
+  // per session values copied into every buffer's GstRealsenseMeta, set in start
+  GstRealsenseMeta meta_values;
+
+  // Capture thread hands framesets to create() through ring
+  rs_ring_ptr ring = nullptr;
+  std::unique_ptr<std::thread> capture_thread = nullptr;
+  std::atomic<bool> capture_running {false};
+  std::atomic<bool> capture_error {false};
+  std::atomic<bool> capture_eos {false}; // playback reached the end of the file
+  std::atomic<guint64> dropped_oldest {0};
+  std::atomic<guint64> dropped_newest {0};
+
+  // device timestamps mapped onto running time by the capture thread
+  rs_clock_mapper_ptr clock_mapper = nullptr;
+  GstClockTime mapper_base_time = GST_CLOCK_TIME_NONE; // base time the mapper started from
+  GstClockTime frame_duration = GST_CLOCK_TIME_NONE; // of the video streams, set in start
+  // largest delay from capture to push seen, and the latency last reported
+  std::atomic<GstClockTime> measured_latency {0};
+  std::atomic<GstClockTime> reported_latency {0};
+
+  // StreamBits each rsdemux downstream consumes, protected by the object
+  // lock, and their union. Streams nobody wants are not muxed.
+  GHashTable *stream_consumers = nullptr; // sender name to StreamBits
+  std::atomic<int> streams_wanted {StreamBitsAll};
+
+  // per-stage timings, only allocated in start when stats are on
+  rs_stats_ptr stats = nullptr;
   
   // Properties
   Align align = Align::None;
   guint64 serial_number = 0;
   StreamType stream_type = StreamType::StreamDepth;
   bool imu_on = true;
+  bool zero_copy = false;
+  guint queue_depth = DEFAULT_PROP_QUEUE_DEPTH;
+  OverflowPolicy overflow_policy = OverflowPolicy::DropOldest;
+  bool zero_copy_fallback = false; // set once we've warned about falling back to copies
+  HugePages huge_pages = HugePages::HugePagesOff;
+  bool mlock = false;
+  bool skip_unused = false; // honour realsense-streams events
+  bool synthetic = false;
+  RSSyntheticSettings synthetic_settings;
+  gchar *file = nullptr; // bag file to play back instead of using a camera
+  bool real_time = true;
+  // requested stream profiles, 0 leaves the choice to the SDK
+  int color_width = 0;
+  int color_height = 0;
+  int color_fps = 0;
+  int depth_width = 0;
+  int depth_height = 0;
+  int depth_fps = 0;
+  ColorFormat color_format_prop = ColorFormat::ColorRGB8;
+  bool stats_on = false;
+  guint stats_interval = DEFAULT_PROP_STATS_INTERVAL; // ms, 0 = only at EOS
 };
 
 struct _GstRealsenseSrcClass 
@@ -0,0 +1,267 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSALIGN_H__
+#define __GST_RSALIGN_H__
+
+#include "rsgeometry.hpp"
+#include "rsworkers.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+/* Packed 4:2:2 color, where each pair of pixels shares one chroma sample */
+enum class RSPacking
+{
+    None,
+    YUY2, // Y0 U Y1 V
+    UYVY  // U Y0 V Y1
+};
+
+/* Depth/color registration with the same results as rs2::align.
+ *
+ * Like the SDK, every depth pixel is projected into the color image through
+ * its two corners. The corner rays are computed once per calibration, so a
+ * frame costs two vectorized project_row() calls per depth row plus the
+ * scatter into the output, both split into row bands on an RSWorkerPool.
+ */
+class RSAligner
+{
+public:
+    /* Rebuild the lookup tables if calibration or resolution changed.
+     * Returns true if anything was rebuilt. */
+    bool configure(const rs2_intrinsics& depth, const rs2_intrinsics& color,
+        const rs2_extrinsics& depth_to_color, float depth_units)
+    {
+        const bool same = configured_ &&
+            rs_intrinsics_equal(depth, depth_) &&
+            rs_intrinsics_equal(color, color_) &&
+            rs_extrinsics_equal(depth_to_color, extrinsics_);
+
+        params_.depth_scale = depth_units;
+        if (same)
+            return false;
+
+        depth_ = depth;
+        color_ = color;
+        extrinsics_ = depth_to_color;
+
+        // corner (u, v) of depth pixel (u, v) is at (u - 0.5, v - 0.5)
+        corners_.build(depth_, extrinsics_, depth_.width + 1, depth_.height + 1, -0.5f);
+
+        params_.t[0] = extrinsics_.translation[0];
+        params_.t[1] = extrinsics_.translation[1];
+        params_.t[2] = extrinsics_.translation[2];
+        params_.target = color_;
+
+        const auto n = static_cast<size_t>(depth_.width) * depth_.height;
+        x0_.resize(n);
+        y0_.resize(n);
+        x1_.resize(n);
+        y1_.resize(n);
+        row_min_.resize(depth_.height);
+        row_max_.resize(depth_.height);
+
+        configured_ = true;
+        return true;
+    }
+
+    const rs2_intrinsics& depth_intrinsics() const { return depth_; }
+    const rs2_intrinsics& color_intrinsics() const { return color_; }
+
+    /* Depth as seen from the color camera, Align::Color. out is color sized.
+     * Where several depth pixels cover one color pixel the nearest wins. */
+    void depth_to_color(const uint16_t* depth, int depth_stride, uint16_t* out, int out_stride,
+        RSWorkerPool& pool, unsigned int max_threads = 0)
+    {
+        project(depth, depth_stride, pool, max_threads);
+
+        const int height = color_.height;
+        const auto bands = pool.bands_for(height, max_threads);
+        pool.parallel_for(bands, [&](size_t band) {
+            const int lo = static_cast<int>(band * height / bands);
+            const int hi = static_cast<int>((band + 1) * height / bands);
+            for (int y = lo; y < hi; ++y)
+                std::memset(row(out, out_stride, y), 0, sizeof(uint16_t) * color_.width);
+
+            for (int v = 0; v < depth_.height; ++v)
+            {
+                if (row_max_[v] < lo || row_min_[v] >= hi)
+                    continue;
+
+                const auto drow = row(depth, depth_stride, v);
+                const auto base = static_cast<size_t>(v) * depth_.width;
+                for (int u = 0; u < depth_.width; ++u)
+                {
+                    const auto i = base + u;
+                    if (x0_[i] < 0)
+                        continue;
+                    const auto z = drow[u];
+                    const int ylo = std::max<int>(y0_[i], lo);
+                    const int yhi = std::min<int>(y1_[i], hi - 1);
+                    for (int y = ylo; y <= yhi; ++y)
+                    {
+                        auto orow = row(out, out_stride, y);
+                        for (int x = x0_[i]; x <= x1_[i]; ++x)
+                            orow[x] = orow[x] ? std::min(orow[x], z) : z;
+                    }
+                }
+            }
+        }, max_threads);
+    }
+
+    /* Color as seen from the depth camera, Align::Depth. out is depth sized,
+     * bpp bytes per pixel. Depth pixels that do not project are black. Packed
+     * 4:2:2 pixels take their luma from the source pixel and the chroma byte
+     * their own position in the output pair carries from the source pair. */
+    void color_to_depth(const uint16_t* depth, int depth_stride, const uint8_t* color, int color_stride,
+        int bpp, uint8_t* out, int out_stride, RSWorkerPool& pool, unsigned int max_threads = 0,
+        RSPacking packing = RSPacking::None)
+    {
+        const int luma = packing == RSPacking::UYVY ? 1 : 0;
+        const int chroma = 1 - luma;
+        const int height = depth_.height;
+        const auto bands = pool.bands_for(height, max_threads);
+        pool.parallel_for(bands, [&](size_t band) {
+            const int lo = static_cast<int>(band * height / bands);
+            const int hi = static_cast<int>((band + 1) * height / bands);
+            project_rows(depth, depth_stride, lo, hi);
+
+            for (int v = lo; v < hi; ++v)
+            {
+                auto orow = out + static_cast<size_t>(v) * out_stride;
+                const auto base = static_cast<size_t>(v) * depth_.width;
+                for (int u = 0; u < depth_.width; ++u)
+                {
+                    const auto i = base + u;
+                    auto dst = orow + static_cast<size_t>(u) * bpp;
+                    if (packing != RSPacking::None)
+                    {
+                        if (x0_[i] < 0)
+                        {
+                            dst[luma] = 16;
+                            dst[chroma] = 128;
+                            continue;
+                        }
+                        const int x = x1_[i];
+                        const auto pair = color + static_cast<size_t>(y1_[i]) * color_stride + static_cast<size_t>(x & ~1) * 2;
+                        dst[luma] = pair[(x & 1) * 2 + luma];
+                        dst[chroma] = pair[(u & 1) * 2 + chroma];
+                        continue;
+                    }
+                    if (x0_[i] < 0)
+                    {
+                        std::memset(dst, 0, bpp);
+                        continue;
+                    }
+                    // the SDK samples at the far corner of the box
+                    const auto src = color + static_cast<size_t>(y1_[i]) * color_stride + static_cast<size_t>(x1_[i]) * bpp;
+                    std::memcpy(dst, src, bpp);
+                }
+            }
+        }, max_threads);
+    }
+
+private:
+    template <typename T>
+    static T* row(T* data, int stride, int y)
+    {
+        using byte = typename std::conditional<std::is_const<T>::value, const uint8_t, uint8_t>::type;
+        return reinterpret_cast<T*>(reinterpret_cast<byte*>(data) + static_cast<size_t>(y) * stride);
+    }
+
+    void project(const uint16_t* depth, int depth_stride, RSWorkerPool& pool, unsigned int max_threads)
+    {
+        const int height = depth_.height;
+        const auto bands = pool.bands_for(height, max_threads);
+        pool.parallel_for(bands, [&](size_t band) {
+            project_rows(depth, depth_stride,
+                static_cast<int>(band * height / bands),
+                static_cast<int>((band + 1) * height / bands));
+        }, max_threads);
+    }
+
+    /* Color box [x0, x1] x [y0, y1] of every depth pixel in rows [lo, hi).
+     * x0 < 0 marks pixels that do not land fully inside the color image. */
+    void project_rows(const uint16_t* depth, int depth_stride, int lo, int hi)
+    {
+        const int width = depth_.width;
+        thread_local std::vector<float> scratch;
+        scratch.resize(4 * static_cast<size_t>(width));
+        float* ax = scratch.data();
+        float* ay = ax + width;
+        float* bx = ay + width;
+        float* by = bx + width;
+
+        for (int v = lo; v < hi; ++v)
+        {
+            const auto drow = row(depth, depth_stride, v);
+
+            // top left corners are (u, v), bottom right ones (u + 1, v + 1)
+            const auto c0 = static_cast<size_t>(v) * corners_.width;
+            const auto c1 = static_cast<size_t>(v + 1) * corners_.width + 1;
+            RSGeometry::project_row(corners_.x.data() + c0, corners_.y.data() + c0, corners_.z.data() + c0,
+                drow, params_, width, ax, ay);
+            RSGeometry::project_row(corners_.x.data() + c1, corners_.y.data() + c1, corners_.z.data() + c1,
+                drow, params_, width, bx, by);
+
+            int rmin = INT_MAX;
+            int rmax = -1;
+            const auto base = static_cast<size_t>(v) * width;
+            for (int u = 0; u < width; ++u)
+            {
+                const auto i = base + u;
+                const int x0 = static_cast<int>(ax[u] + 0.5f);
+                const int y0 = static_cast<int>(ay[u] + 0.5f);
+                const int x1 = static_cast<int>(bx[u] + 0.5f);
+                const int y1 = static_cast<int>(by[u] + 0.5f);
+                if (x0 < 0 || y0 < 0 || x1 >= color_.width || y1 >= color_.height)
+                {
+                    x0_[i] = -1;
+                    continue;
+                }
+                x0_[i] = x0;
+                y0_[i] = y0;
+                x1_[i] = x1;
+                y1_[i] = y1;
+                rmin = std::min(rmin, y0);
+                rmax = std::max(rmax, y1);
+            }
+            row_min_[v] = rmin;
+            row_max_[v] = rmax;
+        }
+    }
+
+    bool configured_ = false;
+    rs2_intrinsics depth_ {};
+    rs2_intrinsics color_ {};
+    rs2_extrinsics extrinsics_ {};
+    RSProjectParams params_ {};
+    RSRayLUT corners_;
+
+    std::vector<int32_t> x0_, y0_, x1_, y1_;
+    std::vector<int> row_min_, row_max_;
+};
+
+#endif // __GST_RSALIGN_H__
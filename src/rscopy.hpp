@@ -0,0 +1,249 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSCOPY_H__
+#define __GST_RSCOPY_H__
+
+#include "rsworkers.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RS_COPY_X86 1
+#endif
+
+/* Copies of whole frames into output buffers.
+ *
+ * A 4K color frame is 25 MB, far more than any cache, and is usually read
+ * next by another thread or not by the CPU at all. Large copies are
+ * therefore split into bands across the shared worker pool so they are not
+ * bound by what one core can move, and written with non-temporal stores that
+ * go straight to memory instead of first reading every destination line
+ * into the cache and evicting the rest of the pipeline's data. Small copies
+ * stay a plain memcpy on the calling thread, where the destination is
+ * likely still cached when it is read. The widest streaming stores the CPU
+ * has are picked at run time.
+ */
+namespace rs_copy_detail
+{
+    // destination lines written per loop iteration of the streaming kernels
+    constexpr size_t Line = 64;
+
+    /* Bytes before dst reaches an align boundary, at most size */
+    inline size_t head(const uint8_t* dst, size_t size, size_t align)
+    {
+        const auto misalign = reinterpret_cast<uintptr_t>(dst) & (align - 1);
+        return std::min(size, misalign == 0 ? 0 : align - misalign);
+    }
+
+#ifdef RS_COPY_X86
+    __attribute__((target("avx512f")))
+    inline void stream_avx512(uint8_t* dst, const uint8_t* src, size_t size)
+    {
+        const auto h = head(dst, size, Line);
+        std::memcpy(dst, src, h);
+        size_t i = h;
+        for (; i + Line <= size; i += Line)
+            _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + i),
+                _mm512_loadu_si512(reinterpret_cast<const void*>(src + i)));
+        std::memcpy(dst + i, src + i, size - i);
+        _mm_sfence();
+    }
+
+    __attribute__((target("avx2")))
+    inline void stream_avx2(uint8_t* dst, const uint8_t* src, size_t size)
+    {
+        const auto h = head(dst, size, Line);
+        std::memcpy(dst, src, h);
+        size_t i = h;
+        for (; i + Line <= size; i += Line)
+        {
+            const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i), a);
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i + 32), b);
+        }
+        std::memcpy(dst + i, src + i, size - i);
+        _mm_sfence();
+    }
+
+    __attribute__((target("sse2")))
+    inline void stream_sse2(uint8_t* dst, const uint8_t* src, size_t size)
+    {
+        const auto h = head(dst, size, Line);
+        std::memcpy(dst, src, h);
+        size_t i = h;
+        for (; i + Line <= size; i += Line)
+        {
+            for (size_t j = 0; j < Line; j += 16)
+                _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i + j),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + j)));
+        }
+        std::memcpy(dst + i, src + i, size - i);
+        _mm_sfence();
+    }
+#endif
+
+    enum class Isa { Scalar, SSE2, AVX2, AVX512 };
+
+    inline Isa detect_isa()
+    {
+#ifdef RS_COPY_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return Isa::AVX512;
+        if (__builtin_cpu_supports("avx2"))
+            return Isa::AVX2;
+        if (__builtin_cpu_supports("sse2"))
+            return Isa::SSE2;
+#endif
+        return Isa::Scalar;
+    }
+
+    inline Isa isa()
+    {
+        static const Isa detected = detect_isa();
+        return detected;
+    }
+
+    /* Copy with streaming stores where the CPU has them */
+    inline void stream(uint8_t* dst, const uint8_t* src, size_t size)
+    {
+        switch (isa())
+        {
+#ifdef RS_COPY_X86
+            case Isa::AVX512:
+                stream_avx512(dst, src, size);
+                return;
+            case Isa::AVX2:
+                stream_avx2(dst, src, size);
+                return;
+            case Isa::SSE2:
+                stream_sse2(dst, src, size);
+                return;
+#endif
+            default:
+                std::memcpy(dst, src, size);
+                return;
+        }
+    }
+}
+
+class RSCopy
+{
+public:
+    // copies smaller than this stay on the calling thread
+    static constexpr size_t ParallelThreshold = 1 << 20;
+    // and each band of a split copy is at least this large
+    static constexpr size_t MinBand = 256 << 10;
+    // from this size on the destination would not stay cached anyway
+    static constexpr size_t StreamThreshold = 4 << 20;
+
+    /* memcpy of size bytes, split across up to max_threads threads of the
+     * shared pool (0 = whole pool plus the caller) when large */
+    static void copy(void* dst, const void* src, size_t size, unsigned int max_threads = 0)
+    {
+        auto d = static_cast<uint8_t*>(dst);
+        auto s = static_cast<const uint8_t*>(src);
+        const bool streaming = size >= StreamThreshold;
+
+        auto& pool = RSWorkerPool::shared();
+        const auto n_bands = bands(size, pool, max_threads);
+        if (n_bands == 1)
+        {
+            copy_band(d, s, size, streaming);
+            return;
+        }
+
+        // bands end on line boundaries of the destination, so no line is written by two threads
+        const auto band_size = (size / n_bands + rs_copy_detail::Line - 1) & ~(rs_copy_detail::Line - 1);
+        pool.parallel_for(n_bands, [&](size_t band) {
+            const auto begin = std::min(size, band * band_size);
+            const auto end = band + 1 == n_bands ? size : std::min(size, begin + band_size);
+            copy_band(d + begin, s + begin, end - begin, streaming);
+        }, max_threads);
+    }
+
+    /* Copy rows of row_bytes between images of different strides, split
+     * across threads by rows as copy() splits bytes */
+    static void copy_rows(uint8_t* dst, size_t dst_stride, const uint8_t* src, size_t src_stride,
+        size_t row_bytes, size_t rows, unsigned int max_threads = 0)
+    {
+        if (dst_stride == row_bytes && src_stride == row_bytes)
+        {
+            copy(dst, src, row_bytes * rows, max_threads);
+            return;
+        }
+
+        const auto size = row_bytes * rows;
+        const bool streaming = size >= StreamThreshold;
+        auto& pool = RSWorkerPool::shared();
+        const auto n_bands = std::min(rows, bands(size, pool, max_threads));
+        const auto band_rows = (rows + n_bands - 1) / n_bands;
+        auto copy_band_rows = [&](size_t band) {
+            const auto end = std::min(rows, (band + 1) * band_rows);
+            for (size_t y = band * band_rows; y < end; ++y)
+                copy_band(dst + y * dst_stride, src + y * src_stride, row_bytes, streaming);
+        };
+
+        if (n_bands == 1)
+            copy_band_rows(0);
+        else
+            pool.parallel_for(n_bands, copy_band_rows, max_threads);
+    }
+
+    static const char* isa_name()
+    {
+        switch (rs_copy_detail::isa())
+        {
+            case rs_copy_detail::Isa::AVX512:
+                return "avx512f";
+            case rs_copy_detail::Isa::AVX2:
+                return "avx2";
+            case rs_copy_detail::Isa::SSE2:
+                return "sse2";
+            default:
+                return "scalar";
+        }
+    }
+
+private:
+    static size_t bands(size_t size, const RSWorkerPool& pool, unsigned int max_threads)
+    {
+        if (size < ParallelThreshold)
+            return 1;
+        const size_t threads = max_threads == 0 ? pool.size() + 1 : max_threads;
+        return std::max<size_t>(1, std::min(threads, size / MinBand));
+    }
+
+    static void copy_band(uint8_t* dst, const uint8_t* src, size_t size, bool streaming)
+    {
+        if (streaming)
+            rs_copy_detail::stream(dst, src, size);
+        else
+            std::memcpy(dst, src, size);
+    }
+};
+
+#endif // __GST_RSCOPY_H__
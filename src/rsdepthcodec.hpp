@@ -0,0 +1,353 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSDEPTHCODEC_H__
+#define __GST_RSDEPTHCODEC_H__
+
+#include <librealsense2/h/rs_types.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/* Every encoded frame starts with this header. Depth units and intrinsics
+ * travel with the frame so they survive files and IPC that drop metadata. */
+struct RSDepthCodecHeader
+{
+    static constexpr uint32_t Magic = 0x315a5352; // "RSZ1"
+    static constexpr uint32_t FlagRaw = 1;        // payload is uncompressed rows
+
+    uint32_t magic;
+    uint32_t flags;
+    int32_t width;
+    int32_t height;
+    uint32_t payload_size; // bytes following the header
+    float depth_units;     // 0 if unknown
+    rs2_intrinsics depth_intrinsics;
+};
+
+/* Lossless Z16 depth codec.
+ *
+ * Rows are split into runs as in RVL: a run of zero pixels, then a run of
+ * valid pixels, each length written as an Exp-Golomb code. Valid pixels are
+ * coded as the zigzagged difference to the previous valid pixel with a Rice
+ * code whose parameter follows the recent magnitude of the differences, as
+ * in LOCO-I, so sensor noise costs close to its entropy while holes are
+ * nearly free. Rows are coded independently. A frame that would not shrink
+ * is stored raw.
+ */
+class RSDepthCodec
+{
+public:
+    /* Size of the buffer encode() needs, header included. Rows are only
+     * checked against the raw size before they start, so this leaves room
+     * for one worst case row past that. */
+    static size_t max_encoded_size(int width, int height)
+    {
+        return sizeof(RSDepthCodecHeader) + static_cast<size_t>(width) * height * sizeof(uint16_t) +
+            static_cast<size_t>(width) * 8 + 16;
+    }
+
+    /* Encode into out, which holds max_encoded_size() bytes. Returns the
+     * number of bytes written. */
+    static size_t encode(const uint16_t* depth, int stride, int width, int height,
+        float depth_units, const rs2_intrinsics& intrinsics, uint8_t* out)
+    {
+        RSDepthCodecHeader header {};
+        header.magic = RSDepthCodecHeader::Magic;
+        header.width = width;
+        header.height = height;
+        header.depth_units = depth_units;
+        header.depth_intrinsics = intrinsics;
+
+        const size_t raw_size = static_cast<size_t>(width) * height * sizeof(uint16_t);
+        auto payload = out + sizeof(RSDepthCodecHeader);
+
+        // anything not smaller than the raw frame is stored raw
+        BitWriter w(reinterpret_cast<uint32_t*>(payload), raw_size / sizeof(uint32_t));
+        for (int y = 0; y < height && !w.full(); ++y)
+        {
+            const auto src = row(depth, stride, y);
+            int prev = 0;
+            uint32_t sum = InitialSum;
+            int x = 0;
+            while (x < width)
+            {
+                const int zeros_start = x;
+                while (x < width && src[x] == 0)
+                    ++x;
+                const int values_start = x;
+                while (x < width && src[x] != 0)
+                    ++x;
+
+                w.put_exp_golomb(values_start - zeros_start);
+                w.put_exp_golomb(x - values_start);
+                for (int i = values_start; i < x; ++i)
+                {
+                    const int delta = src[i] - prev;
+                    prev = src[i];
+                    const auto zz = (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31);
+                    w.put_rice(zz, rice_k(sum));
+                    sum += zz - (sum >> SumShift);
+                }
+            }
+        }
+        w.flush();
+
+        if (w.full())
+        {
+            header.flags = RSDepthCodecHeader::FlagRaw;
+            header.payload_size = static_cast<uint32_t>(raw_size);
+            for (int y = 0; y < height; ++y)
+                std::memcpy(payload + static_cast<size_t>(y) * width * sizeof(uint16_t),
+                    row(depth, stride, y), width * sizeof(uint16_t));
+        }
+        else
+        {
+            header.payload_size = static_cast<uint32_t>(w.size() * sizeof(uint32_t));
+        }
+
+        std::memcpy(out, &header, sizeof(header));
+        return sizeof(header) + header.payload_size;
+    }
+
+    /* Read and validate the header of an encoded frame */
+    static bool parse_header(const uint8_t* data, size_t size, RSDepthCodecHeader& header)
+    {
+        if (size < sizeof(RSDepthCodecHeader))
+            return false;
+        std::memcpy(&header, data, sizeof(header));
+        if (header.magic != RSDepthCodecHeader::Magic || header.width <= 0 || header.height <= 0 ||
+            header.width > UINT16_MAX || header.payload_size > size - sizeof(RSDepthCodecHeader))
+            return false;
+        return header.flags != RSDepthCodecHeader::FlagRaw ||
+            header.payload_size == static_cast<size_t>(header.width) * header.height * sizeof(uint16_t);
+    }
+
+    /* Decode a frame whose header was checked with parse_header() into rows
+     * of out_stride bytes. Returns false on a corrupt payload. */
+    static bool decode(const uint8_t* data, const RSDepthCodecHeader& header, uint16_t* out, int out_stride)
+    {
+        const auto payload = data + sizeof(RSDepthCodecHeader);
+        const int width = header.width;
+
+        if (header.flags == RSDepthCodecHeader::FlagRaw)
+        {
+            for (int y = 0; y < header.height; ++y)
+                std::memcpy(row(out, out_stride, y), payload + static_cast<size_t>(y) * width * sizeof(uint16_t),
+                    width * sizeof(uint16_t));
+            return true;
+        }
+
+        BitReader r(payload, header.payload_size);
+        for (int y = 0; y < header.height; ++y)
+        {
+            const auto dst = row(out, out_stride, y);
+            int prev = 0;
+            uint32_t sum = InitialSum;
+            int x = 0;
+            while (x < width)
+            {
+                const auto zeros = r.get_exp_golomb();
+                const auto values = r.get_exp_golomb();
+                const auto remaining = static_cast<uint32_t>(width - x);
+                if (r.error() || zeros > remaining || values > remaining - zeros || zeros + values == 0)
+                    return false;
+
+                std::memset(dst + x, 0, zeros * sizeof(uint16_t));
+                x += zeros;
+                for (const int end = x + values; x < end; ++x)
+                {
+                    const auto zz = r.get_rice(rice_k(sum));
+                    sum += zz - (sum >> SumShift);
+                    prev += static_cast<int>(zz >> 1) ^ -static_cast<int>(zz & 1);
+                    dst[x] = static_cast<uint16_t>(prev);
+                }
+                if (r.error())
+                    return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    // the Rice parameter follows a running sum of the last ~16 differences
+    static constexpr int SumShift = 4;
+    static constexpr uint32_t InitialSum = 4 << SumShift;
+    static constexpr int MaxK = 16;
+    // quotients from here on escape to the plain 17-bit value
+    static constexpr int Escape = 16;
+    static constexpr int EscapeBits = 17;
+
+    static int rice_k(uint32_t sum)
+    {
+        // smallest k with 2^k >= mean difference
+        const uint32_t mean = (sum + (1u << SumShift) - 1) >> SumShift;
+        return mean <= 1 ? 0 : std::min(MaxK, 32 - __builtin_clz(mean - 1));
+    }
+
+    template <typename T>
+    static T* row(T* data, int stride, int y)
+    {
+        using Byte = typename std::conditional<std::is_const<T>::value, const uint8_t, uint8_t>::type;
+        return reinterpret_cast<T*>(reinterpret_cast<Byte*>(data) + static_cast<size_t>(y) * stride);
+    }
+
+    /* Bits are packed LSB first into 32-bit words */
+    class BitWriter
+    {
+    public:
+        BitWriter(uint32_t* out, size_t capacity) : begin_(out), out_(out), end_(out + capacity) {}
+
+        bool full() const { return out_ >= end_; }
+        size_t size() const { return out_ - begin_; }
+
+        void put_exp_golomb(uint32_t value)
+        {
+            const uint32_t v = value + 1;
+            const int n = 31 - __builtin_clz(v); // bits after the leading one
+            put(1ull << n, n + 1);
+            put(v & ((1u << n) - 1), n);
+        }
+
+        void put_rice(uint32_t value, int k)
+        {
+            const uint32_t q = value >> k;
+            if (q < Escape)
+            {
+                put((1ull << q) | (static_cast<uint64_t>(value & ((1u << k) - 1)) << (q + 1)), q + 1 + k);
+            }
+            else
+            {
+                put(1ull << Escape, Escape + 1);
+                put(value, EscapeBits);
+            }
+        }
+
+        void flush()
+        {
+            if (fill_ > 0)
+                *out_++ = static_cast<uint32_t>(bits_);
+            bits_ = 0;
+            fill_ = 0;
+        }
+
+    private:
+        // n <= 32
+        void put(uint64_t code, int n)
+        {
+            bits_ |= code << fill_;
+            fill_ += n;
+            if (fill_ >= 32)
+            {
+                *out_++ = static_cast<uint32_t>(bits_);
+                bits_ >>= 32;
+                fill_ -= 32;
+            }
+        }
+
+        uint32_t* begin_;
+        uint32_t* out_;
+        uint32_t* end_;
+        uint64_t bits_ = 0;
+        int fill_ = 0;
+    };
+
+    class BitReader
+    {
+    public:
+        BitReader(const uint8_t* in, size_t size) : in_(in), end_(in + size) {}
+
+        bool error() const { return error_ || fill_ < padding_; }
+
+        uint32_t get_exp_golomb()
+        {
+            refill();
+            if ((bits_ & 0x1ffff) == 0)
+                return fail();
+            const int n = __builtin_ctzll(bits_);
+            consume(n + 1);
+            return ((1u << n) | get(n)) - 1;
+        }
+
+        uint32_t get_rice(int k)
+        {
+            refill();
+            if ((bits_ & ((1ull << (Escape + 1)) - 1)) == 0)
+                return fail();
+            const int q = __builtin_ctzll(bits_);
+            consume(q + 1);
+            refill();
+            return q < Escape ? (static_cast<uint32_t>(q) << k) | get(k) : get(EscapeBits);
+        }
+
+    private:
+        uint32_t fail()
+        {
+            error_ = true;
+            return 0;
+        }
+
+        // past the end the stream reads as zero words; using them is an error
+        void refill()
+        {
+            while (fill_ <= 32)
+            {
+                uint32_t word = 0;
+                if (in_ + sizeof(word) <= end_)
+                {
+                    std::memcpy(&word, in_, sizeof(word));
+                    in_ += sizeof(word);
+                }
+                else
+                {
+                    padding_ += 32;
+                }
+                bits_ |= static_cast<uint64_t>(word) << fill_;
+                fill_ += 32;
+            }
+        }
+
+        void consume(int n)
+        {
+            bits_ >>= n;
+            fill_ -= n;
+        }
+
+        // n <= 32, after a refill
+        uint32_t get(int n)
+        {
+            const auto v = static_cast<uint32_t>(bits_ & ((1ull << n) - 1));
+            consume(n);
+            return v;
+        }
+
+        const uint8_t* in_;
+        const uint8_t* end_;
+        uint64_t bits_ = 0;
+        int fill_ = 0;
+        int padding_ = 0;
+        bool error_ = false;
+    };
+};
+
+#endif // __GST_RSDEPTHCODEC_H__
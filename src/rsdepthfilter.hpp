@@ -0,0 +1,356 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSDEPTHFILTER_H__
+#define __GST_RSDEPTHFILTER_H__
+
+#include "rsworkers.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+enum HoleFilling { HoleFillingOff, HoleFillingLeft, HoleFillingFarthest, HoleFillingNearest };
+
+struct RSDepthFilterSettings
+{
+    int decimation = 1;          // 1 = off
+    bool spatial = false;
+    float spatial_alpha = 0.5f;  // weight of the current pixel
+    int spatial_delta = 20;      // edges are steps of more than delta depth units
+    int spatial_iterations = 2;
+    bool temporal = false;
+    float temporal_alpha = 0.4f; // weight of the current frame
+    int temporal_delta = 20;
+    int temporal_persistence = 0; // fill a hole from history if valid in that many of the last 8 frames, 0 = off
+    int hole_filling = HoleFillingOff;
+
+    bool any() const
+    {
+        return decimation > 1 || spatial || temporal || hole_filling != HoleFillingOff;
+    }
+};
+
+/* Native versions of the librealsense depth post-processing filters:
+ * decimation, edge-preserving spatial smoothing, temporal smoothing and
+ * hole filling, applied in that order.
+ *
+ * Everything except decimation works in place. Row passes run on row bands,
+ * the spatial filter's column passes on column bands, all on an
+ * RSWorkerPool. The temporal history is sized once per resolution.
+ */
+class RSDepthFilter
+{
+public:
+    static int decimated(int size, int factor)
+    {
+        return std::max(1, size / std::max(1, factor));
+    }
+
+    /* Reduce in by factor in both directions. Factors 2 and 3 take the
+     * median of the non-zero pixels of each block, larger ones their mean. */
+    void decimate(const uint16_t* in, int in_stride, int width, int height, int factor,
+        uint16_t* out, int out_stride, RSWorkerPool& pool, unsigned int max_threads = 0)
+    {
+        const int ow = decimated(width, factor);
+        const int oh = decimated(height, factor);
+        if (factor == 2)
+        {
+            decimate2(in, in_stride, out, out_stride, ow, oh, pool, max_threads);
+            return;
+        }
+        for_rows(oh, pool, max_threads, [&](int lo, int hi) {
+            uint16_t block[64];
+            for (int y = lo; y < hi; ++y)
+            {
+                auto orow = row(out, out_stride, y);
+                for (int x = 0; x < ow; ++x)
+                {
+                    int n = 0;
+                    uint32_t sum = 0;
+                    for (int by = 0; by < factor && y * factor + by < height; ++by)
+                    {
+                        const auto irow = row(in, in_stride, y * factor + by) + x * factor;
+                        for (int bx = 0; bx < factor && x * factor + bx < width; ++bx)
+                        {
+                            const auto z = irow[bx];
+                            if (z == 0)
+                                continue;
+                            sum += z;
+                            block[n++] = z;
+                        }
+                    }
+                    if (n == 0)
+                        orow[x] = 0;
+                    else if (factor <= 3)
+                    {
+                        // at most 9 values, insertion sort beats nth_element
+                        for (int i = 1; i < n; ++i)
+                        {
+                            const auto v = block[i];
+                            int j = i;
+                            for (; j > 0 && block[j - 1] > v; --j)
+                                block[j] = block[j - 1];
+                            block[j] = v;
+                        }
+                        orow[x] = block[n / 2];
+                    }
+                    else
+                        orow[x] = static_cast<uint16_t>(sum / n);
+                }
+            }
+        });
+    }
+
+    /* The common 2x2 case: sort each block with a branch free network. Zeros
+     * sort first, so the median of the n non-zero values is at 4 - n + n / 2. */
+    void decimate2(const uint16_t* in, int in_stride, uint16_t* out, int out_stride, int ow, int oh,
+        RSWorkerPool& pool, unsigned int max_threads)
+    {
+        for_rows(oh, pool, max_threads, [&](int lo, int hi) {
+            for (int y = lo; y < hi; ++y)
+            {
+                const auto r0 = row(in, in_stride, 2 * y);
+                const auto r1 = row(in, in_stride, 2 * y + 1);
+                auto orow = row(out, out_stride, y);
+                for (int x = 0; x < ow; ++x)
+                {
+                    uint16_t v[4] = {r0[2 * x], r0[2 * x + 1], r1[2 * x], r1[2 * x + 1]};
+                    const int n = (v[0] != 0) + (v[1] != 0) + (v[2] != 0) + (v[3] != 0);
+                    auto sort2 = [](uint16_t& a, uint16_t& b) {
+                        const auto lo = std::min(a, b);
+                        b = std::max(a, b);
+                        a = lo;
+                    };
+                    sort2(v[0], v[1]);
+                    sort2(v[2], v[3]);
+                    sort2(v[0], v[2]);
+                    sort2(v[1], v[3]);
+                    sort2(v[1], v[2]);
+                    orow[x] = n == 0 ? 0 : v[4 - n + n / 2];
+                }
+            }
+        });
+    }
+
+    /* Spatial, temporal and hole filling, in place */
+    void filter(uint16_t* data, int stride, int width, int height, const RSDepthFilterSettings& s,
+        RSWorkerPool& pool, unsigned int max_threads = 0)
+    {
+        if (s.spatial)
+            spatial(data, stride, width, height, s, pool, max_threads);
+        if (s.temporal)
+            temporal(data, stride, width, height, s, pool, max_threads);
+        if (s.hole_filling != HoleFillingOff)
+            fill_holes(data, stride, width, height, s.hole_filling, pool, max_threads);
+    }
+
+    /* Forget the temporal history, e.g. after a discontinuity */
+    void reset_history()
+    {
+        std::fill(history_.begin(), history_.end(), 0);
+        std::fill(valid_bits_.begin(), valid_bits_.end(), 0);
+    }
+
+private:
+    template <typename T>
+    static T* row(T* data, int stride, int y)
+    {
+        using byte = typename std::conditional<std::is_const<T>::value, const uint8_t, uint8_t>::type;
+        return reinterpret_cast<T*>(reinterpret_cast<byte*>(data) + static_cast<size_t>(y) * stride);
+    }
+
+    template <typename Fn>
+    static void for_rows(int rows, RSWorkerPool& pool, unsigned int max_threads, Fn&& fn)
+    {
+        const auto bands = pool.bands_for(rows, max_threads);
+        pool.parallel_for(bands, [&](size_t band) {
+            fn(static_cast<int>(band * rows / bands), static_cast<int>((band + 1) * rows / bands));
+        }, max_threads);
+    }
+
+    /* One step of the recursive edge-preserving filter. alpha is in 1/256
+     * units; branch free so the column passes vectorize. */
+    static inline uint16_t smooth(uint16_t cur, uint16_t prev, int alpha, int delta)
+    {
+        const int c = cur;
+        const int p = prev;
+        const int blended = (alpha * c + (256 - alpha) * p + 128) >> 8;
+        const bool use = c != 0 && p != 0 && (c - p < delta) && (p - c < delta);
+        return static_cast<uint16_t>(use ? blended : c);
+    }
+
+    static int fixed_alpha(float alpha)
+    {
+        return std::min(256, std::max(0, static_cast<int>(alpha * 256.f + 0.5f)));
+    }
+
+    void spatial(uint16_t* data, int stride, int width, int height, const RSDepthFilterSettings& s,
+        RSWorkerPool& pool, unsigned int max_threads)
+    {
+        const auto alpha = fixed_alpha(s.spatial_alpha);
+        const auto delta = s.spatial_delta;
+        for (int it = 0; it < s.spatial_iterations; ++it)
+        {
+            // horizontal passes, one row at a time
+            for_rows(height, pool, max_threads, [&](int lo, int hi) {
+                for (int y = lo; y < hi; ++y)
+                {
+                    auto r = row(data, stride, y);
+                    for (int x = 1; x < width; ++x)
+                        r[x] = smooth(r[x], r[x - 1], alpha, delta);
+                    for (int x = width - 2; x >= 0; --x)
+                        r[x] = smooth(r[x], r[x + 1], alpha, delta);
+                }
+            });
+
+            // vertical passes on tiles of whole cache lines, walking rows so
+            // memory is read in order
+            constexpr int tile = 64;
+            pool.parallel_for((width + tile - 1) / tile, [&](size_t t) {
+                const int c0 = static_cast<int>(t) * tile;
+                const int c1 = std::min(width, c0 + tile);
+                for (int y = 1; y < height; ++y)
+                {
+                    auto r = row(data, stride, y);
+                    const auto up = row(data, stride, y - 1);
+                    for (int x = c0; x < c1; ++x)
+                        r[x] = smooth(r[x], up[x], alpha, delta);
+                }
+                for (int y = height - 2; y >= 0; --y)
+                {
+                    auto r = row(data, stride, y);
+                    const auto down = row(data, stride, y + 1);
+                    for (int x = c0; x < c1; ++x)
+                        r[x] = smooth(r[x], down[x], alpha, delta);
+                }
+            }, max_threads);
+        }
+    }
+
+    void temporal(uint16_t* data, int stride, int width, int height, const RSDepthFilterSettings& s,
+        RSWorkerPool& pool, unsigned int max_threads)
+    {
+        const auto n = static_cast<size_t>(width) * height;
+        if (width != hist_width_ || height != hist_height_)
+        {
+            history_.assign(n, 0);
+            valid_bits_.assign(n, 0);
+            hist_width_ = width;
+            hist_height_ = height;
+        }
+
+        const auto alpha = fixed_alpha(s.temporal_alpha);
+        const auto delta = s.temporal_delta;
+        const auto persistence = s.temporal_persistence;
+        for_rows(height, pool, max_threads, [&](int lo, int hi) {
+            for (int y = lo; y < hi; ++y)
+            {
+                auto r = row(data, stride, y);
+                auto prev = history_.data() + static_cast<size_t>(y) * width;
+                auto bits = valid_bits_.data() + static_cast<size_t>(y) * width;
+                for (int x = 0; x < width; ++x)
+                {
+                    auto cur = r[x];
+                    bits[x] = static_cast<uint8_t>((bits[x] << 1) | (cur != 0));
+                    if (cur != 0)
+                        cur = smooth(cur, prev[x], alpha, delta);
+                    else if (persistence > 0 && __builtin_popcount(bits[x]) >= persistence)
+                        cur = prev[x];
+                    r[x] = cur;
+                    if (cur != 0)
+                        prev[x] = cur;
+                }
+            }
+        });
+    }
+
+    void fill_holes(uint16_t* data, int stride, int width, int height, int mode,
+        RSWorkerPool& pool, unsigned int max_threads)
+    {
+        if (mode == HoleFillingLeft)
+        {
+            for_rows(height, pool, max_threads, [&](int lo, int hi) {
+                for (int y = lo; y < hi; ++y)
+                {
+                    auto r = row(data, stride, y);
+                    uint16_t last = 0;
+                    for (int x = 0; x < width; ++x)
+                    {
+                        if (r[x] == 0)
+                            r[x] = last;
+                        else
+                            last = r[x];
+                    }
+                }
+            });
+            return;
+        }
+
+        // the neighbours must be read before any hole is filled
+        scratch_.resize(static_cast<size_t>(width) * height);
+        for_rows(height, pool, max_threads, [&](int lo, int hi) {
+            for (int y = lo; y < hi; ++y)
+                std::memcpy(scratch_.data() + static_cast<size_t>(y) * width, row(data, stride, y), sizeof(uint16_t) * width);
+        });
+
+        const bool farthest = mode == HoleFillingFarthest;
+        for_rows(height, pool, max_threads, [&](int lo, int hi) {
+            for (int y = lo; y < hi; ++y)
+            {
+                auto r = row(data, stride, y);
+                const auto src = scratch_.data() + static_cast<size_t>(y) * width;
+                for (int x = 0; x < width; ++x)
+                {
+                    if (src[x] != 0)
+                        continue;
+                    const uint16_t around[4] = {
+                        x > 0 ? src[x - 1] : uint16_t(0),
+                        x + 1 < width ? src[x + 1] : uint16_t(0),
+                        y > 0 ? src[x - width] : uint16_t(0),
+                        y + 1 < height ? src[x + width] : uint16_t(0)};
+                    uint16_t best = 0;
+                    for (auto z : around)
+                    {
+                        if (z == 0)
+                            continue;
+                        if (best == 0 || (farthest ? z > best : z < best))
+                            best = z;
+                    }
+                    r[x] = best;
+                }
+            }
+        });
+    }
+
+    // temporal history, one slot per pixel: the last non-zero output and
+    // which of the last 8 frames had depth there
+    std::vector<uint16_t> history_;
+    std::vector<uint8_t> valid_bits_;
+    int hist_width_ = 0;
+    int hist_height_ = 0;
+
+    std::vector<uint16_t> scratch_;
+};
+
+#endif // __GST_RSDEPTHFILTER_H__
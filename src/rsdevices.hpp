@@ -0,0 +1,159 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSDEVICES_H__
+#define __GST_RSDEVICES_H__
+
+#include <librealsense2/rs.hpp>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* What an element needs to know about a device before streaming from it */
+struct RSDeviceInfo
+{
+    bool has_imu = false;    // accel and gyro on the same device
+    float depth_units = 0.f; // meters per depth unit, 0 without a depth sensor
+};
+
+/* One rs2::context and device list for the whole process.
+ *
+ * Creating a context and enumerating devices takes hundreds of milliseconds,
+ * and walking every profile of every sensor for capabilities more, so
+ * elements that restart, and several elements in one process, share the
+ * results. Pipelines built on context() reuse the same enumeration. The
+ * cache is dropped when the SDK reports devices being added or removed.
+ */
+class RSDeviceCache
+{
+public:
+    /* Never destroyed, like RSWorkerPool::shared(), so the SDK callback
+     * can't outlive it. */
+    static RSDeviceCache& shared()
+    {
+        static auto cache = new RSDeviceCache();
+        return *cache;
+    }
+
+    RSDeviceCache(const RSDeviceCache&) = delete;
+    RSDeviceCache& operator=(const RSDeviceCache&) = delete;
+
+    rs2::context& context() { return ctx_; }
+
+    std::vector<rs2::device> devices()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!valid_)
+        {
+            devices_.clear();
+            for (auto&& dev : ctx_.query_devices())
+                devices_.push_back(dev);
+            valid_ = true;
+        }
+        return devices_;
+    }
+
+    /* Capabilities of a camera from devices(). The profile walk for
+     * has_imu is done once per serial number, depth units are read every
+     * time, as presets and other tools can change them. */
+    RSDeviceInfo info(const rs2::device& dev)
+    {
+        const std::string serial = dev.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER);
+        RSDeviceInfo info;
+        bool cached = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto it = imu_.find(serial);
+            if (it != imu_.end())
+            {
+                info.has_imu = it->second;
+                cached = true;
+            }
+        }
+        if (!cached)
+        {
+            info.has_imu = has_imu(dev);
+            std::lock_guard<std::mutex> lock(mutex_);
+            imu_[serial] = info.has_imu;
+        }
+        info.depth_units = depth_units(dev);
+        return info;
+    }
+
+    /* Uncached, for devices that are not cameras like playback and
+     * software devices */
+    static RSDeviceInfo probe(const rs2::device& dev)
+    {
+        RSDeviceInfo info;
+        info.has_imu = has_imu(dev);
+        info.depth_units = depth_units(dev);
+        return info;
+    }
+
+    /* Current depth units of the depth sensor, a single option read */
+    static float depth_units(const rs2::device& dev)
+    {
+        for (auto&& sensor : dev.query_sensors())
+        {
+            if (sensor.supports(RS2_OPTION_DEPTH_UNITS))
+                return sensor.get_option(RS2_OPTION_DEPTH_UNITS);
+        }
+        return 0.f;
+    }
+
+    /* Whether accel and gyro are on the device, from the stream profiles */
+    static bool has_imu(const rs2::device& dev)
+    {
+        bool found_accel = false;
+        bool found_gyro = false;
+        for (auto&& sensor : dev.query_sensors())
+        {
+            // motion streams all live on one sensor, skip the video sensors' long profile lists
+            if (sensor.is<rs2::depth_sensor>() || sensor.is<rs2::color_sensor>())
+                continue;
+            for (auto&& profile : sensor.get_stream_profiles())
+            {
+                found_accel |= profile.stream_type() == RS2_STREAM_ACCEL;
+                found_gyro |= profile.stream_type() == RS2_STREAM_GYRO;
+            }
+        }
+        return found_accel && found_gyro;
+    }
+
+private:
+    RSDeviceCache()
+    {
+        ctx_.set_devices_changed_callback([this](rs2::event_information&) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            valid_ = false;
+            imu_.clear();
+        });
+    }
+
+    rs2::context ctx_;
+    std::mutex mutex_;
+    std::vector<rs2::device> devices_;
+    bool valid_ = false;
+    std::map<std::string, bool> imu_; // has_imu() by serial number
+};
+
+#endif // __GST_RSDEVICES_H__
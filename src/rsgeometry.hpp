@@ -0,0 +1,353 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSGEOMETRY_H__
+#define __GST_RSGEOMETRY_H__
+
+#include <librealsense2/rsutil.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RS_GEOMETRY_X86 1
+#endif
+
+/* Depth camera geometry shared by rsalign and rspointcloud.
+ *
+ * Deprojecting a pixel through the (possibly distorted) intrinsics is the
+ * expensive part and it does not depend on the depth value, so RSRayLUT
+ * precomputes for every pixel the direction a such that a depth z lands at
+ * z * a in the target frame (after rotation). Per frame only z * a + t and,
+ * for registration, the pinhole projection remain, and those vectorize.
+ */
+
+inline bool rs_intrinsics_equal(const rs2_intrinsics& a, const rs2_intrinsics& b)
+{
+    return std::memcmp(&a, &b, sizeof(rs2_intrinsics)) == 0;
+}
+
+inline bool rs_extrinsics_equal(const rs2_extrinsics& a, const rs2_extrinsics& b)
+{
+    return std::memcmp(&a, &b, sizeof(rs2_extrinsics)) == 0;
+}
+
+inline rs2_extrinsics rs_identity_extrinsics()
+{
+    return rs2_extrinsics{{1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f}, {0.f, 0.f, 0.f}};
+}
+
+/* Projection in the vector kernels is pinhole only. Models whose forward
+ * projection ignores the coefficients, or all-zero coefficients, qualify. */
+inline bool rs_is_pinhole_projection(const rs2_intrinsics& intr)
+{
+    if (intr.model == RS2_DISTORTION_NONE || intr.model == RS2_DISTORTION_INVERSE_BROWN_CONRADY)
+        return true;
+    for (auto c : intr.coeffs)
+        if (c != 0.f)
+            return false;
+    return true;
+}
+
+/* Per pixel rays of one camera, rotated into another camera's frame. Stored
+ * as separate x, y, z planes so kernels can load 8 neighbours at once. */
+struct RSRayLUT
+{
+    int width = 0;
+    int height = 0;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+
+    /* Rays for a width x height grid of pixel positions (u + offset, v + offset)
+     * of intr, rotated by extr. offset -0.5 gives pixel corners. */
+    void build(const rs2_intrinsics& intr, const rs2_extrinsics& extr, int grid_width, int grid_height, float offset)
+    {
+        width = grid_width;
+        height = grid_height;
+        const auto n = static_cast<size_t>(width) * height;
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+
+        const auto r = extr.rotation; // column major
+        for (int v = 0; v < height; ++v)
+        {
+            for (int u = 0; u < width; ++u)
+            {
+                const float pixel[2] = {u + offset, v + offset};
+                float p[3];
+                rs2_deproject_pixel_to_point(p, &intr, pixel, 1.f);
+
+                const auto i = static_cast<size_t>(v) * width + u;
+                x[i] = r[0] * p[0] + r[3] * p[1] + r[6] * p[2];
+                y[i] = r[1] * p[0] + r[4] * p[1] + r[7] * p[2];
+                z[i] = r[2] * p[0] + r[5] * p[1] + r[8] * p[2];
+            }
+        }
+    }
+
+    const float* row_x(int v) const { return x.data() + static_cast<size_t>(v) * width; }
+    const float* row_y(int v) const { return y.data() + static_cast<size_t>(v) * width; }
+    const float* row_z(int v) const { return z.data() + static_cast<size_t>(v) * width; }
+};
+
+/* Coordinate written by project_row for pixels that do not project. Far
+ * enough out that rounding can never bring it back inside an image. */
+constexpr float RS_INVALID_PIXEL = -65536.f;
+
+/* Input for project_row: rays, raw depth and where to project. */
+struct RSProjectParams
+{
+    float depth_scale;        // raw depth units to meters
+    float t[3];               // translation into the target frame
+    rs2_intrinsics target;    // target camera
+};
+
+namespace rs_geometry_detail
+{
+    /* Writes RS_INVALID_PIXEL for pixels without depth or behind the target camera. */
+    inline void project_row_scalar(const float* ax, const float* ay, const float* az, const uint16_t* depth,
+        const RSProjectParams& p, int n, float* out_x, float* out_y)
+    {
+        const bool pinhole = rs_is_pinhole_projection(p.target);
+        for (int i = 0; i < n; ++i)
+        {
+            const float zm = depth[i] * p.depth_scale;
+            const float point[3] = {zm * ax[i] + p.t[0], zm * ay[i] + p.t[1], zm * az[i] + p.t[2]};
+            if (depth[i] == 0 || point[2] <= 0.f)
+            {
+                out_x[i] = out_y[i] = RS_INVALID_PIXEL;
+                continue;
+            }
+            if (pinhole)
+            {
+                out_x[i] = point[0] / point[2] * p.target.fx + p.target.ppx;
+                out_y[i] = point[1] / point[2] * p.target.fy + p.target.ppy;
+            }
+            else
+            {
+                float pixel[2];
+                rs2_project_point_to_pixel(pixel, &p.target, point);
+                out_x[i] = pixel[0];
+                out_y[i] = pixel[1];
+            }
+        }
+    }
+
+    /* Points z * a + t, no projection. */
+    inline void deproject_row_scalar(const float* ax, const float* ay, const float* az, const uint16_t* depth,
+        float depth_scale, const float t[3], int n, float* out_x, float* out_y, float* out_z)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            const float zm = depth[i] * depth_scale;
+            out_x[i] = zm * ax[i] + (depth[i] ? t[0] : 0.f);
+            out_y[i] = zm * ay[i] + (depth[i] ? t[1] : 0.f);
+            out_z[i] = zm * az[i] + (depth[i] ? t[2] : 0.f);
+        }
+    }
+
+#ifdef RS_GEOMETRY_X86
+    __attribute__((target("avx2,fma")))
+    inline void project_row_avx2(const float* ax, const float* ay, const float* az, const uint16_t* depth,
+        const RSProjectParams& p, int n, float* out_x, float* out_y)
+    {
+        const __m256 scale = _mm256_set1_ps(p.depth_scale);
+        const __m256 tx = _mm256_set1_ps(p.t[0]);
+        const __m256 ty = _mm256_set1_ps(p.t[1]);
+        const __m256 tz = _mm256_set1_ps(p.t[2]);
+        const __m256 fx = _mm256_set1_ps(p.target.fx);
+        const __m256 fy = _mm256_set1_ps(p.target.fy);
+        const __m256 ppx = _mm256_set1_ps(p.target.ppx);
+        const __m256 ppy = _mm256_set1_ps(p.target.ppy);
+        const __m256 invalid = _mm256_set1_ps(RS_INVALID_PIXEL);
+        const __m256 zero = _mm256_setzero_ps();
+
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m128i d16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + i));
+            const __m256 d = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(d16));
+            const __m256 zm = _mm256_mul_ps(d, scale);
+
+            const __m256 X = _mm256_fmadd_ps(zm, _mm256_loadu_ps(ax + i), tx);
+            const __m256 Y = _mm256_fmadd_ps(zm, _mm256_loadu_ps(ay + i), ty);
+            const __m256 Z = _mm256_fmadd_ps(zm, _mm256_loadu_ps(az + i), tz);
+
+            const __m256 valid = _mm256_and_ps(_mm256_cmp_ps(d, zero, _CMP_GT_OQ), _mm256_cmp_ps(Z, zero, _CMP_GT_OQ));
+            const __m256 inv_z = _mm256_div_ps(_mm256_set1_ps(1.f), Z);
+
+            const __m256 px = _mm256_fmadd_ps(_mm256_mul_ps(X, inv_z), fx, ppx);
+            const __m256 py = _mm256_fmadd_ps(_mm256_mul_ps(Y, inv_z), fy, ppy);
+
+            _mm256_storeu_ps(out_x + i, _mm256_blendv_ps(invalid, px, valid));
+            _mm256_storeu_ps(out_y + i, _mm256_blendv_ps(invalid, py, valid));
+        }
+        project_row_scalar(ax + i, ay + i, az + i, depth + i, p, n - i, out_x + i, out_y + i);
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void deproject_row_avx2(const float* ax, const float* ay, const float* az, const uint16_t* depth,
+        float depth_scale, const float t[3], int n, float* out_x, float* out_y, float* out_z)
+    {
+        const __m256 scale = _mm256_set1_ps(depth_scale);
+        const __m256 tx = _mm256_set1_ps(t[0]);
+        const __m256 ty = _mm256_set1_ps(t[1]);
+        const __m256 tz = _mm256_set1_ps(t[2]);
+        const __m256 zero = _mm256_setzero_ps();
+
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m128i d16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth + i));
+            const __m256 d = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(d16));
+            const __m256 zm = _mm256_mul_ps(d, scale);
+            const __m256 valid = _mm256_cmp_ps(d, zero, _CMP_GT_OQ);
+
+            _mm256_storeu_ps(out_x + i, _mm256_fmadd_ps(zm, _mm256_loadu_ps(ax + i), _mm256_and_ps(tx, valid)));
+            _mm256_storeu_ps(out_y + i, _mm256_fmadd_ps(zm, _mm256_loadu_ps(ay + i), _mm256_and_ps(ty, valid)));
+            _mm256_storeu_ps(out_z + i, _mm256_fmadd_ps(zm, _mm256_loadu_ps(az + i), _mm256_and_ps(tz, valid)));
+        }
+        deproject_row_scalar(ax + i, ay + i, az + i, depth + i, depth_scale, t, n - i, out_x + i, out_y + i, out_z + i);
+    }
+
+    __attribute__((target("sse4.1")))
+    inline void project_row_sse(const float* ax, const float* ay, const float* az, const uint16_t* depth,
+        const RSProjectParams& p, int n, float* out_x, float* out_y)
+    {
+        const __m128 scale = _mm_set1_ps(p.depth_scale);
+        const __m128 tx = _mm_set1_ps(p.t[0]);
+        const __m128 ty = _mm_set1_ps(p.t[1]);
+        const __m128 tz = _mm_set1_ps(p.t[2]);
+        const __m128 fx = _mm_set1_ps(p.target.fx);
+        const __m128 fy = _mm_set1_ps(p.target.fy);
+        const __m128 ppx = _mm_set1_ps(p.target.ppx);
+        const __m128 ppy = _mm_set1_ps(p.target.ppy);
+        const __m128 invalid = _mm_set1_ps(RS_INVALID_PIXEL);
+        const __m128 zero = _mm_setzero_ps();
+
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            const __m128i d16 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth + i));
+            const __m128 d = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(d16));
+            const __m128 zm = _mm_mul_ps(d, scale);
+
+            const __m128 X = _mm_add_ps(_mm_mul_ps(zm, _mm_loadu_ps(ax + i)), tx);
+            const __m128 Y = _mm_add_ps(_mm_mul_ps(zm, _mm_loadu_ps(ay + i)), ty);
+            const __m128 Z = _mm_add_ps(_mm_mul_ps(zm, _mm_loadu_ps(az + i)), tz);
+
+            const __m128 valid = _mm_and_ps(_mm_cmpgt_ps(d, zero), _mm_cmpgt_ps(Z, zero));
+            const __m128 inv_z = _mm_div_ps(_mm_set1_ps(1.f), Z);
+
+            const __m128 px = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(X, inv_z), fx), ppx);
+            const __m128 py = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(Y, inv_z), fy), ppy);
+
+            _mm_storeu_ps(out_x + i, _mm_blendv_ps(invalid, px, valid));
+            _mm_storeu_ps(out_y + i, _mm_blendv_ps(invalid, py, valid));
+        }
+        project_row_scalar(ax + i, ay + i, az + i, depth + i, p, n - i, out_x + i, out_y + i);
+    }
+#endif
+
+    enum class Isa { Scalar, SSE, AVX2 };
+
+    inline Isa detect_isa()
+    {
+#ifdef RS_GEOMETRY_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return Isa::AVX2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return Isa::SSE;
+#endif
+        return Isa::Scalar;
+    }
+
+    inline Isa isa()
+    {
+        static const Isa detected = detect_isa();
+        return detected;
+    }
+}
+
+class RSGeometry
+{
+public:
+    /* Project n depth pixels with rays (ax, ay, az) into p.target. Pixels with
+     * no depth, or that land behind the target camera, get RS_INVALID_PIXEL. */
+    static void project_row(const float* ax, const float* ay, const float* az, const uint16_t* depth,
+        const RSProjectParams& p, int n, float* out_x, float* out_y)
+    {
+        using namespace rs_geometry_detail;
+        if (!rs_is_pinhole_projection(p.target))
+        {
+            project_row_scalar(ax, ay, az, depth, p, n, out_x, out_y);
+            return;
+        }
+        switch (isa())
+        {
+#ifdef RS_GEOMETRY_X86
+            case Isa::AVX2:
+                project_row_avx2(ax, ay, az, depth, p, n, out_x, out_y);
+                return;
+            case Isa::SSE:
+                project_row_sse(ax, ay, az, depth, p, n, out_x, out_y);
+                return;
+#endif
+            default:
+                project_row_scalar(ax, ay, az, depth, p, n, out_x, out_y);
+                return;
+        }
+    }
+
+    /* 3D points of n depth pixels, z * a + t. Pixels with no depth give (0, 0, 0). */
+    static void deproject_row(const float* ax, const float* ay, const float* az, const uint16_t* depth,
+        float depth_scale, const float t[3], int n, float* out_x, float* out_y, float* out_z)
+    {
+        using namespace rs_geometry_detail;
+#ifdef RS_GEOMETRY_X86
+        if (isa() == Isa::AVX2)
+        {
+            deproject_row_avx2(ax, ay, az, depth, depth_scale, t, n, out_x, out_y, out_z);
+            return;
+        }
+#endif
+        deproject_row_scalar(ax, ay, az, depth, depth_scale, t, n, out_x, out_y, out_z);
+    }
+
+    static const char* isa_name()
+    {
+        switch (rs_geometry_detail::isa())
+        {
+            case rs_geometry_detail::Isa::AVX2:
+                return "avx2";
+            case rs_geometry_detail::Isa::SSE:
+                return "sse4.1";
+            default:
+                return "scalar";
+        }
+    }
+};
+
+#endif // __GST_RSGEOMETRY_H__
@@ -0,0 +1,209 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSIMU_H__
+#define __GST_RSIMU_H__
+
+#include <librealsense2/h/rs_types.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <mutex>
+
+/* IMU samples of one muxed buffer: accel x, y, z then gyro x, y, z per
+ * sample, sample i taken at first_timestamp + i / rate. */
+struct RSImuBatch
+{
+    static constexpr size_t Channels = 6;
+    static constexpr size_t MaxSamples = 256; // 400 Hz down to 2 fps video
+
+    std::array<float, MaxSamples * Channels> samples;
+    size_t count = 0;
+    double first_timestamp = 0; // ms, SDK time domain
+
+    static constexpr size_t max_bytes() { return MaxSamples * Channels * sizeof(float); }
+    size_t bytes() const { return count * Channels * sizeof(float); }
+};
+
+/* Collects every accel and gyro sample from the motion sensor callback and
+ * resamples both onto one uniform grid at the faster of the two rates, so
+ * the IMU stream is regular 6 channel audio. Each stream is linearly
+ * interpolated between the two samples around a grid point.
+ *
+ * push_accel()/push_gyro() run on the SDK callback thread and pop() on the
+ * streaming thread. Storage is fixed, nothing allocates after construction.
+ */
+class RSImuBatcher
+{
+public:
+    explicit RSImuBatcher(int rate) : period_(1000.0 / std::max(1, rate)), rate_(std::max(1, rate)) {}
+
+    int rate() const { return rate_; }
+
+    void push_accel(double timestamp, const rs2_vector& v) { push(accel_, timestamp, v); }
+    void push_gyro(double timestamp, const rs2_vector& v) { push(gyro_, timestamp, v); }
+
+    /* Move up to RSImuBatch::MaxSamples of the oldest resampled samples into
+     * batch. Samples nobody popped in time are dropped, oldest first. */
+    void pop(RSImuBatch& batch)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        batch.count = std::min(out_count_, RSImuBatch::MaxSamples);
+        batch.first_timestamp = out_first_;
+        for (size_t i = 0; i < batch.count; ++i)
+        {
+            const auto src = &out_[((out_begin_ + i) % OutCapacity) * RSImuBatch::Channels];
+            std::copy(src, src + RSImuBatch::Channels, &batch.samples[i * RSImuBatch::Channels]);
+        }
+        drop_output(batch.count);
+    }
+
+    /* Resampled samples lost because nobody popped them */
+    size_t dropped() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return dropped_;
+    }
+
+private:
+    static constexpr size_t HistoryCapacity = 64; // room for a burst of one stream
+    static constexpr size_t OutCapacity = 4 * RSImuBatch::MaxSamples;
+    // a longer silence on either stream restarts the grid
+    static constexpr double MaxGap = 100.0; // ms
+
+    struct Sample
+    {
+        double t;
+        rs2_vector v;
+    };
+
+    struct History
+    {
+        std::array<Sample, HistoryCapacity> samples;
+        size_t begin = 0;
+        size_t size = 0;
+
+        const Sample& operator[](size_t i) const { return samples[(begin + i) % HistoryCapacity]; }
+        const Sample& back() const { return (*this)[size - 1]; }
+        void pop_front()
+        {
+            begin = (begin + 1) % HistoryCapacity;
+            --size;
+        }
+        void push_back(const Sample& s)
+        {
+            if (size == HistoryCapacity)
+                pop_front();
+            samples[(begin + size) % HistoryCapacity] = s;
+            ++size;
+        }
+        void clear() { begin = size = 0; }
+    };
+
+    void push(History& history, double timestamp, const rs2_vector& v)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (history.size > 0 && (timestamp <= history.back().t || timestamp - history.back().t > MaxGap))
+        {
+            // out of order or after a stall, start over from here
+            accel_.clear();
+            gyro_.clear();
+            started_ = false;
+        }
+        history.push_back({timestamp, v});
+        emit();
+    }
+
+    // both streams start before the grid does
+    void emit()
+    {
+        if (accel_.size == 0 || gyro_.size == 0)
+            return;
+        if (!started_)
+        {
+            next_ = std::max(accel_[0].t, gyro_[0].t);
+            drop_output(out_count_);
+            started_ = true;
+        }
+
+        const auto end = std::min(accel_.back().t, gyro_.back().t);
+        for (; next_ <= end; next_ += period_)
+        {
+            if (out_count_ == OutCapacity)
+            {
+                drop_output(1);
+                ++dropped_;
+            }
+            if (out_count_ == 0)
+                out_first_ = next_;
+            auto dst = &out_[((out_begin_ + out_count_) % OutCapacity) * RSImuBatch::Channels];
+            interpolate(accel_, next_, dst);
+            interpolate(gyro_, next_, dst + 3);
+            ++out_count_;
+        }
+    }
+
+    // history[0].t <= t <= history.back().t
+    static void interpolate(History& history, double t, float* dst)
+    {
+        while (history.size > 1 && history[1].t <= t)
+            history.pop_front();
+
+        const auto& a = history[0];
+        if (history.size == 1)
+        {
+            dst[0] = a.v.x;
+            dst[1] = a.v.y;
+            dst[2] = a.v.z;
+            return;
+        }
+        const auto& b = history[1];
+        // a lagging stream can overrun the history, never extrapolate
+        const auto w = static_cast<float>(std::max(0.0, (t - a.t) / (b.t - a.t)));
+        dst[0] = a.v.x + w * (b.v.x - a.v.x);
+        dst[1] = a.v.y + w * (b.v.y - a.v.y);
+        dst[2] = a.v.z + w * (b.v.z - a.v.z);
+    }
+
+    void drop_output(size_t n)
+    {
+        out_begin_ = (out_begin_ + n) % OutCapacity;
+        out_count_ -= n;
+        out_first_ += n * period_;
+    }
+
+    const double period_; // ms
+    const int rate_;
+
+    mutable std::mutex mutex_;
+    History accel_;
+    History gyro_;
+    bool started_ = false;
+    double next_ = 0; // time of the next grid point
+
+    std::array<float, OutCapacity * RSImuBatch::Channels> out_;
+    size_t out_begin_ = 0;
+    size_t out_count_ = 0;
+    double out_first_ = 0; // time of out_[out_begin_]
+    size_t dropped_ = 0;
+};
+
+#endif // __GST_RSIMU_H__
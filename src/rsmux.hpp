@@ -22,72 +22,344 @@
 #define __GST_RSMUX_H__
 
 #include <gst/gst.h>
+#include <gst/audio/audio.h>
 #include <gst/video/video.h>
 
 #include <librealsense2/rs.hpp>
 
 #include "common.hpp"
+#include "rscopy.hpp"
+#include "rsimu.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <tuple>
 #include <cstring>
 
 using buf_tuple = std::tuple<GstBuffer*, GstBuffer*, GstBuffer*>;
 
+/* Caps of a muxed stream for pad templates. Elements reading one also take
+ * the video/x-raw caps older sources gave it. */
+#define RS_MUX_CAPS "video/x-realsense-mux, version = (int) 2"
+
+/* Source is realsensesrc or a realsensemultisrc pad: anything with
+ * stream_type, gst_stride and imu_active that the GST_*_OBJECT macros take. */
 class RSMux 
 {
 public:
+    static constexpr const char* CapsName = "video/x-realsense-mux";
+
+    /* SDK format of a color-format property value */
+    static rs2_format rs_format(ColorFormat fmt)
+    {
+        switch (fmt)
+        {
+            case ColorFormat::ColorBGR8:
+                return RS2_FORMAT_BGR8;
+            case ColorFormat::ColorRGBA8:
+                return RS2_FORMAT_RGBA8;
+            case ColorFormat::ColorBGRA8:
+                return RS2_FORMAT_BGRA8;
+            case ColorFormat::ColorYUYV:
+                return RS2_FORMAT_YUYV;
+            default:
+                return RS2_FORMAT_RGB8;
+        }
+    }
+
+    /* GStreamer format of the frames of an SDK stream profile */
+    static GstVideoFormat video_format(rs2_format fmt)
+    {
+        switch (fmt)
+        {
+            case RS2_FORMAT_RGB8:
+                return GST_VIDEO_FORMAT_RGB;
+            case RS2_FORMAT_BGR8:
+                return GST_VIDEO_FORMAT_BGR;
+            case RS2_FORMAT_RGBA8:
+                return GST_VIDEO_FORMAT_RGBA;
+            case RS2_FORMAT_BGRA8:
+                return GST_VIDEO_FORMAT_BGRA;
+            case RS2_FORMAT_Z16:
+            case RS2_FORMAT_RAW16:
+            case RS2_FORMAT_Y16:
+                return G_BYTE_ORDER == G_LITTLE_ENDIAN ? GST_VIDEO_FORMAT_GRAY16_LE : GST_VIDEO_FORMAT_GRAY16_BE;
+            case RS2_FORMAT_YUYV:
+                return GST_VIDEO_FORMAT_YUY2;
+            case RS2_FORMAT_UYVY:
+                return GST_VIDEO_FORMAT_UYVY;
+            default:
+                return GST_VIDEO_FORMAT_UNKNOWN;
+        }
+    }
+
+    /* Caps of a muxed stream of the geometry header describes */
+    static GstCaps* caps(const RSHeader& header, bool imu)
+    {
+        return gst_caps_new_simple(CapsName,
+            "version", G_TYPE_INT, RSMuxPrefix::Version,
+            "color-format", G_TYPE_STRING, gst_video_format_to_string(static_cast<GstVideoFormat>(header.color_format)),
+            "color-width", G_TYPE_INT, header.color_width,
+            "color-height", G_TYPE_INT, header.color_height,
+            "depth-format", G_TYPE_STRING, gst_video_format_to_string(static_cast<GstVideoFormat>(header.depth_format)),
+            "depth-width", G_TYPE_INT, header.depth_width,
+            "depth-height", G_TYPE_INT, header.depth_height,
+            "imu", G_TYPE_BOOLEAN, imu,
+            "framerate", GST_TYPE_FRACTION, header.color_fps, 1,
+            NULL);
+    }
+
+    static bool is_mux_caps(const GstCaps* caps)
+    {
+        return gst_caps_get_size(caps) > 0 && gst_structure_has_name(gst_caps_get_structure(caps, 0), CapsName);
+    }
+
+    /* Parameters that give memory whose planes land on RSMuxAlign */
+    static GstAllocationParams allocation_params()
+    {
+        GstAllocationParams params;
+        gst_allocation_params_init(&params);
+        params.align = RSMuxAlign - 1;
+        return params;
+    }
+
+    static constexpr gsize align_up(gsize size, gsize align = RSMuxAlign)
+    {
+        return (size + align - 1) / align * align;
+    }
+
+    /* Prefix of a buffer holding planes of these sizes, 0 for a stream
+     * left out. Planes start at multiples of align after start: RSMuxAlign
+     * when mux() copies them, 1 when each is its own memory and the plane
+     * boundaries are the memory boundaries. */
+    static RSMuxPrefix layout(const RSHeader& header, gsize color_sz, gsize depth_sz, gsize imu_sz,
+        gsize align = RSMuxAlign, gsize start = align_up(sizeof(RSMuxPrefix)))
+    {
+        RSMuxPrefix prefix {};
+        prefix.magic = RSMuxPrefix::Magic;
+        prefix.version = RSMuxPrefix::Version;
+        prefix.size = static_cast<uint32_t>(start);
+        prefix.n_planes = RSMuxPlanes;
+        prefix.header = header;
+
+        const gsize sizes[RSMuxPlanes] = {color_sz, depth_sz, imu_sz};
+        const int32_t strides[RSMuxPlanes] = {header.color_stride, header.depth_stride, 0};
+        const int64_t pts_offsets[RSMuxPlanes] = {0, header.depth_offset, header.imu_offset};
+        gsize offset = start;
+        for (int i = 0; i < RSMuxPlanes; ++i)
+        {
+            offset = align_up(offset, align);
+            prefix.planes[i] = {offset, sizes[i], sizes[i] > 0 ? strides[i] : 0, 0, pts_offsets[i]};
+            offset += sizes[i];
+        }
+        return prefix;
+    }
+
+    /* Bytes a buffer with this layout takes */
+    static gsize layout_size(const RSMuxPrefix& prefix)
+    {
+        const auto& last = prefix.planes[RSMuxPlanes - 1];
+        return last.offset + last.size;
+    }
+
+    /* Header and planes of a buffer that starts with an RSHeaderV1, as
+     * sources before RSMuxPrefix wrote them: color, depth, then one accel
+     * and one gyro rs2_vector when IMU was on. Fields V1 lacks are zero,
+     * but for the single IMU sample, at the rate rsdemux gave it then. */
+    static RSMuxPrefix legacy_layout(const RSHeaderV1& v1)
+    {
+        RSHeader header {};
+        header.color_height = v1.color_height;
+        header.color_width = v1.color_width;
+        header.color_stride = v1.color_stride;
+        header.color_format = v1.color_format;
+        header.depth_height = v1.depth_height;
+        header.depth_width = v1.depth_width;
+        header.depth_stride = v1.depth_stride;
+        header.depth_format = v1.depth_format;
+        header.accel_format = v1.accel_format;
+        header.gyro_format = v1.gyro_format;
+
+        const gsize color_sz = static_cast<gsize>(std::max(0, header.color_height)) * std::max(0, header.color_stride);
+        const gsize depth_sz = static_cast<gsize>(std::max(0, header.depth_height)) * std::max(0, header.depth_stride);
+        gsize imu_sz = 0;
+        if (header.accel_format != GST_AUDIO_FORMAT_UNKNOWN && header.gyro_format != GST_AUDIO_FORMAT_UNKNOWN)
+        {
+            static_assert(2 * sizeof(rs2_vector) == RSImuBatch::Channels * sizeof(float),
+                "a V1 IMU section is one RSImuBatch sample");
+            imu_sz = 2 * sizeof(rs2_vector);
+            header.imu_count = 1;
+            header.imu_rate = GST_AUDIO_DEF_RATE;
+        }
+
+        auto prefix = layout(header, color_sz, depth_sz, imu_sz, 1, sizeof(RSHeaderV1));
+        prefix.version = 1;
+        return prefix;
+    }
+
+    /* Every plane of the prefix lies within size bytes. Offsets and sizes
+     * come from the wire, so the sum is not formed before the compare. */
+    static bool planes_fit(const RSMuxPrefix& prefix, gsize size)
+    {
+        for (const auto& plane : prefix.planes)
+        {
+            if (plane.offset > size || plane.size > size - plane.offset)
+                return false;
+        }
+        return true;
+    }
+
+    /* Header of a muxed buffer, and where its planes are in prefix when
+     * given. Buffers without an RSMuxPrefix are read in the older layout. */
     template <typename Element>
-    static RSHeader GetRSHeader(Element* src, GstBuffer* buffer)
-    {               
-        RSHeader header;
-        RSHeader* in;
-        GstMapInfo map;
-        gst_buffer_map(buffer, &map, GST_MAP_READ);
-        in = reinterpret_cast<RSHeader*>(map.data);
-
-        header.color_height = in->color_height;
-        header.color_width = in->color_width;
-        header.color_stride = in->color_stride;
-        header.color_format = in->color_format;
-        header.depth_height = in->depth_height;
-        header.depth_width = in->depth_width;
-        header.depth_stride = in->depth_stride;
-        header.depth_format = in->depth_format;
-        header.accel_format = in->accel_format;
-        header.gyro_format = in->gyro_format;
-        
-        gst_buffer_unmap(buffer, &map);
+    static RSHeader GetRSHeader(Element* src, GstBuffer* buffer, RSMuxPrefix* prefix = nullptr)
+    {
+        RSMuxPrefix p {};
 
-        return header;
+        // Only the start is read, so a multi-memory buffer is not merged
+        const auto read = gst_buffer_extract(buffer, 0, &p, sizeof(p));
+        if (read >= sizeof(p.magic) && p.magic == RSMuxPrefix::Magic)
+        {
+            if (read < sizeof(p) || p.version != RSMuxPrefix::Version || p.n_planes < RSMuxPlanes ||
+                p.size < sizeof(p))
+            {
+                GST_WARNING_OBJECT(src, "Unsupported muxed buffer, version %u", p.version);
+                p = {};
+            }
+            else if (!planes_fit(p, gst_buffer_get_size(buffer)))
+            {
+                GST_WARNING_OBJECT(src, "Buffer of %" G_GSIZE_FORMAT " bytes too small for its muxed planes",
+                    gst_buffer_get_size(buffer));
+                p = {};
+            }
+        }
+        else if (read < sizeof(RSHeaderV1))
+        {
+            GST_WARNING_OBJECT(src, "Buffer too small for RSHeaderV1");
+            p = {};
+        }
+        else
+        {
+            RSHeaderV1 v1;
+            std::memcpy(&v1, &p, sizeof(v1));
+            p = legacy_layout(v1);
+            if (layout_size(p) > gst_buffer_get_size(buffer))
+            {
+                GST_WARNING_OBJECT(src, "Buffer of %" G_GSIZE_FORMAT " bytes too small for its RSHeaderV1 planes",
+                    gst_buffer_get_size(buffer));
+                p = {};
+            }
+        }
+
+        if (prefix != nullptr)
+            *prefix = p;
+        return p.header;
+    }
+
+    /* The only frame carried in StreamColor and StreamDepth modes */
+    template <typename Source>
+    static rs2::video_frame single_frame(rs2::frameset& frame_set, const Source* src)
+    {
+        if (src->stream_type == StreamType::StreamColor)
+            return frame_set.get_color_frame();
+        return frame_set.get_depth_frame();
+    }
+
+    /* Copy frame rows into dst laid out with dst_stride. Returns bytes written. */
+    static size_t copy_plane(guint8* dst, int dst_stride, const rs2::video_frame& frame)
+    {
+        const auto rs_stride = frame.get_stride_in_bytes();
+        const auto height = frame.get_height();
+        const auto data = static_cast<const guint8*>(frame.get_data());
+
+        if (dst_stride == rs_stride)
+            RSCopy::copy(dst, data, static_cast<size_t>(height) * rs_stride);
+        else
+            RSCopy::copy_rows(dst, dst_stride, data, rs_stride, std::min(dst_stride, rs_stride), height);
+        return static_cast<size_t>(height) * dst_stride;
     }
 
-    static GstBuffer* mux(rs2::frameset& frame_set, const RSHeader& header, const GstRealsenseSrc* src)
+    /* Upstream event rsdemux sends when the set of streams it has consumers
+     * for changes. sender names the consumer, so a source feeding several
+     * can keep what any of them still wants. */
+    static constexpr const char* StreamsEventName = "realsense-streams";
+
+    static GstEvent* streams_event(const gchar* sender, int streams)
+    {
+        return gst_event_new_custom(GST_EVENT_CUSTOM_UPSTREAM,
+            gst_structure_new(StreamsEventName, "sender", G_TYPE_STRING, sender,
+                "streams", G_TYPE_INT, streams, NULL));
+    }
+
+    /* True if event is a streams event. Its StreamBits go to streams and
+     * the sender, valid as long as the event, to sender. */
+    static bool parse_streams_event(GstEvent* event, int* streams, const gchar** sender)
+    {
+        if (GST_EVENT_TYPE(event) != GST_EVENT_CUSTOM_UPSTREAM || !gst_event_has_name(event, StreamsEventName))
+            return false;
+        const auto s = gst_event_get_structure(event);
+        *sender = gst_structure_get_string(s, "sender");
+        return *sender != nullptr && gst_structure_get_int(s, "streams", streams);
+    }
+
+    /* Layout RSMux::mux writes for this frame_set, leaving out the sections
+     * of header.skipped */
+    template <typename Source>
+    static RSMuxPrefix mux_layout(rs2::frameset& frame_set, const RSHeader& header, const Source* src,
+        const RSImuBatch* imu = nullptr)
+    {
+        const gsize color_sz = (header.skipped & StreamBitColor) ? 0 :
+            static_cast<gsize>(frame_set.get_color_frame().get_height()) * src->gst_stride;
+        const gsize depth_sz = (header.skipped & StreamBitDepth) ? 0 : frame_set.get_depth_frame().get_data_size();
+        const gsize imu_sz = src->imu_active && imu != nullptr && !(header.skipped & StreamBitImu) ? imu->bytes() : 0;
+        return layout(header, color_sz, depth_sz, imu_sz);
+    }
+
+    /* Number of bytes RSMux::mux will write for this frame_set */
+    template <typename Source>
+    static size_t buffer_size(rs2::frameset& frame_set, const RSHeader& header, const Source* src,
+        const RSImuBatch* imu = nullptr)
+    {
+        // single stream modes carry only the frame, exactly as the caps describe it
+        if (src->stream_type != StreamType::StreamMux)
+            return static_cast<size_t>(single_frame(frame_set, src).get_height() * src->gst_stride);
+        return layout_size(mux_layout(frame_set, header, src, imu));
+    }
+
+    /* Mux frame_set into buffer. If buffer is nullptr or too small a new one 
+     * is allocated. Takes ownership of buffer. The prefix and imu are only
+     * written in StreamMux mode, and the streams in header.skipped are not. */
+    template <typename Source>
+    static GstBuffer* mux(rs2::frameset& frame_set, const RSHeader& header, const Source* src, 
+        GstBuffer* buffer = nullptr, const RSImuBatch* imu = nullptr)
     {
         GstMapInfo minfo;
-        GstBuffer *buffer;
 
-        auto cframe = frame_set.get_color_frame();
-        auto color_sz = static_cast<size_t>(cframe.get_height() * src->gst_stride);
-        auto depth = frame_set.get_depth_frame();
-        auto depth_sz = static_cast<size_t>(depth.get_data_size());
-        
-        int imu_sz = 0;
-        rs2::frame accel_frame;
-        rs2::frame gyro_frame;
-        if(src->imu_on)
+        const auto buffer_sz = buffer_size(frame_set, header, src, imu);
+        if (buffer != nullptr)
         {
-            accel_frame = frame_set.first_or_default(RS2_STREAM_ACCEL);
-            gyro_frame = frame_set.first_or_default(RS2_STREAM_GYRO);
-            imu_sz = accel_frame.get_data_size() + gyro_frame.get_data_size();
+            gsize maxsize = 0;
+            gst_buffer_get_sizes(buffer, nullptr, &maxsize);
+            if (maxsize < buffer_sz)
+            {
+                GST_WARNING_OBJECT(src, "Pooled buffer too small (%lu < %lu), allocating", maxsize, buffer_sz);
+                gst_buffer_unref(buffer);
+                buffer = nullptr;
+            }
+            else
+            {
+                gst_buffer_set_size(buffer, buffer_sz);
+            }
         }
-        constexpr auto header_sz = sizeof(RSHeader);
 
-        const auto buffer_sz = header_sz + color_sz + depth_sz + imu_sz + 1;
-        buffer = gst_buffer_new_and_alloc(buffer_sz);
         if (buffer == nullptr)
         {
-            GST_ELEMENT_ERROR (src, RESOURCE, FAILED, ("failed to allocate buffer"), (NULL));
+            auto params = allocation_params();
+            buffer = gst_buffer_new_allocate(nullptr, buffer_sz, &params);
+        }
+        if (buffer == nullptr)
+        {
+            GST_ERROR_OBJECT(src, "failed to allocate buffer");
             
             throw new std::runtime_error("failed to allocate buffer");
         }
@@ -95,102 +367,226 @@ public:
 
         GST_LOG_OBJECT(src,
                        "GstBuffer size=%lu, gst_stride=%d, frame_num=%llu",
-                       minfo.size, src->gst_stride, cframe.get_frame_number());
-        GST_LOG_OBJECT(src, "Buffer timestamp %f", cframe.get_timestamp());
-
-        std::memcpy(minfo.data, &header, sizeof(header));
+                       minfo.size, src->gst_stride, frame_set.get_frame_number());
+        GST_LOG_OBJECT(src, "Buffer timestamp %f", frame_set.get_timestamp());
 
-        // TODO refactor this section into cleaner code
-        // NOTE We're always StreamMux now. If color or depth is off, then those portions will be 0
-        // if(src->stream_type == StreamType::StreamColor || src->stream_type == StreamType::StreamMux)
-        // {
-        int rs_stride = 0;
-        auto outdata = minfo.data + sizeof(RSHeader);
-        rs_stride = cframe.get_stride_in_bytes();
-        if (src->gst_stride == rs_stride)
+        if (src->stream_type != StreamType::StreamMux)
         {
-            std::memcpy(outdata, ((guint8 *)cframe.get_data()), color_sz);
-            outdata += color_sz;
+            copy_plane(minfo.data, src->gst_stride, single_frame(frame_set, src));
+            gst_buffer_unmap(buffer, &minfo);
+            return buffer;
         }
-        else
+
+        const auto prefix = mux_layout(frame_set, header, src, imu);
+        std::memcpy(minfo.data, &prefix, sizeof(prefix));
+        std::memset(minfo.data + sizeof(prefix), 0, prefix.size - sizeof(prefix));
+
+        const auto& color = prefix.planes[RSMuxColor];
+        if (color.size > 0)
         {
-            int i;
-            GST_INFO_OBJECT(src, "Image strides not identical, copy will be slower.");
-            for (i = 0; i < src->height; i++)
-            {
-                std::memcpy(outdata,
-                       ((guint8 *)cframe.get_data()) + i * rs_stride,
-                       rs_stride);
-                outdata += src->gst_stride;
-            }
+            auto cframe = frame_set.get_color_frame();
+            if (cframe.get_stride_in_bytes() != src->gst_stride)
+                GST_INFO_OBJECT(src, "Image strides not identical, copy will be slower.");
+            copy_plane(minfo.data + color.offset, src->gst_stride, cframe);
         }
 
-        if (depth_sz != 0)
+        const auto& depth = prefix.planes[RSMuxDepth];
+        if (depth.size > 0)
+            RSCopy::copy(minfo.data + depth.offset, frame_set.get_depth_frame().get_data(), depth.size);
+
+        const auto& samples = prefix.planes[RSMuxImu];
+        if (samples.size > 0)
+            std::memcpy(minfo.data + samples.offset, imu->samples.data(), samples.size);
+        gst_buffer_unmap(buffer, &minfo);
+
+        return buffer;
+    }
+
+    /* Zero-copy muxing is only possible when the frame layout matches the 
+     * negotiated caps. */
+    template <typename Source>
+    static bool can_wrap(rs2::frameset& frame_set, const Source* src)
+    {
+        if (src->stream_type != StreamType::StreamMux)
+            return single_frame(frame_set, src).get_stride_in_bytes() == src->gst_stride;
+        return frame_set.get_color_frame().get_stride_in_bytes() == src->gst_stride;
+    }
+
+    /* Wrap frame data in a read-only GstMemory. The memory holds a reference
+     * to the rs2::frame so the SDK does not recycle it until the memory is freed. */
+    static GstMemory* wrap_frame(const rs2::frame& frame, size_t size)
+    {
+        auto ref = new rs2::frame(frame);
+        return gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY,
+            const_cast<void*>(ref->get_data()), size, 0, size,
+            ref, [](gpointer data) { delete static_cast<rs2::frame*>(data); });
+    }
+
+    /* Same layout as mux(), but each stream is its own GstMemory wrapping
+     * the SDK frame, so no frame data is copied and the planes are where
+     * the SDK put them rather than on RSMuxAlign. Check can_wrap() first. */
+    template <typename Source>
+    static GstBuffer* mux_zero_copy(rs2::frameset& frame_set, const RSHeader& header, const Source* src,
+        const RSImuBatch* imu = nullptr)
+    {
+        auto buffer = gst_buffer_new();
+
+        if (src->stream_type != StreamType::StreamMux)
         {
-            std::memcpy(outdata, depth.get_data(), depth_sz);
-            outdata += depth_sz;
+            auto frame = single_frame(frame_set, src);
+            gst_buffer_append_memory(buffer, 
+                wrap_frame(frame, static_cast<size_t>(frame.get_height() * src->gst_stride)));
+            return buffer;
         }
 
-        if (imu_sz != 0 && src->imu_on)
+        auto cframe = frame_set.get_color_frame();
+        auto depth = frame_set.get_depth_frame();
+        const gsize color_sz = (header.skipped & StreamBitColor) ? 0 :
+            static_cast<gsize>(cframe.get_height()) * src->gst_stride;
+        const gsize depth_sz = (header.skipped & StreamBitDepth) ? 0 : depth.get_data_size();
+        const gsize imu_sz = src->imu_active && imu != nullptr && !(header.skipped & StreamBitImu) ? imu->bytes() : 0;
+
+        // planes follow each other without padding, so the offsets are the memory boundaries
+        const auto prefix = layout(header, color_sz, depth_sz, imu_sz, 1);
+        auto params = allocation_params();
+        gst_buffer_append_memory(buffer, gst_allocator_alloc(nullptr, prefix.size, &params));
+        gst_buffer_memset(buffer, 0, 0, prefix.size);
+        gst_buffer_fill(buffer, 0, &prefix, sizeof(prefix));
+
+        if (color_sz > 0)
+            gst_buffer_append_memory(buffer, wrap_frame(cframe, color_sz));
+        if (depth_sz > 0)
+            gst_buffer_append_memory(buffer, wrap_frame(depth, depth_sz));
+
+        // the IMU batch is reused for the next frame, so it is copied
+        if (imu_sz > 0)
         {
-#ifdef DEBUG
-            auto print_imu = [](const float *ptr, const auto descrtion) {
-                std::cout << descrtion << ": ";
-                for (size_t idx = 0; idx < 3; ++idx)
-                {
-                    std::cout << *ptr << ',';
-                    ++ptr;
-                }
-                std::cout << std::endl;
-            };
-            print_imu(static_cast<const float*>(accel_frame.get_data()), "accel");
-            print_imu(static_cast<const float*>(gyro_frame.get_data()), "gyro");
-#endif
-            std::memcpy(outdata, accel_frame.get_data(), accel_frame.get_data_size());
-            outdata += accel_frame.get_data_size();
-            std::memcpy(outdata, gyro_frame.get_data(), gyro_frame.get_data_size());
-            outdata += gyro_frame.get_data_size();
+            gst_buffer_append_memory(buffer, gst_allocator_alloc(nullptr, imu_sz, &params));
+            gst_buffer_fill(buffer, prefix.planes[RSMuxImu].offset, imu->samples.data(), imu_sz);
         }
-        gst_buffer_unmap(buffer, &minfo);
+
+        GST_LOG_OBJECT(src, "Wrapped frame_num=%llu in %u memories",
+                       cframe.get_frame_number(), gst_buffer_n_memory(buffer));
 
         return buffer;
     }
 
-    static buf_tuple demux(GstBuffer *buffer, const RSHeader &header)
+    /* Create a read-only buffer over [offset, offset + size) of buffer without
+     * copying. The new buffer keeps a reference to buffer (not just its memory),
+     * so a pooled buffer returns to its pool with exclusive memory once all its
+     * sub-buffers are gone. Timestamps and metadata are copied from buffer. */
+    static GstBuffer* sub_buffer(GstBuffer* buffer, gsize offset, gsize size)
     {
-        GstMapInfo inmap, cmap, dmap, imumap;
-        gst_buffer_map(buffer, &inmap, GST_MAP_READ);
+        struct SubRegion
+        {
+            GstBuffer* parent;
+            GstMemory* mem;
+            GstMapInfo map;
+        };
+        
+        guint idx, length;
+        gsize skip;
+        GstBuffer* out = nullptr;
 
-        auto color_sz = header.color_height * header.color_stride;
-        auto colorbuf = gst_buffer_new_and_alloc(color_sz);
-        gst_buffer_map(colorbuf, &cmap, GST_MAP_WRITE);
-        auto cdata = inmap.data + sizeof(RSHeader);
-        std::memcpy(cmap.data, cdata, color_sz);
+        if (size == 0 || !gst_buffer_find_memory(buffer, offset, size, &idx, &length, &skip))
+            return nullptr;
 
-        auto depth_sz = header.depth_height * header.depth_stride;
-        auto depthbuf = gst_buffer_new_and_alloc(depth_sz);
-        gst_buffer_map(depthbuf, &dmap, GST_MAP_WRITE);
-        auto ddata = cdata + color_sz;
-        std::memcpy(dmap.data, ddata, depth_sz);
+        if (length == 1)
+        {
+            auto region = new SubRegion{buffer, gst_buffer_peek_memory(buffer, idx), {}};
+            if (!gst_memory_map(region->mem, &region->map, GST_MAP_READ))
+            {
+                delete region;
+                return nullptr;
+            }
+            gst_buffer_ref(buffer);
 
-        GstBuffer* imubuf = nullptr;
-        if (header.accel_format != GST_AUDIO_FORMAT_UNKNOWN && header.gyro_format != GST_AUDIO_FORMAT_UNKNOWN)
+            out = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, 
+                region->map.data + skip, size, 0, size, region, 
+                [](gpointer data) {
+                    auto region = static_cast<SubRegion*>(data);
+                    gst_memory_unmap(region->mem, &region->map);
+                    gst_buffer_unref(region->parent);
+                    delete region;
+                });
+        }
+        else
         {
-            imubuf = gst_buffer_new_and_alloc(depth_sz);
-            gst_buffer_map(imubuf, &imumap, GST_MAP_READ);
-            constexpr auto imu_sz = 2*sizeof(rs2_vector);
-            auto imudata = ddata + depth_sz;
-            std::memcpy(imumap.data, imudata, imu_sz);
-            GST_BUFFER_TIMESTAMP(imubuf) = GST_BUFFER_TIMESTAMP(buffer);
-            gst_buffer_unmap(imubuf, &imumap);
+            // region straddles memories, gather it into one
+            auto params = allocation_params();
+            out = gst_buffer_new_allocate(nullptr, size, &params);
+            GstMapInfo omap;
+            if (out == nullptr || !gst_buffer_map(out, &omap, GST_MAP_WRITE))
+            {
+                if (out != nullptr)
+                    gst_buffer_unref(out);
+                return nullptr;
+            }
+
+            gsize done = 0;
+            for (guint i = idx; i < idx + length && done < size; ++i, skip = 0)
+            {
+                auto mem = gst_buffer_peek_memory(buffer, i);
+                GstMapInfo map;
+                if (!gst_memory_map(mem, &map, GST_MAP_READ))
+                    break;
+                const auto n = std::min<gsize>(size - done, map.size - skip);
+                RSCopy::copy(omap.data + done, map.data + skip, n);
+                done += n;
+                gst_memory_unmap(mem, &map);
+            }
+            gst_buffer_unmap(out, &omap);
+
+            if (done < size)
+            {
+                gst_buffer_unref(out);
+                return nullptr;
+            }
         }
 
-        GST_BUFFER_TIMESTAMP(colorbuf) = GST_BUFFER_TIMESTAMP(buffer);
-        GST_BUFFER_TIMESTAMP(depthbuf) = GST_BUFFER_TIMESTAMP(buffer);
+        if (out == nullptr)
+            return nullptr;
+
+        gst_buffer_copy_into(out, buffer, 
+            static_cast<GstBufferCopyFlags>(GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS | GST_BUFFER_COPY_META), 
+            0, -1);
+
+        return out;
+    }
+
+    /* Split a muxed buffer laid out as prefix (see GetRSHeader) into color,
+     * depth and IMU buffers. No frame data is copied, the outputs are
+     * sub-buffers of buffer. Streams not in the wanted StreamBits, or
+     * skipped by the source, come back as nullptr. */
+    static buf_tuple demux(GstBuffer *buffer, const RSMuxPrefix& prefix, int wanted = StreamBitsAll)
+    {
+        const auto& header = prefix.header;
+        const auto present = wanted & ~header.skipped;
+
+        // color carries the buffer timestamp, the other streams are stamped on their own
+        auto plane_buffer = [&](int index) {
+            const auto& plane = prefix.planes[index];
+            auto sub = sub_buffer(buffer, plane.offset, plane.size);
+            if (sub != nullptr && plane.pts_offset != 0 && GST_BUFFER_PTS_IS_VALID(sub))
+                GST_BUFFER_PTS(sub) = std::max<GstClockTimeDiff>(0, GST_BUFFER_PTS(sub) + plane.pts_offset);
+            return sub;
+        };
 
-        gst_buffer_unmap(buffer, &inmap);
-        gst_buffer_unmap(colorbuf, &cmap);
-        gst_buffer_unmap(depthbuf, &dmap);
+        auto colorbuf = (present & StreamBitColor) ? plane_buffer(RSMuxColor) : nullptr;
+        auto depthbuf = (present & StreamBitDepth) ? plane_buffer(RSMuxDepth) : nullptr;
+
+        GstBuffer* imubuf = nullptr;
+        if ((present & StreamBitImu) && header.accel_format != GST_AUDIO_FORMAT_UNKNOWN &&
+            header.imu_count > 0 && header.imu_rate > 0)
+        {
+            imubuf = plane_buffer(RSMuxImu);
+            if (imubuf != nullptr)
+            {
+                GST_BUFFER_DTS(imubuf) = GST_CLOCK_TIME_NONE;
+                GST_BUFFER_DURATION(imubuf) = gst_util_uint64_scale_int(header.imu_count, GST_SECOND, header.imu_rate);
+                GST_BUFFER_OFFSET(imubuf) = GST_BUFFER_OFFSET_NONE;
+            }
+        }
 
         return std::make_tuple(colorbuf, depthbuf, imubuf);
     }
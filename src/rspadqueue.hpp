@@ -0,0 +1,205 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSPADQUEUE_H__
+#define __GST_RSPADQUEUE_H__
+
+#include <gst/gst.h>
+
+#include "common.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/* Bounded queue feeding one source pad from its own task.
+ *
+ * Buffers and serialized events stay in order. Only buffers count towards
+ * the capacity and only buffers are dropped, so segments and EOS always get
+ * through. Each buffer is the part of one muxed frame meant for the pad,
+ * tagged with its frame number. When frames are dropped the next buffer
+ * popped is flagged DISCONT, so elements keeping history across frames
+ * (temporal filters) know frames are missing.
+ *
+ * Any number of threads may push, one task pops.
+ */
+class RSPadQueue
+{
+public:
+    enum class PushResult
+    {
+        Queued,
+        DroppedOldest, // buffer was queued, the oldest queued frame was discarded
+        DroppedNewest, // queue was full, buffer was discarded
+        Flushing       // queue is flushing, buffer was discarded
+    };
+
+    RSPadQueue(size_t capacity, OverflowPolicy policy)
+        : capacity_(capacity > 0 ? capacity : 1), policy_(policy) {}
+
+    ~RSPadQueue() { set_flushing(true); }
+
+    RSPadQueue(const RSPadQueue&) = delete;
+    RSPadQueue& operator=(const RSPadQueue&) = delete;
+
+    /* Queue the buffer of frame, taking ownership. With OverflowPolicy::Block
+     * this waits for room or flushing. */
+    PushResult push_buffer(GstBuffer* buffer, guint64 frame)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (policy_ == OverflowPolicy::Block)
+            space_.wait(lock, [this] { return flushing_ || buffers_ < capacity_; });
+
+        if (flushing_)
+        {
+            gst_buffer_unref(buffer);
+            return PushResult::Flushing;
+        }
+
+        auto result = PushResult::Queued;
+        if (buffers_ >= capacity_)
+        {
+            if (policy_ == OverflowPolicy::DropNewest)
+            {
+                GST_LOG("queue full, dropped frame %" G_GUINT64_FORMAT, frame);
+                gst_buffer_unref(buffer);
+                discont_ = true;
+                return PushResult::DroppedNewest;
+            }
+            drop_oldest();
+            result = PushResult::DroppedOldest;
+        }
+
+        items_.push_back({GST_MINI_OBJECT_CAST(buffer), frame, true, discont_});
+        discont_ = false;
+        ++buffers_;
+        lock.unlock();
+        item_.notify_one();
+        return result;
+    }
+
+    /* Queue a serialized event, taking ownership. Returns false, dropping
+     * it, when flushing. */
+    bool push_event(GstEvent* event)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (flushing_)
+        {
+            gst_event_unref(event);
+            return false;
+        }
+        items_.push_back({GST_MINI_OBJECT_CAST(event), 0, false, false});
+        lock.unlock();
+        item_.notify_one();
+        return true;
+    }
+
+    /* Wait for the next buffer or event and take it, nullptr once flushing */
+    GstMiniObject* pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        item_.wait(lock, [this] { return flushing_ || !items_.empty(); });
+        if (flushing_)
+            return nullptr;
+
+        const auto item = items_.front();
+        items_.pop_front();
+        if (!item.is_buffer)
+            return item.object;
+
+        --buffers_;
+        lock.unlock();
+        space_.notify_one();
+
+        if (!item.discont)
+            return item.object;
+        auto buffer = gst_buffer_make_writable(GST_BUFFER_CAST(item.object));
+        GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+        return GST_MINI_OBJECT_CAST(buffer);
+    }
+
+    /* Flushing drops everything queued and wakes both sides, which then
+     * return at once until flushing is turned off again. */
+    void set_flushing(bool flushing)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        flushing_ = flushing;
+        if (flushing)
+        {
+            for (const auto& item : items_)
+                gst_mini_object_unref(item.object);
+            items_.clear();
+            buffers_ = 0;
+            discont_ = false;
+        }
+        lock.unlock();
+        item_.notify_all();
+        space_.notify_all();
+    }
+
+    /* Number of buffers queued */
+    size_t level()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return buffers_;
+    }
+
+private:
+    struct Item
+    {
+        GstMiniObject* object;
+        guint64 frame;
+        bool is_buffer;
+        bool discont; // frames before this one were dropped
+    };
+
+    // the next buffer after the dropped one carries the gap
+    void drop_oldest()
+    {
+        auto it = items_.begin();
+        while (!it->is_buffer)
+            ++it;
+        GST_LOG("queue full, dropped frame %" G_GUINT64_FORMAT, it->frame);
+        gst_mini_object_unref(it->object);
+        it = items_.erase(it);
+        --buffers_;
+
+        while (it != items_.end() && !it->is_buffer)
+            ++it;
+        if (it != items_.end())
+            it->discont = true;
+        else
+            discont_ = true;
+    }
+
+    const size_t capacity_;
+    const OverflowPolicy policy_;
+
+    std::mutex mutex_;
+    std::condition_variable item_;
+    std::condition_variable space_;
+    std::deque<Item> items_;
+    size_t buffers_ = 0;
+    bool discont_ = false; // the next buffer queued follows dropped frames
+    bool flushing_ = false;
+};
+
+#endif // __GST_RSPADQUEUE_H__
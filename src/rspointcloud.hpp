@@ -0,0 +1,178 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSPOINTCLOUD_H__
+#define __GST_RSPOINTCLOUD_H__
+
+#include "rsgeometry.hpp"
+#include "rsworkers.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/* XYZ point clouds from depth frames, the same points rs2::pointcloud gives.
+ *
+ * Points are written interleaved as float32 x, y, z in meters, followed by
+ * u, v texture coordinates into the color image (normalized to [0, 1], -1
+ * where the point does not project) when texture is on. Organized output
+ * has one point per depth pixel, (0, 0, 0) where there is no depth;
+ * compact output keeps only pixels with depth, in row order.
+ *
+ * Call prepare() to learn the number of points, then compute() to write them.
+ */
+class RSPointCloud
+{
+public:
+    /* Rebuild the ray tables if calibration changed. Pass color and
+     * depth_to_color as nullptr when no texture coordinates are wanted. */
+    bool configure(const rs2_intrinsics& depth, const rs2_intrinsics* color,
+        const rs2_extrinsics* depth_to_color, float depth_units)
+    {
+        depth_scale_ = depth_units;
+        texture_ = color != nullptr && depth_to_color != nullptr;
+
+        bool rebuilt = false;
+        if (!configured_ || !rs_intrinsics_equal(depth, depth_))
+        {
+            depth_ = depth;
+            rays_.build(depth_, rs_identity_extrinsics(), depth_.width, depth_.height, 0.f);
+            configured_ = true;
+            rebuilt = true;
+        }
+
+        if (texture_ && (!texture_configured_ || rebuilt ||
+            !rs_intrinsics_equal(*color, color_) || !rs_extrinsics_equal(*depth_to_color, extrinsics_)))
+        {
+            color_ = *color;
+            extrinsics_ = *depth_to_color;
+            color_rays_.build(depth_, extrinsics_, depth_.width, depth_.height, 0.f);
+            texture_configured_ = true;
+            rebuilt = true;
+        }
+        return rebuilt;
+    }
+
+    bool texture() const { return texture_; }
+    int floats_per_point() const { return texture_ ? 5 : 3; }
+    size_t point_size() const { return sizeof(float) * floats_per_point(); }
+
+    /* Number of points compute() will write for this frame */
+    size_t prepare(const uint16_t* depth, int depth_stride, bool compact,
+        RSWorkerPool& pool, unsigned int max_threads = 0)
+    {
+        compact_ = compact;
+        bands_ = pool.bands_for(depth_.height, max_threads);
+        if (!compact)
+            return static_cast<size_t>(depth_.width) * depth_.height;
+
+        band_offset_.assign(bands_ + 1, 0);
+        pool.parallel_for(bands_, [&](size_t band) {
+            size_t count = 0;
+            for (int v = band_lo(band); v < band_lo(band + 1); ++v)
+            {
+                const auto drow = row(depth, depth_stride, v);
+                for (int u = 0; u < depth_.width; ++u)
+                    count += drow[u] != 0;
+            }
+            band_offset_[band + 1] = count;
+        }, max_threads);
+
+        for (size_t band = 0; band < bands_; ++band)
+            band_offset_[band + 1] += band_offset_[band];
+        return band_offset_[bands_];
+    }
+
+    void compute(const uint16_t* depth, int depth_stride, float* out,
+        RSWorkerPool& pool, unsigned int max_threads = 0)
+    {
+        pool.parallel_for(bands_, [&](size_t band) {
+            const int width = depth_.width;
+            thread_local std::vector<float> scratch;
+            scratch.resize(5 * static_cast<size_t>(width));
+            float* px = scratch.data();
+            float* py = px + width;
+            float* pz = py + width;
+            float* tu = pz + width;
+            float* tv = tu + width;
+
+            const auto fpp = floats_per_point();
+            float* dst = out + fpp * (compact_ ? band_offset_[band] : static_cast<size_t>(band_lo(band)) * width);
+            const float zero[3] = {0.f, 0.f, 0.f};
+
+            for (int v = band_lo(band); v < band_lo(band + 1); ++v)
+            {
+                const auto drow = row(depth, depth_stride, v);
+                RSGeometry::deproject_row(rays_.row_x(v), rays_.row_y(v), rays_.row_z(v),
+                    drow, depth_scale_, zero, width, px, py, pz);
+
+                if (texture_)
+                {
+                    const RSProjectParams params {depth_scale_,
+                        {extrinsics_.translation[0], extrinsics_.translation[1], extrinsics_.translation[2]}, color_};
+                    RSGeometry::project_row(color_rays_.row_x(v), color_rays_.row_y(v), color_rays_.row_z(v),
+                        drow, params, width, tu, tv);
+                }
+
+                for (int u = 0; u < width; ++u)
+                {
+                    if (compact_ && drow[u] == 0)
+                        continue;
+                    dst[0] = px[u];
+                    dst[1] = py[u];
+                    dst[2] = pz[u];
+                    if (texture_)
+                    {
+                        const bool valid = tu[u] != RS_INVALID_PIXEL;
+                        dst[3] = valid ? tu[u] / color_.width : -1.f;
+                        dst[4] = valid ? tv[u] / color_.height : -1.f;
+                    }
+                    dst += fpp;
+                }
+            }
+        }, max_threads);
+    }
+
+private:
+    static const uint16_t* row(const uint16_t* data, int stride, int y)
+    {
+        return reinterpret_cast<const uint16_t*>(reinterpret_cast<const uint8_t*>(data) + static_cast<size_t>(y) * stride);
+    }
+
+    int band_lo(size_t band) const
+    {
+        return static_cast<int>(band * depth_.height / bands_);
+    }
+
+    bool configured_ = false;
+    bool texture_configured_ = false;
+    bool texture_ = false;
+    bool compact_ = false;
+    float depth_scale_ = 0.f;
+    rs2_intrinsics depth_ {};
+    rs2_intrinsics color_ {};
+    rs2_extrinsics extrinsics_ {};
+    RSRayLUT rays_;        // depth rays in the depth frame
+    RSRayLUT color_rays_;  // depth rays rotated into the color frame
+
+    size_t bands_ = 1;
+    std::vector<size_t> band_offset_; // first point of each band in compact mode
+};
+
+#endif // __GST_RSPOINTCLOUD_H__
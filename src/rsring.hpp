@@ -0,0 +1,245 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSRING_H__
+#define __GST_RSRING_H__
+
+#include "common.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+/* Bounded lock-free ring for handing items from one producer thread to one
+ * consumer thread.
+ *
+ * Each cell carries a sequence number (after D. Vyukov's bounded queue), so
+ * a cell is owned by exactly one side at a time. That lets the producer
+ * discard the oldest item when the ring is full (OverflowPolicy::DropOldest)
+ * without racing the consumer.
+ *
+ * push and try_pop never block. wait_for_item() lets an idle consumer sleep
+ * and wait_for_space() a producer that must not drop (OverflowPolicy::Block);
+ * either side only touches the mutex when the other is actually waiting.
+ */
+template <typename T>
+class RSRing
+{
+public:
+    enum class PushResult
+    {
+        Pushed,
+        DroppedOldest, // item was pushed, the oldest queued item was discarded
+        DroppedNewest  // ring was full, item was discarded
+    };
+
+    explicit RSRing(size_t capacity)
+        : capacity_(capacity > 0 ? capacity : 1),
+          cells_(new Cell[capacity_])
+    {
+        for (size_t i = 0; i < capacity_; ++i)
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    RSRing(const RSRing&) = delete;
+    RSRing& operator=(const RSRing&) = delete;
+
+    size_t capacity() const { return capacity_; }
+
+    /* Approximate number of queued items */
+    size_t size() const
+    {
+        const auto head = head_.load(std::memory_order_acquire);
+        const auto tail = tail_.load(std::memory_order_acquire);
+        return head > tail ? head - tail : 0;
+    }
+
+    bool try_push(T&& item)
+    {
+        auto pos = head_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            auto& cell = cells_[pos % capacity_];
+            const auto seq = cell.seq.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.data = std::move(item);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    wake(consumer_waiting_);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& item)
+    {
+        auto pos = tail_.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            auto& cell = cells_[pos % capacity_];
+            const auto seq = cell.seq.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    item = std::move(cell.data);
+                    cell.data = T();
+                    cell.seq.store(pos + capacity_, std::memory_order_release);
+                    wake(producer_waiting_);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // empty
+            }
+            else
+            {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /* Producer side. Never blocks, OverflowPolicy::Block is left to the
+     * caller (try_push() and wait_for_space()) and drops the item here. */
+    PushResult push(T&& item, OverflowPolicy policy)
+    {
+        if (try_push(std::move(item)))
+            return PushResult::Pushed;
+
+        if (policy != OverflowPolicy::DropOldest)
+            return PushResult::DroppedNewest;
+
+        // DropOldest: claim the oldest cell like a consumer would, then retry.
+        // The consumer may have made room in the meantime, so loop.
+        for (;;)
+        {
+            T discarded;
+            const bool dropped = try_pop(discarded);
+            if (try_push(std::move(item)))
+                return dropped ? PushResult::DroppedOldest : PushResult::Pushed;
+        }
+    }
+
+    /* Consumer side. Sleep until an item may be available, the timeout
+     * expires or interrupt() is called. Returns true if the ring is non-empty. */
+    template <typename Rep, typename Period>
+    bool wait_for_item(const std::chrono::duration<Rep, Period>& timeout)
+    {
+        if (size() > 0)
+            return true;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        consumer_waiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cond_.wait_for(lock, timeout, [this] {
+            return size() > 0 || interrupted_.load(std::memory_order_acquire);
+        });
+        consumer_waiting_.store(false, std::memory_order_relaxed);
+        return size() > 0;
+    }
+
+    /* Producer side. Sleep until the consumer may have made room or the
+     * timeout expires. Returns true if the ring has room. */
+    template <typename Rep, typename Period>
+    bool wait_for_space(const std::chrono::duration<Rep, Period>& timeout)
+    {
+        if (size() < capacity_)
+            return true;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        producer_waiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cond_.wait_for(lock, timeout, [this] { return size() < capacity_; });
+        producer_waiting_.store(false, std::memory_order_relaxed);
+        return size() < capacity_;
+    }
+
+    /* Wake a consumer blocked in wait_for_item() and keep it from blocking
+     * again until resume() is called. */
+    void interrupt()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        interrupted_.store(true, std::memory_order_release);
+        cond_.notify_all();
+    }
+
+    void resume()
+    {
+        interrupted_.store(false, std::memory_order_release);
+    }
+
+    /* Drop everything still queued. Only call when the producer is stopped. */
+    void clear()
+    {
+        T discarded;
+        while (try_pop(discarded))
+            ;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    void wake(const std::atomic<bool>& waiting)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cond_.notify_all();
+        }
+    }
+
+    const size_t capacity_;
+    std::unique_ptr<Cell[]> cells_;
+
+    // keep producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> head_ {0};
+    alignas(64) std::atomic<size_t> tail_ {0};
+
+    alignas(64) std::atomic<bool> consumer_waiting_ {false};
+    std::atomic<bool> producer_waiting_ {false};
+    std::atomic<bool> interrupted_ {false};
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+
+#endif // __GST_RSRING_H__
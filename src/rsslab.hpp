@@ -0,0 +1,210 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSSLAB_H__
+#define __GST_RSSLAB_H__
+
+#include "common.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct RSSlabCounters
+{
+    uint64_t live = 0;    // bytes handed out and not yet released
+    uint64_t peak = 0;    // largest live
+    uint64_t mapped = 0;  // bytes of slabs mapped now
+    uint64_t refills = 0; // slabs mapped since creation
+    bool huge = false;    // the last slab is backed by explicit huge pages
+    bool locked = true;   // every slab that should be locked is
+};
+
+/* Frame sized blocks carved from large anonymous mappings.
+ *
+ * Output buffers are a few large blocks of the same size, allocated once per
+ * pool and reused, so blocks are simply bumped off the end of a slab and a
+ * slab is reset once every block in it was released. Empty slabs but one are
+ * unmapped again. Slabs are a multiple of the 2 MiB huge page size and
+ * aligned to it, so the kernel can back them with transparent huge pages,
+ * or come from hugetlbfs when asked. They are written once when mapped (and
+ * optionally locked), so the capture path takes no page faults. Blocks are
+ * 64-byte aligned.
+ */
+class RSSlab
+{
+public:
+    static constexpr size_t Align = 64;
+    static constexpr size_t HugePageSize = 2 << 20;
+    static constexpr size_t DefaultSlabSize = 32 << 20;
+
+    RSSlab(HugePages huge_pages, bool lock, size_t slab_size = DefaultSlabSize) :
+        huge_pages_(huge_pages), lock_(lock), slab_size_(round_up(slab_size, HugePageSize))
+    {
+    }
+
+    ~RSSlab()
+    {
+        for (auto& slab : slabs_)
+            munmap(slab.base, slab.size);
+    }
+
+    RSSlab(const RSSlab&) = delete;
+    RSSlab& operator=(const RSSlab&) = delete;
+
+    /* A block of at least size bytes, nullptr when no slab can be mapped */
+    void* alloc(size_t size)
+    {
+        const auto block = round_up(std::max<size_t>(size, 1), Align);
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto slab = std::find_if(slabs_.begin(), slabs_.end(),
+            [&](const Slab& s) { return s.size - s.used >= block; });
+        if (slab == slabs_.end())
+        {
+            Slab fresh {};
+            if (!map(std::max(slab_size_, round_up(block, HugePageSize)), fresh))
+                return nullptr;
+            slabs_.push_back(fresh);
+            slab = slabs_.end() - 1;
+        }
+
+        auto p = slab->base + slab->used;
+        slab->used += block;
+        ++slab->blocks;
+        counters_.live += block;
+        counters_.peak = std::max(counters_.peak, counters_.live);
+        return p;
+    }
+
+    /* Give back a block alloc() returned for size */
+    void release(void* p, size_t size)
+    {
+        const auto block = round_up(std::max<size_t>(size, 1), Align);
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto slab = std::find_if(slabs_.begin(), slabs_.end(), [&](const Slab& s) {
+            return static_cast<uint8_t*>(p) >= s.base && static_cast<uint8_t*>(p) < s.base + s.size;
+        });
+        if (slab == slabs_.end())
+            return;
+        counters_.live -= block;
+        if (--slab->blocks > 0)
+            return;
+
+        slab->used = 0;
+        // keep one empty slab for the next pool
+        const auto empty = std::count_if(slabs_.begin(), slabs_.end(),
+            [](const Slab& s) { return s.blocks == 0; });
+        if (empty > 1)
+        {
+            munmap(slab->base, slab->size);
+            counters_.mapped -= slab->size;
+            slabs_.erase(slab);
+        }
+    }
+
+    RSSlabCounters counters() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return counters_;
+    }
+
+private:
+    struct Slab
+    {
+        uint8_t* base;
+        size_t size;
+        size_t used;   // bytes bumped off the start
+        size_t blocks; // blocks not yet released
+    };
+
+    static size_t round_up(size_t size, size_t align)
+    {
+        return (size + align - 1) / align * align;
+    }
+
+    bool map(size_t size, Slab& slab)
+    {
+        void* p = MAP_FAILED;
+        bool huge = false;
+#ifdef MAP_HUGETLB
+        if (huge_pages_ == HugePagesExplicit)
+        {
+            p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            huge = p != MAP_FAILED;
+        }
+#endif
+        if (p == MAP_FAILED)
+        {
+            p = map_aligned(size);
+            if (p == MAP_FAILED)
+                return false;
+#ifdef MADV_HUGEPAGE
+            if (huge_pages_ != HugePagesOff)
+                madvise(p, size, MADV_HUGEPAGE);
+#endif
+        }
+
+        // fault the slab in now rather than on the capture path
+        auto base = static_cast<uint8_t*>(p);
+        const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        for (size_t i = 0; i < size; i += page)
+            static_cast<volatile uint8_t*>(base)[i] = 0;
+        if (lock_ && mlock(p, size) != 0)
+            counters_.locked = false;
+
+        slab = Slab {base, size, 0, 0};
+        counters_.mapped += size;
+        ++counters_.refills;
+        counters_.huge = huge;
+        return true;
+    }
+
+    /* size bytes at a huge page boundary, as transparent huge pages need */
+    static void* map_aligned(size_t size)
+    {
+        const auto padded = size + HugePageSize;
+        auto p = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return p;
+        const auto start = reinterpret_cast<uintptr_t>(p);
+        const auto aligned = round_up(start, HugePageSize);
+        if (aligned > start)
+            munmap(p, aligned - start);
+        if (start + padded > aligned + size)
+            munmap(reinterpret_cast<void*>(aligned + size), start + padded - aligned - size);
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    const HugePages huge_pages_;
+    const bool lock_;
+    const size_t slab_size_;
+    mutable std::mutex mutex_;
+    std::vector<Slab> slabs_;
+    RSSlabCounters counters_;
+};
+
+#endif // __GST_RSSLAB_H__
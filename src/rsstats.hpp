@@ -0,0 +1,220 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSSTATS_H__
+#define __GST_RSSTATS_H__
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+constexpr const guint DEFAULT_PROP_STATS_INTERVAL = 1000; // ms
+
+/* Stages of a frame on its way through realsensesrc and rsdemux */
+enum class RSStage
+{
+    Capture, // sensor to host, from the mapped capture time
+    Queue,   // waiting in the source's ring
+    Wait,    // create() blocked on an empty ring
+    Align,
+    Mux,     // copy or wrap into the output buffer
+    Meta,
+    Demux,   // split into sub-buffers
+    Push,    // downstream of rsdemux's pads
+    Count
+};
+
+/* Lock-free histogram of durations in ns. Each power of two is split into
+ * four buckets, so percentiles are within about 12%. Safe to record from
+ * any number of threads while another one reads. */
+class RSHistogram
+{
+public:
+    static constexpr size_t Buckets = 160; // up to ~2^40 ns, about 18 minutes
+
+    void record(uint64_t ns)
+    {
+        buckets_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(ns, std::memory_order_relaxed);
+        auto max = max_.load(std::memory_order_relaxed);
+        while (ns > max && !max_.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+            ;
+    }
+
+    void reset()
+    {
+        for (auto& b : buckets_)
+            b.store(0, std::memory_order_relaxed);
+        count_ = 0;
+        sum_ = 0;
+        max_ = 0;
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    uint64_t mean() const
+    {
+        const auto n = count();
+        return n > 0 ? sum_.load(std::memory_order_relaxed) / n : 0;
+    }
+
+    /* Middle of the bucket holding the q-th quantile, 0 <= q <= 1 */
+    uint64_t percentile(double q) const
+    {
+        const auto n = count();
+        if (n == 0)
+            return 0;
+        const auto rank = static_cast<uint64_t>(q * static_cast<double>(n - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < Buckets; ++i)
+        {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                return (lower(i) + lower(i + 1)) / 2;
+        }
+        return max();
+    }
+
+    static size_t bucket(uint64_t ns)
+    {
+        if (ns < 4)
+            return static_cast<size_t>(ns);
+        const int msb = 63 - __builtin_clzll(ns);
+        const auto sub = static_cast<size_t>((ns >> (msb - 2)) & 3);
+        return std::min(Buckets - 1, static_cast<size_t>(msb - 1) * 4 + sub);
+    }
+
+    static uint64_t lower(size_t i)
+    {
+        if (i < 4)
+            return i;
+        return static_cast<uint64_t>(4 + i % 4) << (i / 4 - 1);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, Buckets> buckets_ {};
+    std::atomic<uint64_t> count_ {0};
+    std::atomic<uint64_t> sum_ {0};
+    std::atomic<uint64_t> max_ {0};
+};
+
+/* Per-stage timings of one element. Elements hold a null RSStats* while
+ * stats are off, so disabled instrumentation costs a pointer test. Timings
+ * accumulate from start and are posted as a "realsense-stats" element
+ * message every interval and at EOS. */
+class RSStats
+{
+public:
+    explicit RSStats(GstClockTime interval) : interval_(static_cast<int64_t>(interval)), last_post_(now()) {}
+
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void record(RSStage stage, int64_t ns)
+    {
+        if (ns >= 0)
+            stages_[static_cast<size_t>(stage)].record(static_cast<uint64_t>(ns));
+    }
+
+    const RSHistogram& stage(RSStage stage) const { return stages_[static_cast<size_t>(stage)]; }
+
+    /* True for exactly one caller once interval has passed since the last post */
+    bool due()
+    {
+        if (interval_ <= 0)
+            return false;
+        const auto t = now();
+        auto last = last_post_.load(std::memory_order_relaxed);
+        return t - last >= interval_ && last_post_.compare_exchange_strong(last, t, std::memory_order_relaxed);
+    }
+
+    /* One field per stage that saw frames, each a structure of count, mean,
+     * p50, p90, p99 and max in ns */
+    GstStructure* to_structure() const
+    {
+        auto s = gst_structure_new_empty("realsense-stats");
+        for (size_t i = 0; i < stages_.size(); ++i)
+        {
+            const auto& h = stages_[i];
+            if (h.count() == 0)
+                continue;
+            auto fields = gst_structure_new(name(static_cast<RSStage>(i)),
+                "count", G_TYPE_UINT64, h.count(),
+                "mean", G_TYPE_UINT64, h.mean(),
+                "p50", G_TYPE_UINT64, h.percentile(0.5),
+                "p90", G_TYPE_UINT64, h.percentile(0.9),
+                "p99", G_TYPE_UINT64, h.percentile(0.99),
+                "max", G_TYPE_UINT64, h.max(),
+                nullptr);
+            gst_structure_set(s, name(static_cast<RSStage>(i)), GST_TYPE_STRUCTURE, fields, nullptr);
+            gst_structure_free(fields);
+        }
+        return s;
+    }
+
+    void post(GstElement* element) const
+    {
+        gst_element_post_message(element, gst_message_new_element(GST_OBJECT(element), to_structure()));
+    }
+
+    static const char* name(RSStage stage)
+    {
+        static constexpr const char* names[] = {
+            "capture", "queue", "wait", "align", "mux", "meta", "demux", "push"
+        };
+        return names[static_cast<size_t>(stage)];
+    }
+
+private:
+    std::array<RSHistogram, static_cast<size_t>(RSStage::Count)> stages_;
+    const int64_t interval_;
+    std::atomic<int64_t> last_post_;
+};
+
+/* Times the enclosing scope into a stage when stats are on */
+class RSStageTimer
+{
+public:
+    RSStageTimer(RSStats* stats, RSStage stage) : stats_(stats), stage_(stage), start_(stats ? RSStats::now() : 0) {}
+    ~RSStageTimer()
+    {
+        if (stats_)
+            stats_->record(stage_, RSStats::now() - start_);
+    }
+
+    RSStageTimer(const RSStageTimer&) = delete;
+    RSStageTimer& operator=(const RSStageTimer&) = delete;
+
+private:
+    RSStats* stats_;
+    RSStage stage_;
+    int64_t start_;
+};
+
+#endif // __GST_RSSTATS_H__
@@ -0,0 +1,449 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSSYNTHETIC_H__
+#define __GST_RSSYNTHETIC_H__
+
+#include <librealsense2/rs.hpp>
+#include <librealsense2/hpp/rs_internal.hpp>
+
+#include "common.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+struct RSSyntheticSettings
+{
+    int width = 640;
+    int height = 480;
+    int fps = 30;
+    int pattern = PatternStatic;
+};
+
+/* A camera made of an rs2::software_device, for running pipelines without
+ * hardware. It has color (RGB8), depth (Z16) and motion sensors with
+ * plausible calibration, and a thread that feeds them frames at the
+ * configured rate into an rs2::syncer. The framesets that come out are
+ * regular SDK framesets, so everything downstream of
+ * try_wait_for_frames() is the same as with a real camera. Motion runs at
+ * D435i rates and, like a camera's, can go to its own callback instead.
+ */
+class RSSynthetic
+{
+public:
+    static constexpr float DepthUnits = 0.001f;
+    static constexpr const char* SerialNumber = "000000000000";
+    static constexpr int AccelRate = 250;
+    static constexpr int GyroRate = 400;
+
+    explicit RSSynthetic(const RSSyntheticSettings& settings)
+        : settings_(settings), syncer_(queue_size)
+    {
+        dev_.register_info(RS2_CAMERA_INFO_NAME, "Synthetic RealSense");
+        dev_.register_info(RS2_CAMERA_INFO_SERIAL_NUMBER, SerialNumber);
+
+        const int w = settings_.width;
+        const int h = settings_.height;
+
+        depth_sensor_ = std::make_unique<rs2::software_sensor>(dev_.add_sensor("Depth"));
+        depth_sensor_->add_read_only_option(RS2_OPTION_DEPTH_UNITS, DepthUnits);
+        depth_profile_ = depth_sensor_->add_video_stream(
+            {RS2_STREAM_DEPTH, 0, 0, w, h, settings_.fps, 2, RS2_FORMAT_Z16, pinhole(w, h, 87.f)}, true);
+
+        color_sensor_ = std::make_unique<rs2::software_sensor>(dev_.add_sensor("Color"));
+        color_profile_ = color_sensor_->add_video_stream(
+            {RS2_STREAM_COLOR, 0, 1, w, h, settings_.fps, 3, RS2_FORMAT_RGB8, pinhole(w, h, 69.f)}, true);
+
+        // depth camera 15 mm to the left of the color camera, as on a D435
+        depth_profile_.register_extrinsics_to(color_profile_,
+            {{1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f}, {0.015f, 0.f, 0.f}});
+
+        motion_sensor_ = std::make_unique<rs2::software_sensor>(dev_.add_sensor("Motion Module"));
+        const rs2_motion_device_intrinsic imu_intrinsics {{{1.f, 0.f, 0.f, 0.f}, {0.f, 1.f, 0.f, 0.f},
+            {0.f, 0.f, 1.f, 0.f}}, {0.f, 0.f, 0.f}, {0.f, 0.f, 0.f}};
+        accel_profile_ = motion_sensor_->add_motion_stream(
+            {RS2_STREAM_ACCEL, 0, 2, AccelRate, RS2_FORMAT_MOTION_XYZ32F, imu_intrinsics}, true);
+        gyro_profile_ = motion_sensor_->add_motion_stream(
+            {RS2_STREAM_GYRO, 0, 3, GyroRate, RS2_FORMAT_MOTION_XYZ32F, imu_intrinsics}, true);
+
+        dev_.create_matcher(RS2_MATCHER_DEFAULT);
+    }
+
+    ~RSSynthetic()
+    {
+        stop();
+        for (auto& slots : {&color_slots_, &depth_slots_, &motion_slots_})
+            for (auto slot : *slots)
+                Slot::release(slot);
+    }
+
+    RSSynthetic(const RSSynthetic&) = delete;
+    RSSynthetic& operator=(const RSSynthetic&) = delete;
+
+    rs2::device device() const { return dev_; }
+
+    rs2::stream_profile stream(rs2_stream type) const
+    {
+        switch (type)
+        {
+            case RS2_STREAM_COLOR: return color_profile_;
+            case RS2_STREAM_DEPTH: return depth_profile_;
+            case RS2_STREAM_ACCEL: return accel_profile_;
+            case RS2_STREAM_GYRO: return gyro_profile_;
+            default: throw std::invalid_argument("no such synthetic stream");
+        }
+    }
+
+    /* Motion frames go to motion_callback if one is given, otherwise into
+     * the framesets. */
+    void start(bool color, bool depth, bool imu, std::function<void(rs2::frame)> motion_callback = {})
+    {
+        color_on_ = color;
+        depth_on_ = depth;
+        imu_on_ = imu;
+
+        if (color_on_)
+            open(*color_sensor_, {color_profile_});
+        if (depth_on_)
+            open(*depth_sensor_, {depth_profile_});
+        if (imu_on_)
+            open(*motion_sensor_, {accel_profile_, gyro_profile_}, std::move(motion_callback));
+
+        running_ = true;
+        thread_ = std::thread([this] { run(); });
+    }
+
+    void stop()
+    {
+        running_ = false;
+        if (thread_.joinable())
+            thread_.join();
+
+        for (auto sensor : opened_)
+        {
+            sensor->stop();
+            sensor->close();
+        }
+        opened_.clear();
+    }
+
+    bool try_wait_for_frames(rs2::frameset* frame_set, unsigned int timeout_ms)
+    {
+        return syncer_.try_wait_for_frames(frame_set, timeout_ms);
+    }
+
+    rs2::frameset wait_for_frames(unsigned int timeout_ms = 5000)
+    {
+        return syncer_.wait_for_frames(timeout_ms);
+    }
+
+private:
+    static constexpr int queue_size = 4;
+
+    /* Frame memory handed to the SDK. Each slot is shared by the renderer and
+     * at most one SDK frame; whoever drops the last reference frees it, so
+     * frames wrapped downstream may outlive this object. */
+    struct Slot
+    {
+        std::atomic<int> refs;
+        int64_t key; // what was last rendered into data, see render_*
+        size_t size;
+
+        static constexpr size_t header_size = 64; // keeps data cache line aligned
+
+        static Slot* create(size_t size)
+        {
+            auto mem = std::aligned_alloc(header_size, header_size + ((size + header_size - 1) / header_size) * header_size);
+            if (mem == nullptr)
+                throw std::bad_alloc();
+            return new (mem) Slot {{1}, -1, size};
+        }
+
+        uint8_t* data() { return reinterpret_cast<uint8_t*>(this) + header_size; }
+
+        static Slot* from_data(void* data)
+        {
+            return reinterpret_cast<Slot*>(static_cast<uint8_t*>(data) - header_size);
+        }
+
+        static void release(Slot* slot)
+        {
+            if (--slot->refs == 0)
+            {
+                slot->~Slot();
+                std::free(slot);
+            }
+        }
+
+        // rs2_software_*_frame deleter
+        static void release_data(void* data) { release(from_data(data)); }
+    };
+
+    // A slot no SDK frame is using, reference taken for the SDK
+    static Slot* acquire(std::vector<Slot*>& slots, size_t size)
+    {
+        for (auto slot : slots)
+        {
+            int expected = 1;
+            if (slot->refs.compare_exchange_strong(expected, 2))
+                return slot;
+        }
+        auto slot = Slot::create(size);
+        slot->refs = 2;
+        slots.push_back(slot);
+        return slot;
+    }
+
+    static rs2_intrinsics pinhole(int width, int height, float hfov_deg)
+    {
+        rs2_intrinsics intr {};
+        intr.width = width;
+        intr.height = height;
+        intr.fx = intr.fy = 0.5f * width / std::tan(0.5f * hfov_deg * static_cast<float>(M_PI) / 180.f);
+        intr.ppx = 0.5f * (width - 1);
+        intr.ppy = 0.5f * (height - 1);
+        intr.model = RS2_DISTORTION_NONE;
+        return intr;
+    }
+
+    void open(rs2::software_sensor& sensor, const std::vector<rs2::stream_profile>& profiles,
+        std::function<void(rs2::frame)> callback = {})
+    {
+        sensor.open(profiles);
+        if (callback)
+            sensor.start(callback);
+        else
+            sensor.start(syncer_);
+        opened_.push_back(&sensor);
+    }
+
+    // scroll offset in pixels of frame n
+    int64_t shift(int64_t n) const
+    {
+        return settings_.pattern == PatternMoving ? (n * 4) % settings_.width : 0;
+    }
+
+    uint32_t next_random()
+    {
+        rng_ ^= rng_ << 13;
+        rng_ ^= rng_ >> 17;
+        rng_ ^= rng_ << 5;
+        return rng_;
+    }
+
+    /* Vertical color bars. Rows are identical, so one row is built and
+     * copied; static content is never rendered twice into the same slot. */
+    void render_color(Slot* slot, int64_t n)
+    {
+        const int w = settings_.width;
+        const auto stride = static_cast<size_t>(w) * 3;
+        auto data = slot->data();
+
+        if (settings_.pattern == PatternNoise)
+        {
+            for (size_t i = 0; i + 4 <= slot->size; i += 4)
+            {
+                const auto r = next_random();
+                std::memcpy(data + i, &r, 4);
+            }
+            return;
+        }
+
+        const auto key = shift(n);
+        if (slot->key == key)
+            return;
+        slot->key = key;
+
+        for (int x = 0; x < w; ++x)
+        {
+            const int bar = static_cast<int>(((x + key) % w) * 8 / w);
+            data[3 * x + 0] = (bar & 1) ? 255 : 0;
+            data[3 * x + 1] = (bar & 2) ? 255 : 0;
+            data[3 * x + 2] = (bar & 4) ? 255 : 0;
+        }
+        for (int y = 1; y < settings_.height; ++y)
+            std::memcpy(data + y * stride, data, stride);
+    }
+
+    /* A depth ramp from 0.5 m to 2.5 m across the frame with a band of
+     * missing depth, or the ramp with noise. */
+    void render_depth(Slot* slot, int64_t n)
+    {
+        const int w = settings_.width;
+        const auto stride = static_cast<size_t>(w) * 2;
+        auto data = reinterpret_cast<uint16_t*>(slot->data());
+
+        auto ramp = [&](int x, int64_t key) -> uint16_t {
+            const auto pos = (x + key) % w;
+            if (pos >= w / 2 && pos < w / 2 + w / 20)
+                return 0;
+            return static_cast<uint16_t>(500 + pos * 2000 / w);
+        };
+
+        if (settings_.pattern == PatternNoise)
+        {
+            for (int y = 0; y < settings_.height; ++y)
+                for (int x = 0; x < w; ++x)
+                {
+                    const auto d = ramp(x, 0);
+                    data[static_cast<size_t>(y) * w + x] = d == 0 ? 0 : static_cast<uint16_t>(d + (next_random() & 63));
+                }
+            return;
+        }
+
+        const auto key = shift(n);
+        if (slot->key == key)
+            return;
+        slot->key = key;
+
+        for (int x = 0; x < w; ++x)
+            data[x] = ramp(x, key);
+        for (int y = 1; y < settings_.height; ++y)
+            std::memcpy(reinterpret_cast<uint8_t*>(data) + y * stride, data, stride);
+    }
+
+    void video_frame(rs2::software_sensor& sensor, std::vector<Slot*>& slots, const rs2::stream_profile& profile,
+        int bpp, bool depth, int64_t n, double timestamp)
+    {
+        const int w = settings_.width;
+        const auto slot = acquire(slots, static_cast<size_t>(w) * settings_.height * bpp);
+        if (depth)
+            render_depth(slot, n);
+        else
+            render_color(slot, n);
+
+        rs2_software_video_frame frame {};
+        frame.pixels = slot->data();
+        frame.deleter = Slot::release_data;
+        frame.stride = w * bpp;
+        frame.bpp = bpp;
+        frame.timestamp = timestamp;
+        frame.domain = RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME;
+        frame.frame_number = static_cast<int>(n);
+        frame.profile = profile.get();
+        frame.depth_units = depth ? DepthUnits : 0.f;
+
+        sensor.set_metadata(RS2_FRAME_METADATA_ACTUAL_EXPOSURE, exposure_us);
+        sensor.on_video_frame(frame);
+    }
+
+    void motion_frame(const rs2::stream_profile& profile, const rs2_vector& value, int64_t n, double timestamp)
+    {
+        const auto slot = acquire(motion_slots_, sizeof(rs2_vector));
+        std::memcpy(slot->data(), &value, sizeof(value));
+
+        rs2_software_motion_frame frame {};
+        frame.data = slot->data();
+        frame.deleter = Slot::release_data;
+        frame.timestamp = timestamp;
+        frame.domain = RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME;
+        frame.frame_number = static_cast<int>(n);
+        frame.profile = profile.get();
+
+        motion_sensor_->set_metadata(RS2_FRAME_METADATA_ACTUAL_EXPOSURE, exposure_us);
+        motion_sensor_->on_motion_frame(frame);
+    }
+
+    void run()
+    {
+        using clock = std::chrono::steady_clock;
+        const auto period = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(1.0 / settings_.fps));
+        auto next = clock::now();
+        double next_accel = 0;
+        double next_gyro = 0;
+        int64_t accel_n = 0;
+        int64_t gyro_n = 0;
+
+        for (int64_t n = 0; running_; ++n)
+        {
+            std::this_thread::sleep_until(next);
+            next += period;
+            // late by more than a frame, e.g. after a stall: skip rather than burst
+            if (clock::now() > next + period)
+                next = clock::now();
+
+            const double timestamp = std::chrono::duration<double, std::milli>(
+                clock::now().time_since_epoch()).count();
+
+            if (color_on_)
+                video_frame(*color_sensor_, color_slots_, color_profile_, 3, false, n, timestamp);
+            if (depth_on_)
+                video_frame(*depth_sensor_, depth_slots_, depth_profile_, 2, true, n, timestamp);
+            if (imu_on_)
+            {
+                // every motion sample due since the last frame, at its own time
+                if (n == 0)
+                    next_accel = next_gyro = timestamp;
+                else if (timestamp - std::min(next_accel, next_gyro) > 1000.0)
+                    next_accel = next_gyro = timestamp; // after a stall
+                for (; next_accel <= timestamp; next_accel += 1000.0 / AccelRate)
+                {
+                    const auto t = static_cast<float>(accel_n) / AccelRate;
+                    motion_frame(accel_profile_, {0.1f * std::sin(t), -9.81f, 0.1f * std::cos(t)}, accel_n++, next_accel);
+                }
+                for (; next_gyro <= timestamp; next_gyro += 1000.0 / GyroRate)
+                {
+                    const auto t = static_cast<float>(gyro_n) / GyroRate;
+                    motion_frame(gyro_profile_, {0.01f * std::cos(t), 0.f, 0.01f * std::sin(t)}, gyro_n++, next_gyro);
+                }
+            }
+        }
+    }
+
+    static constexpr rs2_metadata_type exposure_us = 8500;
+
+    RSSyntheticSettings settings_;
+    rs2::software_device dev_;
+    std::unique_ptr<rs2::software_sensor> color_sensor_;
+    std::unique_ptr<rs2::software_sensor> depth_sensor_;
+    std::unique_ptr<rs2::software_sensor> motion_sensor_;
+    rs2::stream_profile color_profile_;
+    rs2::stream_profile depth_profile_;
+    rs2::stream_profile accel_profile_;
+    rs2::stream_profile gyro_profile_;
+    rs2::syncer syncer_;
+    std::vector<rs2::software_sensor*> opened_;
+
+    bool color_on_ = false;
+    bool depth_on_ = false;
+    bool imu_on_ = false;
+    std::atomic<bool> running_ {false};
+    std::thread thread_;
+    uint32_t rng_ = 2463534242u;
+
+    // only touched by the frame thread and the destructor
+    std::vector<Slot*> color_slots_;
+    std::vector<Slot*> depth_slots_;
+    std::vector<Slot*> motion_slots_;
+};
+
+#endif // __GST_RSSYNTHETIC_H__
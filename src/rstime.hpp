@@ -0,0 +1,111 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSTIME_H__
+#define __GST_RSTIME_H__
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+/* Maps the device timestamps of frames onto the pipeline's running time.
+ *
+ * A frame reaches the host some time after the device stamped it, and that
+ * delay varies with USB, the SDK and scheduling, but is never negative. So
+ * arrival time minus device time is the clock offset plus a delay, and its
+ * minimum over a window of frames is the offset plus the smallest delay.
+ * Following that minimum as the window slides corrects for drift between
+ * the device clock and the pipeline clock, and mapped timestamps keep the
+ * device's frame spacing instead of the host's jitter.
+ *
+ * Times are in nanoseconds except device timestamps, which are in the SDK's
+ * milliseconds. Not thread safe, one mapper per capture thread.
+ */
+class RSClockMapper
+{
+public:
+    static constexpr size_t Window = 128; // frames
+    static constexpr int64_t MaxJump = 1000000000; // device clock reset, ns
+
+    void reset()
+    {
+        started_ = false;
+        count_ = 0;
+        next_ = 0;
+    }
+
+    /* Running time at which the frame was captured, given its device
+     * timestamp and the running time it arrived at. Never later than
+     * arrival and never earlier than the previous frame. */
+    int64_t map(double device_ms, int64_t arrival)
+    {
+        if (started_)
+        {
+            const auto delta = arrival - base_arrival_ - elapsed(device_ms);
+            // the device clock jumped or was reset: start over
+            if (std::abs(delta - offset_) > MaxJump)
+                reset();
+        }
+        if (!started_)
+        {
+            base_device_ = device_ms;
+            base_arrival_ = arrival;
+            offset_ = 0;
+            last_ = INT64_MIN;
+            started_ = true;
+        }
+
+        const auto device_elapsed = elapsed(device_ms);
+        const auto delta = arrival - base_arrival_ - device_elapsed;
+        deltas_[next_] = delta;
+        next_ = (next_ + 1) % Window;
+        count_ = std::min(count_ + 1, Window);
+
+        const auto window_min = *std::min_element(deltas_.begin(), deltas_.begin() + count_);
+        // a smaller delay is proof, drift upwards is followed slowly
+        if (window_min < offset_ || count_ == 1)
+            offset_ = window_min;
+        else
+            offset_ += (window_min - offset_) / 16;
+
+        const auto mapped = std::max(base_arrival_ + device_elapsed + offset_, last_);
+        last_ = mapped;
+        return mapped;
+    }
+
+private:
+    int64_t elapsed(double device_ms) const
+    {
+        return static_cast<int64_t>(std::llround((device_ms - base_device_) * 1e6));
+    }
+
+    bool started_ = false;
+    double base_device_ = 0;
+    int64_t base_arrival_ = 0;
+    int64_t offset_ = 0;
+    int64_t last_ = 0;
+    std::array<int64_t, Window> deltas_ {};
+    size_t count_ = 0;
+    size_t next_ = 0;
+};
+
+#endif // __GST_RSTIME_H__
@@ -0,0 +1,170 @@
+/* GStreamer RealSense is a set of plugins to acquire frames from
+ * Intel RealSense cameras into GStreamer pipeline.
+ * Copyright (C) <2020> Tim Connelly/WKD.SMRT <timpconnelly@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_RSWORKERS_H__
+#define __GST_RSWORKERS_H__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Small thread pool shared by the RealSense elements.
+ *
+ * parallel_for() splits work into bands. The calling thread works on bands
+ * too, so it is safe to call from inside a pool job and never waits on a
+ * band nobody has started.
+ */
+class RSWorkerPool
+{
+public:
+    explicit RSWorkerPool(unsigned int n_threads)
+    {
+        n_threads = std::max(1u, n_threads);
+        for (unsigned int i = 0; i < n_threads; ++i)
+            threads_.emplace_back([this] { run(); });
+    }
+
+    ~RSWorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cond_.notify_all();
+        for (auto& t : threads_)
+            t.join();
+    }
+
+    RSWorkerPool(const RSWorkerPool&) = delete;
+    RSWorkerPool& operator=(const RSWorkerPool&) = delete;
+
+    /* Process wide pool with one thread per core. Never destroyed, so it is
+     * safe to use from static destructors and plugin unload. */
+    static RSWorkerPool& shared()
+    {
+        static auto pool = new RSWorkerPool(std::thread::hardware_concurrency());
+        return *pool;
+    }
+
+    unsigned int size() const { return static_cast<unsigned int>(threads_.size()); }
+
+    void submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        cond_.notify_one();
+    }
+
+    /* Call fn(band) for band in [0, n_bands) using up to max_threads threads
+     * (0 = whole pool plus the caller). Returns when every band is done. */
+    template <typename Fn>
+    void parallel_for(size_t n_bands, Fn&& fn, unsigned int max_threads = 0)
+    {
+        if (n_bands == 0)
+            return;
+
+        const auto helpers = std::min<size_t>(n_bands - 1,
+            max_threads == 0 ? size() : std::min(size(), max_threads - 1));
+        if (helpers == 0)
+        {
+            for (size_t band = 0; band < n_bands; ++band)
+                fn(band);
+            return;
+        }
+
+        struct State
+        {
+            std::atomic<size_t> next {0};
+            std::atomic<size_t> done {0};
+            size_t n_bands;
+            std::function<void(size_t)> fn;
+            std::mutex mutex;
+            std::condition_variable cond;
+        };
+        auto state = std::make_shared<State>();
+        state->n_bands = n_bands;
+        state->fn = std::ref(fn);
+
+        auto work = [](State& st) {
+            for (;;)
+            {
+                const auto band = st.next.fetch_add(1);
+                if (band >= st.n_bands)
+                    return;
+                st.fn(band);
+                if (st.done.fetch_add(1) + 1 == st.n_bands)
+                {
+                    std::lock_guard<std::mutex> lock(st.mutex);
+                    st.cond.notify_all();
+                }
+            }
+        };
+
+        for (size_t i = 0; i < helpers; ++i)
+            submit([state, work] { work(*state); });
+
+        work(*state);
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cond.wait(lock, [&] { return state->done.load() == state->n_bands; });
+    }
+
+    /* Suggested band count for splitting rows across max_threads threads */
+    size_t bands_for(size_t rows, unsigned int max_threads = 0) const
+    {
+        const auto threads = max_threads == 0 ? size() + 1 : max_threads;
+        return std::max<size_t>(1, std::min<size_t>(rows, 4 * threads));
+    }
+
+private:
+    void run()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                if (stopping_ && jobs_.empty())
+                    return;
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::deque<std::function<void()>> jobs_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stopping_ = false;
+};
+
+#endif // __GST_RSWORKERS_H__